@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZAsyncCache.h
\ No newline at end of file
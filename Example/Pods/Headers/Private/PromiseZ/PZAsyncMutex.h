@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZAsyncMutex.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZAsyncSemaphore.h
\ No newline at end of file
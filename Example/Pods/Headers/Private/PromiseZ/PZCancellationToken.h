@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZCancellationToken.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZCoroutine.h
\ No newline at end of file
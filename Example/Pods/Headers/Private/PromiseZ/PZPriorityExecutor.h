@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZPriorityExecutor.h
\ No newline at end of file
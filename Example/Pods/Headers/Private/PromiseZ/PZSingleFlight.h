@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZSingleFlight.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZTaskGroup.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZTypedPromise.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZWorkStealingExecutor.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZAsyncRWLock.h
\ No newline at end of file
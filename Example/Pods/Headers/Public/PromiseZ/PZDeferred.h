@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZDeferred.h
\ No newline at end of file
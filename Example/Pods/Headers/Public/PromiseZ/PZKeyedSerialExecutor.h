@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZKeyedSerialExecutor.h
\ No newline at end of file
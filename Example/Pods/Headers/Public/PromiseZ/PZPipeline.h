@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZPipeline.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZPromiseArena.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZRateLimiter.h
\ No newline at end of file
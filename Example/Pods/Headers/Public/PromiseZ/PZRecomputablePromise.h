@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZRecomputablePromise.h
\ No newline at end of file
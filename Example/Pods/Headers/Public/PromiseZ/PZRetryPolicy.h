@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZRetryPolicy.h
\ No newline at end of file
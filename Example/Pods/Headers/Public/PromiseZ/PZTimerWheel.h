@@ -0,0 +1 @@
+../../../../../Pod/Classes/PZTimerWheel.h
\ No newline at end of file
@@ -16,6 +16,15 @@
     {
         // All subclasses of this will have an internal promise
         _promise = [PZPromise new];
+        
+        // If everything waiting on the promise goes away there is no point in doing the work
+        __weak typeof(self) weakSelf = self;
+        [_promise onAbandoned:^{
+            [weakSelf cancel];
+        }];
+        
+        // If something more urgent starts waiting on the promise, the operation should be scheduled sooner
+        [_promise linkOperation:self];
     }
     
     return self;
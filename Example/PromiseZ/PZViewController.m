@@ -12,6 +12,9 @@
 #import "PZBlurOperation.h"
 
 #import <PromiseZ/PZPromise.h>
+#import <PromiseZ/PZRetryPolicy.h>
+#import <PromiseZ/PZCancellationToken.h>
+#import <PromiseZ/PZDeferred.h>
 #import <KVOController/FBKVOController.h>
 #import <AFNetworking/AFNetworking.h>
 
@@ -25,6 +28,7 @@
 @property (strong, nonatomic) NSOperationQueue *operationQueue;
 
 @property (strong, nonatomic) PZPromise *promise;
+@property (strong, nonatomic) PZCancellationToken *cancellationToken;
 
 @end
 
@@ -55,7 +59,6 @@
             
         } else {
             [button setTitle:@"Download" forState:UIControlStateNormal];
-            [self.operationQueue cancelAllOperations];
         }
     };
     
@@ -93,21 +96,39 @@
         [self.KVOController unobserve:self.promise];
         self.promise = nil;
         
+        // Cancelling the token stops the operations of this chain and skips any steps which haven't started yet.
+        [self.cancellationToken cancel];
+        self.cancellationToken = nil;
+        
         return;
     }
     
     self.isProcessing = YES;
     
+    PZCancellationToken *cancellationToken = [PZCancellationToken new];
+    self.cancellationToken = cancellationToken;
+    
     NSURL *url = [NSURL URLWithString:@"http://lorempixel.com/1024/1024"];
-    self.promise = [[[self downloadPromiseForImageURL:url] thenOnKept:^id(id value) {
+    
+    // Flaky networks are retried with backoff instead of failing the whole chain, but cancelled downloads are not.
+    PZRetryPolicy *retryPolicy = [PZRetryPolicy defaultPolicy];
+    retryPolicy.shouldRetryBlock = ^BOOL(NSError *reason, NSUInteger attempt) {
+        return !cancellationToken.isCancelled && !([reason.domain isEqualToString:NSURLErrorDomain] && reason.code == NSURLErrorCancelled);
+    };
+    
+    PZPromise *downloadPromise = [PZPromise retry:^PZPromise *{
+        return [self downloadPromiseForImageURL:url cancellationToken:cancellationToken];
+    } policy:retryPolicy];
+    
+    self.promise = [[downloadPromise thenOnKept:^id(id value) {
         NSLog(@"Did download image...");
         [self animateImage:value];
-        return [self darkenPromiseForImage:value];
-    } onBroken:nil] thenOnKept:^id(id value) {
+        return [self darkenPromiseForImage:value cancellationToken:cancellationToken];
+    } onBroken:nil cancellationToken:cancellationToken] thenOnKept:^id(id value) {
         NSLog(@"Did darken image...");
         [self animateImage:value];
-        return [self blurPromiseForImage:value];
-    } onBroken:nil];
+        return [self blurPromiseForImage:value cancellationToken:cancellationToken];
+    } onBroken:nil cancellationToken:cancellationToken];
     
     [self.KVOController observe:self.promise keyPath:NSStringFromSelector(@selector(state)) options:0 action:@selector(didChangePromiseState)];
 }
@@ -138,33 +159,37 @@
     }
 }
 
-- (PZPromise *)downloadPromiseForImageURL:(NSURL *)imageURL
+- (PZPromise *)downloadPromiseForImageURL:(NSURL *)imageURL cancellationToken:(PZCancellationToken *)cancellationToken
 {
     AFHTTPRequestOperation *operation = [[AFHTTPRequestOperation alloc] initWithRequest:[NSURLRequest requestWithURL:imageURL]];
     operation.responseSerializer = [AFImageResponseSerializer serializer];
     
-    __block PZPromise *promise = [PZPromise new];
+    // Only the completion blocks can settle the promise. If they are released without being called, the deferred breaks the promise instead of leaving it pending forever.
+    PZDeferred *deferred = [PZDeferred deferred];
     [operation setCompletionBlockWithSuccess:^(AFHTTPRequestOperation *operation, id responseObject) {
-        [promise keepWithValue:responseObject];
+        [deferred keepWithValue:responseObject];
     } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [promise breakWithReason:error];
+        [deferred breakWithReason:error];
     }];
     
+    [cancellationToken linkOperation:operation];
     [self.operationQueue addOperation:operation];
     
-    return promise;
+    return deferred.promise;
 }
 
-- (PZPromise *)darkenPromiseForImage:(UIImage *)image
+- (PZPromise *)darkenPromiseForImage:(UIImage *)image cancellationToken:(PZCancellationToken *)cancellationToken
 {
     PZDarkenOperation *operation = [[PZDarkenOperation alloc] initWithImage:image darkenAmount:0.9];
+    [cancellationToken linkOperation:operation];
     [self.operationQueue addOperation:operation];
     return operation.promise;
 }
 
-- (PZPromise *)blurPromiseForImage:(UIImage *)image
+- (PZPromise *)blurPromiseForImage:(UIImage *)image cancellationToken:(PZCancellationToken *)cancellationToken
 {
     PZBlurOperation *operation = [[PZBlurOperation alloc] initWithImage:image blurAmount:8.0];
+    [cancellationToken linkOperation:operation];
     [self.operationQueue addOperation:operation];
     return operation.promise;
 }
@@ -0,0 +1,205 @@
+//
+//  PZAsyncCacheTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/8/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZAsyncCache.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZAsyncCacheTests : XCTestCase
+
+@end
+
+@implementation PZAsyncCacheTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+
+#pragma mark - Hits and misses
+
+- (void)testHitReturnsCachedPromise
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    __block NSInteger invocationCount = 0;
+    PZPromiseFactoryBlock block = ^PZPromise *{
+        invocationCount += 1;
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    };
+    
+    PZPromise *promiseA = [cache promiseForKey:@"A" usingBlock:block];
+    [self waitForPromise:promiseA];
+    
+    PZPromise *promiseB = [cache promiseForKey:@"A" usingBlock:block];
+    PZPromise *promiseC = [cache promiseForKey:@"A" usingBlock:block];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(promiseB.keptValue, @"A");
+    XCTAssertEqual(promiseB, promiseC);
+    XCTAssertEqual(invocationCount, 1);
+    XCTAssertEqual(cache.missCount, 1);
+    XCTAssertEqual(cache.hitCount, 2);
+}
+
+- (void)testExpiredEntryIsMissed
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    [cache setKeptValue:@"A" forKey:@"A" lifetime:0.05];
+    
+    XCTAssertNotNil([cache cachedPromiseForKey:@"A"]);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    XCTAssertNil([cache cachedPromiseForKey:@"A"]);
+    
+    PZPromise *promise = [cache promiseForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"B"];
+    }];
+    [self waitForPromise:promise];
+    
+    XCTAssertEqualObjects(promise.keptValue, @"B");
+    XCTAssertEqual(cache.missCount, 1);
+}
+
+
+#pragma mark - Eviction
+
+- (void)testCountLimitEvictsLeastRecentlyUsed
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    cache.countLimit = 2;
+    
+    [cache setKeptValue:@"A" forKey:@"A" lifetime:0.0];
+    [cache setKeptValue:@"B" forKey:@"B" lifetime:0.0];
+    
+    // Touching A makes B the least recently used entry.
+    [cache promiseForKey:@"A" usingBlock:^PZPromise *{
+        return nil;
+    }];
+    
+    [cache setKeptValue:@"C" forKey:@"C" lifetime:0.0];
+    
+    XCTAssertNotNil([cache cachedPromiseForKey:@"A"]);
+    XCTAssertNil([cache cachedPromiseForKey:@"B"]);
+    XCTAssertNotNil([cache cachedPromiseForKey:@"C"]);
+    XCTAssertEqual(cache.count, 2);
+    XCTAssertEqual(cache.evictionCount, 1);
+}
+
+- (void)testCostLimitEvictsLeastRecentlyUsed
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    cache.totalCostLimit = 10;
+    cache.costBlock = ^NSUInteger(NSData *value) {
+        return value.length;
+    };
+    
+    [cache setKeptValue:[NSMutableData dataWithLength:4] forKey:@"A" lifetime:0.0];
+    [cache setKeptValue:[NSMutableData dataWithLength:4] forKey:@"B" lifetime:0.0];
+    
+    XCTAssertEqual(cache.totalCost, 8);
+    
+    [cache setKeptValue:[NSMutableData dataWithLength:8] forKey:@"C" lifetime:0.0];
+    
+    XCTAssertNil([cache cachedPromiseForKey:@"A"]);
+    XCTAssertNil([cache cachedPromiseForKey:@"B"]);
+    XCTAssertNotNil([cache cachedPromiseForKey:@"C"]);
+    XCTAssertEqual(cache.totalCost, 8);
+    XCTAssertEqual(cache.evictionCount, 2);
+}
+
+
+#pragma mark - Broken reasons
+
+- (void)testBrokenReasonIsCachedWhenEnabled
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    cache.brokenReasonLifetime = 60.0;
+    
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block NSInteger invocationCount = 0;
+    PZPromiseFactoryBlock block = ^PZPromise *{
+        invocationCount += 1;
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    };
+    
+    PZPromise *promiseA = [cache promiseForKey:@"A" usingBlock:block];
+    [self waitForPromise:promiseA];
+    
+    PZPromise *promiseB = [cache promiseForKey:@"A" usingBlock:block];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateBroken);
+    XCTAssertEqualObjects(promiseB.brokenReason, error);
+    XCTAssertEqual(invocationCount, 1);
+}
+
+- (void)testBrokenReasonIsNotCachedByDefault
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *promise = [cache promiseForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    }];
+    [self waitForPromise:promise];
+    
+    XCTAssertEqualObjects(promise.brokenReason, error);
+    XCTAssertNil([cache cachedPromiseForKey:@"A"]);
+}
+
+
+#pragma mark - Stale while revalidate
+
+- (void)testStaleValueIsReturnedWhileRevalidating
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    cache.staleWhileRevalidateInterval = 60.0;
+    
+    [cache setKeptValue:@"A" forKey:@"A" lifetime:0.05];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    PZPromise *revalidatedPromise = [[PZPromise alloc] initWithKeptValue:@"B"];
+    PZPromise *stalePromise = [cache promiseForKey:@"A" lifetime:60.0 usingBlock:^PZPromise *{
+        return revalidatedPromise;
+    }];
+    
+    XCTAssertEqualObjects(stalePromise.keptValue, @"A");
+    XCTAssertEqual(cache.staleHitCount, 1);
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (![[cache cachedPromiseForKey:@"A"].keptValue isEqual:@"B"] && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertEqualObjects([cache cachedPromiseForKey:@"A"].keptValue, @"B");
+}
+
+- (void)testRemovedKeyIsNotStoredByTaskInFlight
+{
+    PZAsyncCache *cache = [PZAsyncCache new];
+    PZPromise *taskPromise = [PZPromise new];
+    
+    PZPromise *promise = [cache promiseForKey:@"A" usingBlock:^PZPromise *{
+        return taskPromise;
+    }];
+    
+    [cache removePromiseForKey:@"A"];
+    [taskPromise keepWithValue:@"A"];
+    [self waitForPromise:promise];
+    
+    XCTAssertEqualObjects(promise.keptValue, @"A");
+    XCTAssertNil([cache cachedPromiseForKey:@"A"]);
+    XCTAssertEqual(cache.count, 0);
+}
+
+@end
@@ -0,0 +1,140 @@
+//
+//  PZAsyncMutexTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZAsyncMutex.h>
+#import <pthread.h>
+
+static const NSUInteger PZAsyncMutexContentionWidth = 64;
+static const NSUInteger PZAsyncMutexContentionIterations = 100;
+
+@interface PZAsyncMutexTests : XCTestCase
+
+@end
+
+@implementation PZAsyncMutexTests
+
+- (void)testLockIsExclusive
+{
+    PZAsyncMutex *mutex = [PZAsyncMutex new];
+    
+    PZPromise *promiseA = [mutex lock];
+    PZPromise *promiseB = [mutex lock];
+    
+    XCTAssertEqual(promiseA.state, PZPromiseStateKept);
+    XCTAssertEqual(promiseB.state, PZPromiseStatePending);
+    XCTAssertTrue(mutex.isLocked);
+    XCTAssertFalse([mutex tryLock]);
+    
+    [mutex unlock];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateKept);
+    XCTAssertTrue(mutex.isLocked);
+    
+    [mutex unlock];
+    
+    XCTAssertFalse(mutex.isLocked);
+}
+
+- (void)testWithLockSerializesTasks
+{
+    PZAsyncMutex *mutex = [PZAsyncMutex new];
+    PZPromise *taskPromise = [PZPromise new];
+    __block BOOL didStartSecondTask = NO;
+    
+    [mutex withLock:^PZPromise *{
+        return taskPromise;
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Second task should run."];
+    [mutex withLock:^PZPromise *{
+        didStartSecondTask = YES;
+        [expectation fulfill];
+        return nil;
+    }];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    XCTAssertFalse(didStartSecondTask);
+    
+    [taskPromise keepWithValue:nil];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+
+#pragma mark - Performance
+
+- (void)testPthreadMutexContentionPerformance
+{
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(mutex, NULL);
+    
+    [self measureBlock:^{
+        __block NSUInteger counter = 0;
+        XCTestExpectation *expectation = [self expectationWithDescription:@"All continuations should finish."];
+        NSMutableArray *promises = [NSMutableArray new];
+        
+        // Every continuation hangs off its own promise, so they run concurrently and contend for the lock.
+        for (NSUInteger i = 0; i < PZAsyncMutexContentionWidth; i++)
+        {
+            PZPromise *promise = [[PZPromise alloc] initWithKeptValue:nil];
+            [promises addObject:[promise thenOnKept:^id(id value) {
+                for (NSUInteger j = 0; j < PZAsyncMutexContentionIterations; j++)
+                {
+                    pthread_mutex_lock(mutex);
+                    counter += 1;
+                    if (counter == PZAsyncMutexContentionWidth * PZAsyncMutexContentionIterations)
+                    {
+                        [expectation fulfill];
+                    }
+                    pthread_mutex_unlock(mutex);
+                }
+                return nil;
+            } onBroken:nil]];
+        }
+        
+        [self waitForExpectationsWithTimeout:30.0 handler:nil];
+    }];
+    
+    pthread_mutex_destroy(mutex);
+    free(mutex);
+}
+
+- (void)testAsyncMutexContentionPerformance
+{
+    PZAsyncMutex *mutex = [PZAsyncMutex new];
+    
+    [self measureBlock:^{
+        __block NSUInteger counter = 0;
+        XCTestExpectation *expectation = [self expectationWithDescription:@"All continuations should finish."];
+        NSMutableArray *promises = [NSMutableArray new];
+        
+        for (NSUInteger i = 0; i < PZAsyncMutexContentionWidth; i++)
+        {
+            PZPromise *promise = [[PZPromise alloc] initWithKeptValue:nil];
+            [promises addObject:[promise thenOnKept:^id(id value) {
+                for (NSUInteger j = 0; j < PZAsyncMutexContentionIterations; j++)
+                {
+                    [mutex withLock:^PZPromise *{
+                        counter += 1;
+                        if (counter == PZAsyncMutexContentionWidth * PZAsyncMutexContentionIterations)
+                        {
+                            [expectation fulfill];
+                        }
+                        return nil;
+                    }];
+                }
+                return nil;
+            } onBroken:nil]];
+        }
+        
+        [self waitForExpectationsWithTimeout:30.0 handler:nil];
+    }];
+}
+
+@end
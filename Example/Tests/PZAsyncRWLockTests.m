@@ -0,0 +1,195 @@
+//
+//  PZAsyncRWLockTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZAsyncRWLock.h>
+
+@interface PZAsyncRWLockTests : XCTestCase
+
+@end
+
+@implementation PZAsyncRWLockTests
+
+- (void)testReadersShareLock
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    
+    XCTAssertEqual([lock lockRead].state, PZPromiseStateKept);
+    XCTAssertEqual([lock lockRead].state, PZPromiseStateKept);
+    XCTAssertEqual(lock.readerCount, 2);
+    XCTAssertEqual([lock lockWrite].state, PZPromiseStatePending);
+}
+
+- (void)testWriterWaitsForReaders
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    [lock lockRead];
+    
+    PZPromise *writePromise = [lock lockWrite];
+    XCTAssertEqual(writePromise.state, PZPromiseStatePending);
+    
+    [lock unlockRead];
+    
+    XCTAssertEqual(writePromise.state, PZPromiseStateKept);
+    XCTAssertTrue(lock.isWriting);
+    XCTAssertEqual(lock.readerCount, 0);
+}
+
+- (void)testQueuedReadersAreBatched
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    [lock lockWrite];
+    
+    PZPromise *readPromiseA = [lock lockRead];
+    PZPromise *readPromiseB = [lock lockRead];
+    PZPromise *readPromiseC = [lock lockRead];
+    
+    XCTAssertEqual(readPromiseA.state, PZPromiseStatePending);
+    XCTAssertEqual(readPromiseB.state, PZPromiseStatePending);
+    XCTAssertEqual(readPromiseC.state, PZPromiseStatePending);
+    
+    [lock unlockWrite];
+    
+    XCTAssertEqual(readPromiseA.state, PZPromiseStateKept);
+    XCTAssertEqual(readPromiseB.state, PZPromiseStateKept);
+    XCTAssertEqual(readPromiseC.state, PZPromiseStateKept);
+    XCTAssertEqual(lock.readerCount, 3);
+}
+
+- (void)testQueuedWriterIsNotStarvedByLaterReaders
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    [lock lockRead];
+    
+    PZPromise *writePromise = [lock lockWrite];
+    PZPromise *readPromise = [lock lockRead];
+    
+    XCTAssertEqual(readPromise.state, PZPromiseStatePending);
+    
+    [lock unlockRead];
+    
+    XCTAssertEqual(writePromise.state, PZPromiseStateKept);
+    XCTAssertEqual(readPromise.state, PZPromiseStatePending);
+    
+    [lock unlockWrite];
+    
+    XCTAssertEqual(readPromise.state, PZPromiseStateKept);
+}
+
+- (void)testAbandonedWaiterIsSkipped
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    [lock lockRead];
+    
+    PZPromise *writePromiseA = [lock lockWrite];
+    PZPromise *writePromiseB = [lock lockWrite];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Waiter should be abandoned."];
+    [writePromiseA onAbandoned:^{
+        [expectation fulfill];
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *consumer = [writePromiseA thenOnKept:nil onBroken:nil];
+        consumer = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    // The abandoned writer would never unlock, so the next writer is granted the lock instead.
+    [lock unlockRead];
+    
+    XCTAssertEqual(writePromiseA.state, PZPromiseStateBroken);
+    XCTAssertEqual(writePromiseA.brokenReason.code, PZAbandonedError);
+    XCTAssertEqual(writePromiseB.state, PZPromiseStateKept);
+    XCTAssertTrue(lock.isWriting);
+    
+    // Abandoned readers are skipped too, without affecting the readers queued after them.
+    PZPromise *readPromiseA = [lock lockRead];
+    XCTestExpectation *readExpectation = [self expectationWithDescription:@"Readers should be abandoned."];
+    [readPromiseA onAbandoned:^{
+        [readExpectation fulfill];
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *consumer = [readPromiseA thenOnKept:nil onBroken:nil];
+        consumer = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    PZPromise *readPromiseB = [lock lockRead];
+    XCTAssertNotEqual(readPromiseA, readPromiseB);
+    
+    [lock unlockWrite];
+    
+    XCTAssertEqual(readPromiseB.state, PZPromiseStateKept);
+    XCTAssertEqual(lock.readerCount, 1);
+}
+
+- (void)testAbandonedReaderDoesNotHoldBatch
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    [lock lockWrite];
+    
+    PZPromise *readPromiseA = [lock lockRead];
+    PZPromise *readPromiseB = [lock lockRead];
+    PZPromise *readPromiseC = [lock lockRead];
+    PZPromise *writePromise = [lock lockWrite];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Reader should be abandoned."];
+    [readPromiseB onAbandoned:^{
+        [expectation fulfill];
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *consumer = [readPromiseB thenOnKept:nil onBroken:nil];
+        consumer = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    // Only the readers still waiting are let through, so their unlocks are enough to let the writer in.
+    [lock unlockWrite];
+    
+    XCTAssertEqual(readPromiseA.state, PZPromiseStateKept);
+    XCTAssertEqual(readPromiseC.state, PZPromiseStateKept);
+    XCTAssertEqual(lock.readerCount, 2);
+    
+    [lock unlockRead];
+    [lock unlockRead];
+    
+    XCTAssertEqual(writePromise.state, PZPromiseStateKept);
+    XCTAssertTrue(lock.isWriting);
+}
+
+- (void)testWithWriteLockReleasesLock
+{
+    PZAsyncRWLock *lock = [PZAsyncRWLock new];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Task should run."];
+    [lock withWriteLock:^PZPromise *{
+        [expectation fulfill];
+        return nil;
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (lock.isWriting && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertFalse(lock.isWriting);
+}
+
+@end
@@ -0,0 +1,149 @@
+//
+//  PZAsyncSemaphoreTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZAsyncSemaphore.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZAsyncSemaphoreTests : XCTestCase
+
+@end
+
+@implementation PZAsyncSemaphoreTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testAcquireKeepsWhilePermitsAreAvailable
+{
+    PZAsyncSemaphore *semaphore = [[PZAsyncSemaphore alloc] initWithValue:2];
+    
+    XCTAssertEqual([semaphore acquire].state, PZPromiseStateKept);
+    XCTAssertEqual([semaphore acquire].state, PZPromiseStateKept);
+    XCTAssertEqual([semaphore acquire].state, PZPromiseStatePending);
+    XCTAssertEqual(semaphore.availablePermits, 0);
+    XCTAssertFalse([semaphore tryAcquire]);
+}
+
+- (void)testSignalReleasesWaitersInOrder
+{
+    PZAsyncSemaphore *semaphore = [[PZAsyncSemaphore alloc] initWithValue:0];
+    PZPromise *promiseA = [semaphore acquire];
+    PZPromise *promiseB = [semaphore acquire];
+    
+    XCTAssertEqual(semaphore.waiterCount, 2);
+    
+    [semaphore signal];
+    
+    XCTAssertEqual(promiseA.state, PZPromiseStateKept);
+    XCTAssertEqual(promiseB.state, PZPromiseStatePending);
+    XCTAssertEqual(semaphore.availablePermits, 0);
+    
+    [semaphore signal];
+    [semaphore signal];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateKept);
+    XCTAssertEqual(semaphore.availablePermits, 1);
+}
+
+- (void)testAbandonedWaiterIsSkipped
+{
+    PZAsyncSemaphore *semaphore = [[PZAsyncSemaphore alloc] initWithValue:0];
+    PZPromise *promiseA = [semaphore acquire];
+    PZPromise *promiseB = [semaphore acquire];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Waiter should be abandoned."];
+    [promiseA onAbandoned:^{
+        [expectation fulfill];
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *consumer = [promiseA thenOnKept:nil onBroken:nil];
+        consumer = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [semaphore signal];
+    
+    XCTAssertEqual(promiseA.state, PZPromiseStateBroken);
+    XCTAssertEqual(promiseB.state, PZPromiseStateKept);
+}
+
+- (void)testWithPermitLimitsConcurrency
+{
+    PZAsyncSemaphore *semaphore = [[PZAsyncSemaphore alloc] initWithValue:2];
+    NSMutableArray *taskPromises = [NSMutableArray new];
+    NSMutableArray *promises = [NSMutableArray new];
+    __block NSInteger runningCount = 0;
+    __block NSInteger maximumRunningCount = 0;
+    NSObject *lock = [NSObject new];
+    
+    for (NSUInteger i = 0; i < 6; i++)
+    {
+        PZPromise *taskPromise = [PZPromise new];
+        [taskPromises addObject:taskPromise];
+        
+        [promises addObject:[semaphore withPermit:^PZPromise *{
+            @synchronized(lock)
+            {
+                runningCount += 1;
+                maximumRunningCount = MAX(maximumRunningCount, runningCount);
+            }
+            
+            // Finish each task shortly after it starts.
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.01 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+                @synchronized(lock)
+                {
+                    runningCount -= 1;
+                }
+                [taskPromise keepWithValue:@(i)];
+            });
+            
+            return taskPromise;
+        }]];
+    }
+    
+    for (PZPromise *promise in promises)
+    {
+        [self expectPromise:promise toReachState:PZPromiseStateKept];
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertLessThanOrEqual(maximumRunningCount, 2);
+    XCTAssertEqual(semaphore.availablePermits, 2);
+}
+
+- (void)testManyWaitersDoNotBlockThreads
+{
+    PZAsyncSemaphore *semaphore = [[PZAsyncSemaphore alloc] initWithValue:0];
+    NSMutableArray *promises = [NSMutableArray new];
+    
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        [promises addObject:[semaphore acquire]];
+    }
+    
+    XCTAssertEqual(semaphore.waiterCount, 10000);
+    
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        [semaphore signal];
+    }
+    
+    XCTAssertEqual(semaphore.waiterCount, 0);
+    XCTAssertEqual([promises.lastObject state], PZPromiseStateKept);
+}
+
+@end
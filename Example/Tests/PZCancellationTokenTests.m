@@ -0,0 +1,182 @@
+//
+//  PZCancellationTokenTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/14/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZCancellationToken.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZCancellationTokenTests : XCTestCase
+
+@end
+
+@implementation PZCancellationTokenTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+
+#pragma mark - Token
+
+- (void)testCancelExecutesHandlersInOrder
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    NSMutableArray *calls = [NSMutableArray new];
+    
+    [token addCancellationHandler:^{
+        [calls addObject:@"A"];
+    }];
+    [token addCancellationHandler:^{
+        [calls addObject:@"B"];
+    }];
+    
+    XCTAssertFalse(token.isCancelled);
+    
+    [token cancel];
+    [token cancel];
+    
+    XCTAssertTrue(token.isCancelled);
+    XCTAssertEqualObjects(calls, (@[@"A", @"B"]));
+}
+
+- (void)testRemovedHandlerIsNotExecuted
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    __block BOOL didExecute = NO;
+    
+    id registration = [token addCancellationHandler:^{
+        didExecute = YES;
+    }];
+    [token removeCancellationHandler:registration];
+    [token cancel];
+    
+    XCTAssertFalse(didExecute);
+}
+
+- (void)testHandlerAddedAfterCancelExecutesImmediately
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    [token cancel];
+    
+    __block BOOL didExecute = NO;
+    id registration = [token addCancellationHandler:^{
+        didExecute = YES;
+    }];
+    
+    XCTAssertNil(registration);
+    XCTAssertTrue(didExecute);
+}
+
+- (void)testCancelCancelsLinkedOperation
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    
+    [token linkOperation:operation];
+    [token cancel];
+    
+    XCTAssertTrue(operation.isCancelled);
+}
+
+- (void)testFinishedOperationRunsItsCompletionBlock
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Completion block should run."];
+    operation.completionBlock = ^{
+        [expectation fulfill];
+    };
+    
+    // The link is removed as the operation finishes, without replacing the completion block it already had.
+    [token linkOperation:operation];
+    [[NSOperationQueue new] addOperation:operation];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [token cancel];
+    XCTAssertTrue(operation.isFinished);
+}
+
+
+#pragma mark - Promises
+
+- (void)testCancelBreaksPendingPromise
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    PZPromise *promiseA = [PZPromise new];
+    __block BOOL didExecute = NO;
+    
+    PZPromise *promiseB = [promiseA thenOnKept:^id(id value) {
+        didExecute = YES;
+        return value;
+    } onBroken:nil cancellationToken:token];
+    
+    [self expectPromise:promiseB toReachState:PZPromiseStateBroken];
+    
+    [token cancel];
+    [promiseA keepWithValue:@"A"];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promiseB.brokenReason.domain, PZErrorDomain);
+    XCTAssertEqual(promiseB.brokenReason.code, PZCancelledError);
+    
+    // Give the binding promise's continuation drain a chance to run, which should skip the cancelled block.
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    XCTAssertFalse(didExecute);
+}
+
+- (void)testCancelledTokenReturnsBrokenPromise
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    [token cancel];
+    
+    PZPromise *promiseA = [[PZPromise alloc] initWithKeptValue:@"A"];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil cancellationToken:token];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateBroken);
+    XCTAssertEqual(promiseB.brokenReason.code, PZCancelledError);
+}
+
+- (void)testCancelAfterResolutionHasNoEffect
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    PZPromise *promiseA = [[PZPromise alloc] initWithKeptValue:@"A"];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil cancellationToken:token];
+    
+    [self expectPromise:promiseB toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [token cancel];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(promiseB.keptValue, @"A");
+}
+
+- (void)testTokenDoesNotRetainPromise
+{
+    PZCancellationToken *token = [PZCancellationToken new];
+    PZPromise *promiseA = [PZPromise new];
+    __weak PZPromise *weakPromiseB;
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil cancellationToken:token];
+        weakPromiseB = promiseB;
+    }
+    
+    XCTAssertNil(weakPromiseB);
+    XCTAssertNoThrow([token cancel]);
+}
+
+@end
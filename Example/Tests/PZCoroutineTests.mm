@@ -0,0 +1,145 @@
+//
+//  PZCoroutineTests.mm
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/22/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZCoroutine.h>
+#import "XCTestCase+PZPromise.h"
+
+static pz::task<NSString *> PZAppendB(PZPromise *promise)
+{
+    NSString *value = co_await promise;
+    co_return [value stringByAppendingString:@"B"];
+}
+
+static pz::task<NSNumber *> PZSumOfPromises(NSArray *promises)
+{
+    NSInteger sum = 0;
+    for (PZPromise *promise in promises)
+    {
+        NSNumber *value = co_await promise;
+        sum += value.integerValue;
+    }
+    co_return @(sum);
+}
+
+static pz::task<NSNumber *> PZErrorCodeOfPromise(PZPromise *promise)
+{
+    try
+    {
+        co_await promise;
+    }
+    catch (const pz::broken_promise &exception)
+    {
+        co_return @(exception.reason().code);
+    }
+    co_return nil;
+}
+
+static pz::task<void> PZRaiseAfterPromise(PZPromise *promise)
+{
+    co_await promise;
+    [NSException raise:NSInternalInconsistencyException format:@"Expected exception."];
+}
+
+@interface PZCoroutineTests : XCTestCase
+
+@end
+
+@implementation PZCoroutineTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testAwaitingPendingPromiseResumesWithKeptValue
+{
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = PZAppendB(promise);
+    
+    XCTAssertEqual(result.state, PZPromiseStatePending);
+    
+    [self expectPromise:result toReachState:PZPromiseStateKept];
+    [promise keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.keptValue, @"AB");
+}
+
+- (void)testAwaitingResolvedPromiseDoesNotSuspend
+{
+    PZPromise *promise = [[PZPromise alloc] initWithKeptValue:@"A"];
+    PZPromise *result = PZAppendB(promise);
+    
+    XCTAssertEqual(result.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(result.keptValue, @"AB");
+}
+
+- (void)testAwaitingSeveralPromises
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [PZPromise new];
+    PZPromise *result = PZSumOfPromises(@[promiseA, promiseB, [[PZPromise alloc] initWithKeptValue:@3]]);
+    
+    [self expectPromise:result toReachState:PZPromiseStateKept];
+    [promiseB keepWithValue:@2];
+    [promiseA keepWithValue:@1];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.keptValue, @6);
+}
+
+- (void)testBrokenPromiseBreaksTask
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = PZAppendB(promise);
+    
+    [self expectPromise:result toReachState:PZPromiseStateBroken];
+    [promise breakWithReason:error];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.brokenReason, error);
+}
+
+- (void)testBrokenPromiseCanBeCaught
+{
+    PZPromise *promise = [[PZPromise alloc] initWithBrokenReason:[NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil]];
+    PZPromise *result = PZErrorCodeOfPromise(promise);
+    
+    XCTAssertEqual(result.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(result.keptValue, @900);
+}
+
+- (void)testExceptionBreaksTask
+{
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = PZRaiseAfterPromise(promise);
+    
+    [self expectPromise:result toReachState:PZPromiseStateBroken];
+    [promise keepWithValue:nil];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(result.brokenReason.code, PZExceptionError);
+}
+
+- (void)testChainingTasks
+{
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = PZAppendB(PZAppendB(promise));
+    
+    [self expectPromise:result toReachState:PZPromiseStateKept];
+    [promise keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.keptValue, @"ABB");
+}
+
+@end
@@ -0,0 +1,109 @@
+//
+//  PZDeferredTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/15/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZDeferred.h>
+
+@interface PZDeferredTests : XCTestCase
+
+@end
+
+@implementation PZDeferredTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testDeferredKeepsPromise
+{
+    PZDeferred *deferred = [PZDeferred deferred];
+    
+    XCTAssertEqual(deferred.promise.state, PZPromiseStatePending);
+    XCTAssertTrue([deferred keepWithValue:@"A"]);
+    XCTAssertFalse([deferred breakWithReason:nil]);
+    
+    XCTAssertEqual(deferred.promise.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(deferred.promise.keptValue, @"A");
+}
+
+- (void)testDeferredBreaksPromise
+{
+    PZDeferred *deferred = [PZDeferred deferred];
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    
+    XCTAssertTrue([deferred breakWithReason:error]);
+    
+    XCTAssertEqual(deferred.promise.state, PZPromiseStateBroken);
+    XCTAssertEqualObjects(deferred.promise.brokenReason, error);
+}
+
+- (void)testPromiseCannotBeSettledDirectly
+{
+    PZDeferred *deferred = [PZDeferred deferred];
+    
+    XCTAssertFalse([deferred.promise keepWithValue:@"A"]);
+    XCTAssertFalse([deferred.promise breakWithReason:nil]);
+    XCTAssertEqual(deferred.promise.state, PZPromiseStatePending);
+}
+
+- (void)testDeallocatingDeferredBreaksPendingPromise
+{
+    PZPromise *promise;
+    
+    @autoreleasepool
+    {
+        PZDeferred *deferred = [PZDeferred deferred];
+        promise = deferred.promise;
+    }
+    
+    XCTAssertEqual(promise.state, PZPromiseStateBroken);
+    XCTAssertEqualObjects(promise.brokenReason.domain, PZErrorDomain);
+    XCTAssertEqual(promise.brokenReason.code, PZAbandonedError);
+}
+
+- (void)testDeallocatingDeferredReleasesContinuations
+{
+    PZPromise *promiseB;
+    __weak id weakObject;
+    
+    @autoreleasepool
+    {
+        PZDeferred *deferred = [PZDeferred deferred];
+        NSObject *object = [NSObject new];
+        weakObject = object;
+        
+        promiseB = [deferred.promise thenOnKept:^id(id value) {
+            return object;
+        } onBroken:nil];
+    }
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Bound promise should break."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateBroken)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(promiseB.brokenReason.code, PZAbandonedError);
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakObject && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertNil(weakObject);
+}
+
+@end
@@ -0,0 +1,166 @@
+//
+//  PZKeyedSerialExecutorTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/19/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZKeyedSerialExecutor.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZKeyedSerialExecutorTests : XCTestCase
+
+@end
+
+@implementation PZKeyedSerialExecutorTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testTasksForSameKeyRunInOrder
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:4];
+    NSMutableArray *order = [NSMutableArray new];
+    PZPromise *slowPromise = [PZPromise new];
+    
+    [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        @synchronized(order)
+        {
+            [order addObject:@1];
+        }
+        return slowPromise;
+    }];
+    
+    PZPromise *promise = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        @synchronized(order)
+        {
+            [order addObject:@2];
+        }
+        return nil;
+    }];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    XCTAssertEqualObjects(order, (@[@1]));
+    
+    [self expectPromise:promise toReachState:PZPromiseStateKept];
+    [slowPromise keepWithValue:nil];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(order, (@[@1, @2]));
+}
+
+- (void)testBrokenTaskDoesNotStallKey
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:4];
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    
+    PZPromise *promiseA = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    }];
+    PZPromise *promiseB = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"B"];
+    }];
+    
+    [self expectPromise:promiseA toReachState:PZPromiseStateBroken];
+    [self expectPromise:promiseB toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promiseA.brokenReason, error);
+    XCTAssertEqualObjects(promiseB.keptValue, @"B");
+}
+
+- (void)testDifferentKeysRunInParallel
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:1024];
+    PZPromise *blockedPromise = [PZPromise new];
+    
+    // Small NSNumbers hash to their own value, so these keys are known to land on different lanes.
+    [executor submitForKey:@1 usingBlock:^PZPromise *{
+        return blockedPromise;
+    }];
+    
+    PZPromise *promise = [executor submitForKey:@2 usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"B"];
+    }];
+    
+    [self expectPromise:promise toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(blockedPromise.state, PZPromiseStatePending);
+}
+
+- (void)testIdleKeysAreNotRetained
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:4];
+    __weak id weakKey;
+    
+    @autoreleasepool
+    {
+        NSString *key = [NSString stringWithFormat:@"%@-%@", @"key", [NSUUID UUID].UUIDString];
+        weakKey = key;
+        [executor submitForKey:key usingBlock:^PZPromise *{
+            return nil;
+        }];
+    }
+    
+    XCTAssertNil(weakKey);
+}
+
+- (void)testSettledTailIsReleased
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:1];
+    __weak PZPromise *weakPromise;
+    
+    @autoreleasepool
+    {
+        PZPromise *promise = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+            return [[PZPromise alloc] initWithKeptValue:@"A"];
+        }];
+        weakPromise = promise;
+        
+        XCTAssertTrue([promise waitWithTimeout:5.0]);
+    }
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakPromise && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertNil(weakPromise);
+}
+
+- (void)testNewerTailIsKeptWhenOlderTaskSettles
+{
+    PZKeyedSerialExecutor *executor = [[PZKeyedSerialExecutor alloc] initWithLaneCount:1];
+    PZPromise *blockingPromise = [PZPromise new];
+    NSMutableArray *order = [NSMutableArray new];
+    
+    PZPromise *promiseA = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        return blockingPromise;
+    }];
+    PZPromise *promiseB = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        [order addObject:@"B"];
+        return nil;
+    }];
+    
+    [blockingPromise keepWithValue:@"A"];
+    XCTAssertTrue([promiseA waitWithTimeout:5.0]);
+    
+    // Submitted while the second task may still be pending, so it must run after it.
+    PZPromise *promiseC = [executor submitForKey:@"A" usingBlock:^PZPromise *{
+        [order addObject:@"C"];
+        return nil;
+    }];
+    
+    XCTAssertTrue([PZPromise waitAll:@[promiseB, promiseC] timeout:5.0]);
+    XCTAssertEqualObjects(order, (@[@"B", @"C"]));
+}
+
+@end
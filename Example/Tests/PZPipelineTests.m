@@ -0,0 +1,151 @@
+//
+//  PZPipelineTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/24/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZPipeline.h>
+#import "XCTestCase+PZPromise.h"
+
+static const NSUInteger PZPipelineLength = 100;
+
+@interface PZPipelineTests : XCTestCase
+
+@end
+
+@implementation PZPipelineTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testBlocksRunInOrder
+{
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = [[[promise map:^id(NSString *value) {
+        return [value stringByAppendingString:@"B"];
+    }] map:^id(NSString *value) {
+        return [value stringByAppendingString:@"C"];
+    }] promise];
+    
+    [self expectPromise:result toReachState:PZPromiseStateKept];
+    [promise keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.keptValue, @"ABC");
+}
+
+- (void)testBrokenPromiseSkipsBlocks
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block BOOL didRunBlock = NO;
+    PZPromise *result = [[[[PZPromise alloc] initWithBrokenReason:error] map:^id(id value) {
+        didRunBlock = YES;
+        return value;
+    }] promise];
+    
+    [self expectPromise:result toReachState:PZPromiseStateBroken];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertFalse(didRunBlock);
+    XCTAssertEqualObjects(result.brokenReason, error);
+}
+
+- (void)testLaterBlocksWaitForReturnedThenable
+{
+    PZPromise *inner = [PZPromise new];
+    PZPromise *result = [[[[[PZPromise alloc] initWithKeptValue:@"A"] map:^id(id value) {
+        return inner;
+    }] map:^id(NSString *value) {
+        return [value stringByAppendingString:@"C"];
+    }] promise];
+    
+    [self expectPromise:result toReachState:PZPromiseStateKept];
+    [inner keepWithValue:@"B"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(result.keptValue, @"BC");
+}
+
+- (void)testExceptionBreaksResult
+{
+    PZPromise *result = [[[[[PZPromise alloc] initWithKeptValue:nil] map:^id(id value) {
+        [NSException raise:NSInternalInconsistencyException format:@"Expected exception."];
+        return nil;
+    }] map:^id(id value) {
+        return @"Unexpected";
+    }] promise];
+    
+    [self expectPromise:result toReachState:PZPromiseStateBroken];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(result.brokenReason.code, PZExceptionError);
+}
+
+- (void)testMapDoesNotChangeReceiver
+{
+    PZPipeline *pipeline = [[[PZPromise alloc] initWithKeptValue:@1] map:^id(NSNumber *value) {
+        return @(value.integerValue + 1);
+    }];
+    PZPipeline *longerPipeline = [pipeline map:^id(NSNumber *value) {
+        return @(value.integerValue * 10);
+    }];
+    
+    XCTAssertEqual(pipeline.blocks.count, (NSUInteger)1);
+    XCTAssertEqual(longerPipeline.blocks.count, (NSUInteger)2);
+    
+    PZPromise *result = [pipeline promise];
+    PZPromise *longerResult = [longerPipeline promise];
+    XCTAssertTrue([PZPromise waitAll:@[result, longerResult] timeout:5.0]);
+    
+    XCTAssertEqualObjects(result.keptValue, @2);
+    XCTAssertEqualObjects(longerResult.keptValue, @20);
+}
+
+
+#pragma mark - Performance
+
+- (void)testChainedBlocksPerformance
+{
+    [self measureBlock:^{
+        PZPromise *promise = [PZPromise new];
+        PZPromise *result = promise;
+        for (NSUInteger i = 0; i < PZPipelineLength; i++)
+        {
+            result = [result thenOnKept:^id(NSNumber *value) {
+                return @(value.integerValue + 1);
+            } onBroken:nil];
+        }
+        
+        [promise keepWithValue:@0];
+        XCTAssertTrue([result waitWithTimeout:30.0]);
+        XCTAssertEqualObjects(result.keptValue, @(PZPipelineLength));
+    }];
+}
+
+- (void)testPipelinePerformance
+{
+    [self measureBlock:^{
+        PZPromise *promise = [PZPromise new];
+        PZPipeline *pipeline = [[PZPipeline alloc] initWithPromise:promise];
+        for (NSUInteger i = 0; i < PZPipelineLength; i++)
+        {
+            pipeline = [pipeline map:^id(NSNumber *value) {
+                return @(value.integerValue + 1);
+            }];
+        }
+        PZPromise *result = [pipeline promise];
+        
+        [promise keepWithValue:@0];
+        XCTAssertTrue([result waitWithTimeout:30.0]);
+        XCTAssertEqualObjects(result.keptValue, @(PZPipelineLength));
+    }];
+}
+
+@end
@@ -0,0 +1,198 @@
+//
+//  PZPriorityExecutorTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/21/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZPriorityExecutor.h>
+#import <PromiseZ/PZWorkStealingExecutor.h>
+
+static const NSUInteger PZPriorityLatencyLowCount = 1000;
+static const NSUInteger PZPriorityLatencyHighCount = 100;
+static const NSTimeInterval PZPriorityLatencyBlockDuration = 0.001;
+
+@interface PZPriorityExecutorTests : XCTestCase
+
+@end
+
+@implementation PZPriorityExecutorTests
+
+// Occupies the executor's only worker until the returned semaphore is signaled, so blocks can be queued up behind it.
+- (dispatch_semaphore_t)blockWorkerOfExecutor:(id<PZExecutor>)executor
+{
+    dispatch_semaphore_t startedSemaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t gateSemaphore = dispatch_semaphore_create(0);
+    
+    [executor executeBlock:^{
+        dispatch_semaphore_signal(startedSemaphore);
+        dispatch_semaphore_wait(gateSemaphore, DISPATCH_TIME_FOREVER);
+    } priority:PZPromisePriorityHigh];
+    
+    dispatch_semaphore_wait(startedSemaphore, DISPATCH_TIME_FOREVER);
+    return gateSemaphore;
+}
+
+- (void)testHigherPriorityExecutesFirst
+{
+    PZPriorityExecutor *executor = [[PZPriorityExecutor alloc] initWithWorkerCount:1 agingInterval:10.0];
+    NSMutableArray *order = [NSMutableArray new];
+    dispatch_semaphore_t gateSemaphore = [self blockWorkerOfExecutor:executor];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Every block should execute."];
+    [executor executeBlock:^{
+        [order addObject:@"Low"];
+        [expectation fulfill];
+    } priority:PZPromisePriorityLow];
+    [executor executeBlock:^{
+        [order addObject:@"Default"];
+    } priority:PZPromisePriorityDefault];
+    [executor executeBlock:^{
+        [order addObject:@"High"];
+    } priority:PZPromisePriorityHigh];
+    
+    XCTAssertEqual(executor.pendingCount, 3);
+    
+    dispatch_semaphore_signal(gateSemaphore);
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(order, (@[@"High", @"Default", @"Low"]));
+}
+
+- (void)testExecutePendingBlockRunsBestBlockOnCaller
+{
+    PZPriorityExecutor *executor = [[PZPriorityExecutor alloc] initWithWorkerCount:1 agingInterval:10.0];
+    NSMutableArray *order = [NSMutableArray new];
+    dispatch_semaphore_t gateSemaphore = [self blockWorkerOfExecutor:executor];
+    
+    [executor executeBlock:^{
+        [order addObject:@"Low"];
+    } priority:PZPromisePriorityLow];
+    [executor executeBlock:^{
+        XCTAssertTrue([NSThread isMainThread]);
+        [order addObject:@"High"];
+    } priority:PZPromisePriorityHigh];
+    
+    XCTAssertTrue([executor executePendingBlock]);
+    XCTAssertEqualObjects(order, (@[@"High"]));
+    XCTAssertEqual(executor.pendingCount, 1);
+    
+    XCTAssertTrue([executor executePendingBlock]);
+    XCTAssertFalse([executor executePendingBlock]);
+    XCTAssertEqualObjects(order, (@[@"High", @"Low"]));
+    
+    dispatch_semaphore_signal(gateSemaphore);
+}
+
+- (void)testSamePriorityExecutesInOrder
+{
+    PZPriorityExecutor *executor = [[PZPriorityExecutor alloc] initWithWorkerCount:1 agingInterval:10.0];
+    NSMutableArray *order = [NSMutableArray new];
+    dispatch_semaphore_t gateSemaphore = [self blockWorkerOfExecutor:executor];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Every block should execute."];
+    for (NSUInteger i = 0; i < 10; i++)
+    {
+        [executor executeBlock:^{
+            [order addObject:@(i)];
+            if (i == 9)
+            {
+                [expectation fulfill];
+            }
+        } priority:PZPromisePriorityDefault];
+    }
+    
+    dispatch_semaphore_signal(gateSemaphore);
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(order, (@[@0, @1, @2, @3, @4, @5, @6, @7, @8, @9]));
+}
+
+- (void)testAgingPreventsStarvation
+{
+    PZPriorityExecutor *executor = [[PZPriorityExecutor alloc] initWithWorkerCount:1 agingInterval:0.01];
+    __block BOOL didExecuteLowBlock = NO;
+    __block NSUInteger highBlockCount = 0;
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The low priority block should execute."];
+    [executor executeBlock:^{
+        didExecuteLowBlock = YES;
+        [expectation fulfill];
+    } priority:PZPromisePriorityLow];
+    
+    // Every high priority block queues another one, so there is always high priority work waiting.
+    __block __weak dispatch_block_t weakHighBlock;
+    dispatch_block_t highBlock = ^{
+        [NSThread sleepForTimeInterval:PZPriorityLatencyBlockDuration];
+        highBlockCount += 1;
+        if (!didExecuteLowBlock && highBlockCount < 10000)
+        {
+            [executor executeBlock:weakHighBlock priority:PZPromisePriorityHigh];
+        }
+    };
+    weakHighBlock = highBlock;
+    [executor executeBlock:highBlock priority:PZPromisePriorityHigh];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    // Two levels of aging take about 20 milliseconds, which is far fewer than 10000 blocks.
+    XCTAssertLessThan(highBlockCount, 1000);
+}
+
+
+#pragma mark - Latency
+
+- (NSTimeInterval)p99LatencyOfHighPriorityBlocksWithExecutor:(id<PZExecutor>)executor
+{
+    NSMutableArray *latencies = [NSMutableArray new];
+    dispatch_group_t lowGroup = dispatch_group_create();
+    dispatch_group_t highGroup = dispatch_group_create();
+    
+    // Queue far more low priority work than the workers can get through while the high priority blocks arrive.
+    for (NSUInteger i = 0; i < PZPriorityLatencyLowCount; i++)
+    {
+        dispatch_group_enter(lowGroup);
+        [executor executeBlock:^{
+            [NSThread sleepForTimeInterval:PZPriorityLatencyBlockDuration];
+            dispatch_group_leave(lowGroup);
+        } priority:PZPromisePriorityLow];
+    }
+    
+    for (NSUInteger i = 0; i < PZPriorityLatencyHighCount; i++)
+    {
+        NSTimeInterval enqueueTime = [NSProcessInfo processInfo].systemUptime;
+        dispatch_group_enter(highGroup);
+        [executor executeBlock:^{
+            NSTimeInterval latency = [NSProcessInfo processInfo].systemUptime - enqueueTime;
+            @synchronized(latencies)
+            {
+                [latencies addObject:@(latency)];
+            }
+            dispatch_group_leave(highGroup);
+        } priority:PZPromisePriorityHigh];
+        
+        [NSThread sleepForTimeInterval:PZPriorityLatencyBlockDuration * 2.0];
+    }
+    
+    dispatch_group_wait(highGroup, DISPATCH_TIME_FOREVER);
+    dispatch_group_wait(lowGroup, DISPATCH_TIME_FOREVER);
+    
+    NSArray *sortedLatencies = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    return [sortedLatencies[(sortedLatencies.count * 99) / 100] doubleValue];
+}
+
+- (void)testHighPriorityLatencyUnderLowPriorityLoad
+{
+    // The work-stealing executor ignores priorities, so its high priority blocks wait behind the low priority backlog. Both run the same load on the same machine, which keeps the comparison meaningful however fast the machine is.
+    PZWorkStealingExecutor *baselineExecutor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:2];
+    NSTimeInterval baselineP99Latency = [self p99LatencyOfHighPriorityBlocksWithExecutor:baselineExecutor];
+    
+    PZPriorityExecutor *executor = [[PZPriorityExecutor alloc] initWithWorkerCount:2 agingInterval:0.05];
+    NSTimeInterval p99Latency = [self p99LatencyOfHighPriorityBlocksWithExecutor:executor];
+    
+    XCTAssertLessThan(p99Latency, baselineP99Latency);
+}
+
+@end
@@ -0,0 +1,218 @@
+//
+//  PZPromiseArenaTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/25/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZPromise.h>
+#import <PromiseZ/PZPromiseArena.h>
+
+static const NSUInteger PZPromiseArenaChainCount = 100;
+
+@interface PZPromiseArenaTests : XCTestCase
+
+@end
+
+@implementation PZPromiseArenaTests
+
+- (void)testArenaIsCurrentOnlyWithinBlock
+{
+    PZPromiseArena *arena = [PZPromiseArena new];
+    PZPromiseArena *nestedArena = [PZPromiseArena new];
+    
+    XCTAssertNil([PZPromiseArena currentArena]);
+    [arena performBlock:^{
+        XCTAssertEqual([PZPromiseArena currentArena], arena);
+        [nestedArena performBlock:^{
+            XCTAssertEqual([PZPromiseArena currentArena], nestedArena);
+        }];
+        XCTAssertEqual([PZPromiseArena currentArena], arena);
+    }];
+    XCTAssertNil([PZPromiseArena currentArena]);
+}
+
+- (void)testAllocationsAreAlignedAndCounted
+{
+    PZPromiseArena *arena = [[PZPromiseArena alloc] initWithSlabSize:64];
+    
+    void *first = [arena allocateBytes:1];
+    void *second = [arena allocateBytes:40];
+    XCTAssertTrue(first != NULL && second != NULL);
+    XCTAssertEqual((uintptr_t)first % 16, (uintptr_t)0);
+    XCTAssertEqual((uintptr_t)second % 16, (uintptr_t)0);
+    XCTAssertEqual(arena.liveAllocationCount, (NSUInteger)2);
+    
+    // The second slab starts once the first is full.
+    NSUInteger byteCount = arena.allocatedByteCount;
+    void *third = [arena allocateBytes:64];
+    XCTAssertTrue(third != NULL);
+    XCTAssertTrue(arena.allocatedByteCount > byteCount);
+    
+    XCTAssertTrue([arena allocateBytes:65] == NULL);
+    
+    [arena relinquishBytes:first];
+    XCTAssertEqual(arena.liveAllocationCount, (NSUInteger)2);
+    
+    [arena relinquishBytes:second];
+    [arena relinquishBytes:third];
+    XCTAssertEqual(arena.liveAllocationCount, (NSUInteger)0);
+}
+
+- (void)testEmptyArenaReusesNewestSlab
+{
+    PZPromiseArena *arena = [[PZPromiseArena alloc] initWithSlabSize:64];
+    
+    void *first = [arena allocateBytes:64];
+    void *second = [arena allocateBytes:64];
+    NSUInteger byteCount = arena.allocatedByteCount;
+    
+    [arena relinquishBytes:first];
+    XCTAssertEqual(arena.allocatedByteCount, byteCount);
+    
+    [arena relinquishBytes:second];
+    XCTAssertTrue(arena.allocatedByteCount < byteCount);
+    
+    void *third = [arena allocateBytes:64];
+    XCTAssertTrue(third == second);
+    XCTAssertTrue(arena.allocatedByteCount < byteCount);
+    
+    [arena relinquishBytes:third];
+}
+
+- (void)testClosedArenaDoesNotAllocate
+{
+    PZPromiseArena *arena = [PZPromiseArena new];
+    void *bytes = [arena allocateBytes:16];
+    
+    [arena close];
+    XCTAssertTrue(arena.isClosed);
+    XCTAssertEqual(arena.escapedAllocationCount, (NSUInteger)1);
+    XCTAssertTrue([arena allocateBytes:16] == NULL);
+    
+    [arena relinquishBytes:bytes];
+}
+
+- (void)testChainsInArenaUseArena
+{
+    PZPromiseArena *arena = [PZPromiseArena new];
+    PZPromise *promise = [PZPromise new];
+    
+    __block PZPromiseArena *blockArena;
+    __block PZPromise *result;
+    [arena performBlock:^{
+        result = [promise thenOnKept:^id(NSString *value) {
+            blockArena = [PZPromiseArena currentArena];
+            return [value stringByAppendingString:@"B"];
+        } onBroken:nil];
+    }];
+    XCTAssertEqual(arena.liveAllocationCount, (NSUInteger)1);
+    
+    [promise keepWithValue:@"A"];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(result.keptValue, @"AB");
+    XCTAssertEqual(blockArena, arena);
+    
+    [arena close];
+    XCTAssertEqual(arena.escapedAllocationCount, (NSUInteger)0);
+}
+
+- (void)testClosedArenaIsNotCurrentForBlocks
+{
+    PZPromiseArena *arena = [PZPromiseArena new];
+    PZPromise *promise = [PZPromise new];
+    
+    __block BOOL blockHadArena = YES;
+    __block PZPromise *result;
+    [arena performBlock:^{
+        result = [promise thenOnKept:^id(id value) {
+            blockHadArena = ([PZPromiseArena currentArena] != nil);
+            return value;
+        } onBroken:nil];
+    }];
+    [arena close];
+    
+    [promise keepWithValue:@"A"];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertFalse(blockHadArena);
+}
+
+- (void)testEscapingChainKeepsArenaAlive
+{
+    PZPromise *promise = [PZPromise new];
+    __weak PZPromiseArena *weakArena;
+    PZPromise *result;
+    
+    @autoreleasepool
+    {
+        PZPromiseArena *arena = [PZPromiseArena new];
+        weakArena = arena;
+        
+        __block PZPromise *arenaResult;
+        [arena performBlock:^{
+            arenaResult = [promise thenOnKept:^id(NSString *value) {
+                return [value stringByAppendingString:@"B"];
+            } onBroken:nil];
+        }];
+        result = arenaResult;
+        
+        [arena close];
+        XCTAssertEqual(arena.escapedAllocationCount, (NSUInteger)1);
+    }
+    
+    XCTAssertNotNil(weakArena);
+    
+    [promise keepWithValue:@"A"];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(result.keptValue, @"AB");
+    
+    // The drain releases its reference to the arena shortly after resolving the result.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakArena && [deadline timeIntervalSinceNow] > 0.0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertNil(weakArena);
+}
+
+
+#pragma mark - Performance
+
+- (void)testChainingPerformance
+{
+    [self measureBlock:^{
+        [self _buildAndResolveChains];
+    }];
+}
+
+- (void)testChainingInArenaPerformance
+{
+    [self measureBlock:^{
+        PZPromiseArena *arena = [PZPromiseArena new];
+        [arena performBlock:^{
+            [self _buildAndResolveChains];
+        }];
+        [arena close];
+    }];
+}
+
+- (void)_buildAndResolveChains
+{
+    PZPromise *promise = [PZPromise new];
+    NSMutableArray *results = [NSMutableArray new];
+    for (NSUInteger i = 0; i < PZPromiseArenaChainCount; i++)
+    {
+        [results addObject:[[promise thenOnKept:^id(NSNumber *value) {
+            return @(value.integerValue + 1);
+        } onBroken:nil] thenOnKept:^id(NSNumber *value) {
+            return @(value.integerValue * 2);
+        } onBroken:nil]];
+    }
+    
+    [promise keepWithValue:@0];
+    XCTAssertTrue([PZPromise waitAll:results timeout:30.0]);
+}
+
+@end
@@ -10,6 +10,8 @@
 #import <OCMock/OCMock.h>
 #import <KVOController/FBKVOController.h>
 #import <PromiseZ/PZPromise.h>
+#import <PromiseZ/PZTimerWheel.h>
+#import <PromiseZ/PZWorkStealingExecutor.h>
 
 @interface PZSpyThenable : NSObject <PZThenable>
 
@@ -78,6 +80,38 @@
 @end
 
 
+// Records the priority of every block it executes, then executes it on a global queue.
+@interface PZSpyExecutor : NSObject <PZExecutor>
+@property (strong, nonatomic, readonly) NSMutableArray *priorities;
+@end
+
+@implementation PZSpyExecutor
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _priorities = [NSMutableArray new];
+    
+    return self;
+}
+
+- (void)executeBlock:(dispatch_block_t)block priority:(PZPromisePriority)priority
+{
+    @synchronized(self.priorities)
+    {
+        [self.priorities addObject:@(priority)];
+    }
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), block);
+}
+
+@end
+
+
 @interface PZPromiseTests : XCTestCase
 
 @end
@@ -86,6 +120,8 @@
 
 - (void)tearDown
 {
+    // Restored here rather than at the end of a test, so a test which fails early can't leave its executor in place for the rest.
+    [PZPromise setDefaultExecutor:nil];
     [self.KVOController unobserveAll];
     [super tearDown];
 }
@@ -124,6 +160,62 @@
     XCTAssertNil(promise.keptValue);
 }
 
+- (void)testKeptNilIsShared
+{
+    PZPromise *promise = [PZPromise keptNil];
+    
+    XCTAssertEqual(promise, [PZPromise keptNil]);
+    XCTAssertEqual(promise, [PZPromise promiseWithKeptValue:nil]);
+    XCTAssertEqual(promise.state, PZPromiseStateKept);
+    XCTAssertNil(promise.keptValue);
+    XCTAssertFalse([promise keepWithValue:@"A"]);
+}
+
+- (void)testPromiseWithKeptValueInternsSmallImmutableValues
+{
+    XCTAssertEqual([PZPromise promiseWithKeptValue:@YES], [PZPromise promiseWithKeptValue:@YES]);
+    XCTAssertEqual([PZPromise promiseWithKeptValue:@0], [PZPromise promiseWithKeptValue:@0]);
+    XCTAssertEqual([PZPromise promiseWithKeptValue:@""], [PZPromise promiseWithKeptValue:@""]);
+    XCTAssertEqual([PZPromise promiseWithKeptValue:@[]], [PZPromise promiseWithKeptValue:@[]]);
+    XCTAssertEqual([PZPromise promiseWithKeptValue:[NSNull null]], [PZPromise promiseWithKeptValue:[NSNull null]]);
+    
+    XCTAssertEqualObjects([PZPromise promiseWithKeptValue:@"A"].keptValue, @"A");
+}
+
+- (void)testPromiseWithKeptValueKeepsKindsOfNumbersApart
+{
+    PZPromise *boolPromise = [PZPromise promiseWithKeptValue:@YES];
+    PZPromise *integerPromise = [PZPromise promiseWithKeptValue:@1];
+    PZPromise *doublePromise = [PZPromise promiseWithKeptValue:@1.0];
+    
+    XCTAssertEqual(boolPromise.keptValue, (id)kCFBooleanTrue);
+    XCTAssertNotEqual(integerPromise.keptValue, (id)kCFBooleanTrue);
+    XCTAssertEqual(strcmp([doublePromise.keptValue objCType], @encode(double)), 0);
+}
+
+- (void)testPromiseWithKeptValueDoesNotInternMutableValues
+{
+    NSMutableArray *array = [NSMutableArray new];
+    PZPromise *promiseA = [PZPromise promiseWithKeptValue:array];
+    PZPromise *promiseB = [PZPromise promiseWithKeptValue:array];
+    
+    XCTAssertNotEqual(promiseA, promiseB);
+    XCTAssertEqual(promiseA.keptValue, array);
+}
+
+- (void)testResolvedPromiseWithoutBlockReturnsItself
+{
+    PZPromise *promise = [[PZPromise alloc] initWithKeptValue:@"A"];
+    
+    XCTAssertEqual([promise thenOnKept:nil onBroken:^id(NSError *reason) {
+        return nil;
+    }], promise);
+    XCTAssertNotEqual([promise thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh], promise);
+    XCTAssertNotEqual([promise thenOnKept:^id(id value) {
+        return value;
+    } onBroken:nil], promise);
+}
+
 
 #pragma mark - Keeping and breaking
 
@@ -657,7 +749,7 @@
             [expectation fulfill];
         }
     }];
-        
+    
     NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
     [promiseA breakWithReason:error];
     
@@ -667,4 +759,760 @@
     XCTAssertEqualObjects(promiseB.brokenReason, error);
 }
 
+#pragma mark - Timeouts
+
+- (void)testTimeoutAfterBreaksSlowPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA timeoutAfter:0.05];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Returned promise should resolve."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:0 block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateBroken)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promiseB.brokenReason.domain, PZErrorDomain);
+    XCTAssertEqual(promiseB.brokenReason.code, PZTimeoutError);
+    XCTAssertEqual(promiseA.state, PZPromiseStatePending);
+}
+
+- (void)testTimeoutAfterAdoptsKeptPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA timeoutAfter:5.0];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Returned promise should resolve."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:0 block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateKept)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [promiseA keepWithValue:@"A"];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promiseB.keptValue, @"A");
+}
+
+- (void)testTimeoutReleasesSlowPromise
+{
+    __weak PZPromise *weakPromiseA;
+    PZPromise *promiseB;
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseA = [PZPromise new];
+        weakPromiseA = promiseA;
+        promiseB = [promiseA timeoutAfter:0.05];
+    }
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Returned promise should resolve."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:0 block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateBroken)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakPromiseA && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertNil(weakPromiseA);
+}
+
+- (void)testTimeoutAfterReturnsSealedPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA timeoutAfter:5.0];
+    
+    XCTAssertFalse([promiseB keepWithValue:@"B"]);
+    XCTAssertFalse([promiseB breakWithReason:[NSError errorWithDomain:PZErrorDomain code:PZInternalError userInfo:nil]]);
+    XCTAssertEqual(promiseB.state, PZPromiseStatePending);
+    
+    [promiseA keepWithValue:@"A"];
+}
+
+- (void)testTimeoutAfterReturnsResolvedReceiver
+{
+    PZPromise *promiseA = [[PZPromise alloc] initWithKeptValue:@"A"];
+    NSUInteger timerCount = [PZTimerWheel sharedTimerWheel].timerCount;
+    
+    PZPromise *promiseB = [promiseA timeoutAfter:5.0];
+    
+    XCTAssertEqual(promiseB, promiseA);
+    XCTAssertEqual([PZTimerWheel sharedTimerWheel].timerCount, timerCount);
+}
+
+- (void)testTimeoutAfterForwardsPriority
+{
+    PZPromise *rootPromise = [PZPromise new];
+    PZPromise *promiseA = [rootPromise thenOnKept:nil onBroken:nil priority:PZPromisePriorityLow];
+    PZPromise *promiseB = [promiseA timeoutAfter:5.0];
+    
+    XCTAssertEqual(promiseB.priority, PZPromisePriorityLow);
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseC = [promiseB thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+        
+        XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertNotNil(promiseC);
+    }
+    
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityLow);
+    
+    [rootPromise keepWithValue:@"A"];
+}
+
+- (void)testAbandonedTimeoutReleasesReceiver
+{
+    __weak PZPromise *weakPromiseA;
+    PZPromise *promiseB;
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseA = [PZPromise new];
+        weakPromiseA = promiseA;
+        promiseB = [promiseA timeoutAfter:60.0];
+        [self expectPromiseToBeAbandoned:promiseA];
+        
+        PZPromise *promiseC = [promiseB thenOnKept:nil onBroken:nil];
+        promiseC = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakPromiseA && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertTrue(promiseB.isAbandoned);
+    XCTAssertNil(weakPromiseA);
+}
+
+- (void)testWithDeadlineBreaksSlowPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA withDeadline:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Returned promise should resolve."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:0 block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateBroken)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(promiseB.brokenReason.code, PZTimeoutError);
+}
+
+- (void)testAfterKeepsPromiseAfterDelay
+{
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    PZPromise *promise = [PZPromise after:0.05];
+    
+    XCTAssertEqual(promise.state, PZPromiseStatePending);
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Promise should be kept."];
+    [self.KVOController observe:promise keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+        if (promise.state == PZPromiseStateKept)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertGreaterThanOrEqual([NSProcessInfo processInfo].systemUptime - start, 0.05);
+    XCTAssertNil(promise.keptValue);
+}
+
+
+#pragma mark - Abandonment
+
+- (void)expectPromiseToBeAbandoned:(PZPromise *)promise
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Promise should be abandoned."];
+    [promise onAbandoned:^{
+        [expectation fulfill];
+    }];
+}
+
+- (void)testDroppingLastConsumerAbandonsPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    [self expectPromiseToBeAbandoned:promiseA];
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil];
+        PZPromise *promiseC = [promiseA thenOnKept:nil onBroken:nil];
+        promiseB = nil;
+        
+        XCTAssertFalse(promiseA.isAbandoned);
+        promiseC = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertTrue(promiseA.isAbandoned);
+    XCTAssertEqual(promiseA.state, PZPromiseStatePending);
+}
+
+- (void)testPromiseWithoutConsumersIsNotAbandoned
+{
+    PZPromise *promise = [PZPromise new];
+    __block BOOL didAbandon = NO;
+    [promise onAbandoned:^{
+        didAbandon = YES;
+    }];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    
+    XCTAssertFalse(promise.isAbandoned);
+    XCTAssertFalse(didAbandon);
+}
+
+- (void)testResolvedPromiseIsNotAbandoned
+{
+    PZPromise *promiseA = [PZPromise new];
+    __block BOOL didAbandon = NO;
+    [promiseA onAbandoned:^{
+        didAbandon = YES;
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil];
+        [promiseA keepWithValue:@"A"];
+        promiseB = nil;
+    }
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    
+    XCTAssertFalse(promiseA.isAbandoned);
+    XCTAssertFalse(didAbandon);
+}
+
+- (void)testAbandonmentPropagatesThroughChain
+{
+    PZPromise *promiseA = [PZPromise new];
+    [self expectPromiseToBeAbandoned:promiseA];
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseC = [[promiseA thenOnKept:^id(id value) {
+            return value;
+        } onBroken:nil] thenOnKept:^id(id value) {
+            return value;
+        } onBroken:nil];
+        promiseC = nil;
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testAbandonmentPropagatesThroughAdoptedPromise
+{
+    PZPromise *promiseA = [[PZPromise alloc] initWithKeptValue:@"A"];
+    PZPromise *promiseB = [PZPromise new];
+    __block BOOL didAdopt = NO;
+    
+    PZPromise *promiseC = [promiseA thenOnKept:^id(id value) {
+        didAdopt = YES;
+        return promiseB;
+    } onBroken:nil];
+    
+    // Let promiseC start adopting the state of promiseB before letting it go.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (!didAdopt && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    
+    [self expectPromiseToBeAbandoned:promiseB];
+    promiseC = nil;
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(promiseB.state, PZPromiseStatePending);
+}
+
+
+#pragma mark - Priority
+
+- (void)testPromisesHaveDefaultPriority
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil];
+    
+    XCTAssertEqual(promiseA.priority, PZPromisePriorityDefault);
+    XCTAssertEqual(promiseB.priority, PZPromisePriorityDefault);
+}
+
+- (void)testPriorityIsInheritedByChain
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+    PZPromise *promiseC = [promiseB thenOnKept:^id(id value) {
+        return value;
+    } onBroken:nil];
+    PZPromise *promiseD = [promiseC thenOnKept:nil onBroken:nil cancellationToken:nil];
+    
+    XCTAssertEqual(promiseA.priority, PZPromisePriorityDefault);
+    XCTAssertEqual(promiseB.priority, PZPromisePriorityHigh);
+    XCTAssertEqual(promiseC.priority, PZPromisePriorityHigh);
+    XCTAssertEqual(promiseD.priority, PZPromisePriorityHigh);
+    
+    PZPromise *keptPromise = [[PZPromise alloc] initWithKeptValue:@"A"];
+    XCTAssertEqual([keptPromise thenOnKept:nil onBroken:nil priority:PZPromisePriorityLow].priority, PZPromisePriorityLow);
+}
+
+- (void)testBlocksAreScheduledWithChainPriority
+{
+    PZSpyExecutor *executor = [PZSpyExecutor new];
+    [PZPromise setDefaultExecutor:executor];
+    
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:^id(id value) {
+        return value;
+    } onBroken:nil priority:PZPromisePriorityHigh];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Returned promise should resolve."];
+    [self.KVOController observe:promiseB keyPath:NSStringFromSelector(@selector(state)) options:0 block:^(id observer, id object, NSDictionary *change) {
+        if (promiseB.state == PZPromiseStateKept)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [promiseA keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertTrue([executor.priorities containsObject:@(PZPromisePriorityHigh)]);
+}
+
+- (void)testNilDefaultExecutorRestoresSharedExecutor
+{
+    [PZPromise setDefaultExecutor:[PZSpyExecutor new]];
+    [PZPromise setDefaultExecutor:nil];
+    
+    XCTAssertEqualObjects([PZPromise defaultExecutor], [PZWorkStealingExecutor sharedExecutor]);
+}
+
+
+#pragma mark - Priority inheritance
+
+- (void)testHighPriorityWaiterRaisesEffectivePriority
+{
+    PZPromise *promiseA = [PZPromise new];
+    NSMutableArray *priorities = [NSMutableArray new];
+    [promiseA onEffectivePriorityChanged:^(PZPromisePriority effectivePriority) {
+        [priorities addObject:@(effectivePriority)];
+    }];
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+        
+        XCTAssertEqual(promiseA.priority, PZPromisePriorityDefault);
+        XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityHigh);
+    }
+    
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityDefault);
+    XCTAssertEqualObjects(priorities, (@[@(PZPromisePriorityHigh), @(PZPromisePriorityDefault)]));
+}
+
+- (void)testLowPriorityWaiterDoesNotLowerEffectivePriority
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityLow];
+    
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityDefault);
+    XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityLow);
+}
+
+- (void)testEffectivePriorityRevertsWhenResolved
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityHigh);
+    
+    [promiseA keepWithValue:@"A"];
+    
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityDefault);
+    XCTAssertNotNil(promiseB);
+}
+
+- (void)testEffectivePriorityPropagatesUpChain
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityLow];
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseC = [promiseB thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+        
+        XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertNotNil(promiseC);
+    }
+    
+    XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityLow);
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityDefault);
+}
+
+- (void)testEffectivePriorityPropagatesUpLongChain
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *lastPromise = promiseA;
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        lastPromise = [lastPromise thenOnKept:nil onBroken:nil priority:PZPromisePriorityLow];
+    }
+    
+    @autoreleasepool
+    {
+        PZPromise *highPromise = [lastPromise thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+        
+        XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityHigh);
+        XCTAssertNotNil(highPromise);
+    }
+    
+    XCTAssertEqual(lastPromise.effectivePriority, PZPromisePriorityLow);
+    XCTAssertEqual(promiseA.effectivePriority, PZPromisePriorityDefault);
+}
+
+- (void)testEffectivePriorityPropagatesToAdoptedPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *innerPromise = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:^id(id value) {
+        return innerPromise;
+    } onBroken:nil priority:PZPromisePriorityLow];
+    PZPromise *promiseC = [promiseB thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Adopted promise should be raised."];
+    [innerPromise onEffectivePriorityChanged:^(PZPromisePriority effectivePriority) {
+        if (effectivePriority == PZPromisePriorityHigh)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [promiseA keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(innerPromise.effectivePriority, PZPromisePriorityHigh);
+    
+    XCTestExpectation *keptExpectation = [self expectationWithDescription:@"Promise should be kept."];
+    [self.KVOController observe:promiseC keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+        if (promiseC.state == PZPromiseStateKept)
+        {
+            [keptExpectation fulfill];
+        }
+    }];
+    
+    [innerPromise keepWithValue:@"B"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(innerPromise.effectivePriority, PZPromisePriorityDefault);
+    XCTAssertEqual(promiseB.effectivePriority, PZPromisePriorityLow);
+}
+
+- (void)testLinkedOperationIsRaisedWhileHighPriorityWaiterExists
+{
+    NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    operation.queuePriority = NSOperationQueuePriorityNormal;
+    PZPromise *promiseA = [PZPromise new];
+    [promiseA linkOperation:operation];
+    
+    XCTAssertEqual(operation.queuePriority, NSOperationQueuePriorityNormal);
+    
+    @autoreleasepool
+    {
+        PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+        
+        XCTAssertEqual(operation.queuePriority, NSOperationQueuePriorityHigh);
+        XCTAssertNotNil(promiseB);
+    }
+    
+    XCTAssertEqual(operation.queuePriority, NSOperationQueuePriorityNormal);
+}
+
+- (void)testLinkedOperationIsNotLowered
+{
+    NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{}];
+    operation.queuePriority = NSOperationQueuePriorityVeryHigh;
+    PZPromise *promiseA = [PZPromise new];
+    [promiseA linkOperation:operation];
+    
+    PZPromise *promiseB = [promiseA thenOnKept:nil onBroken:nil priority:PZPromisePriorityHigh];
+    
+    XCTAssertEqual(operation.queuePriority, NSOperationQueuePriorityVeryHigh);
+    XCTAssertNotNil(promiseB);
+}
+
+
+#pragma mark - Waiting
+
+- (void)testWaitReturnsImmediatelyForResolvedPromise
+{
+    PZPromise *promise = [[PZPromise alloc] initWithKeptValue:@"A"];
+    
+    XCTAssertTrue([promise waitWithTimeout:0.0]);
+    XCTAssertEqualObjects(promise.keptValue, @"A");
+}
+
+- (void)testWaitBlocksBackgroundThreadUntilKept
+{
+    PZPromise *promise = [PZPromise new];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Wait should return."];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        XCTAssertTrue([promise waitWithTimeout:5.0]);
+        XCTAssertEqualObjects(promise.keptValue, @"A");
+        [expectation fulfill];
+    });
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.05 * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [promise keepWithValue:@"A"];
+    });
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testWaitTimesOut
+{
+    PZPromise *promise = [PZPromise new];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Wait should time out."];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+        XCTAssertFalse([promise waitWithTimeout:0.1]);
+        XCTAssertGreaterThanOrEqual([NSProcessInfo processInfo].systemUptime - start, 0.1);
+        [expectation fulfill];
+    });
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    XCTAssertEqual(promise.state, PZPromiseStatePending);
+}
+
+- (void)testWaitOnMainThreadServicesMainQueue
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [promiseA thenOnKept:^id(NSString *value) {
+        return [value stringByAppendingString:@"B"];
+    } onBroken:nil];
+    
+    // The promise is kept from the main queue, which would deadlock if the wait parked the main thread.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [promiseA keepWithValue:@"A"];
+    });
+    
+    XCTAssertTrue([NSThread isMainThread]);
+    XCTAssertTrue([promiseB waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(promiseB.keptValue, @"AB");
+}
+
+- (void)testWaitAllWaitsForEveryPromise
+{
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [PZPromise new];
+    PZPromise *promiseC = [[PZPromise alloc] initWithBrokenReason:[NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil]];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Wait should return."];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        XCTAssertTrue([PZPromise waitAll:@[promiseA, promiseB, promiseC] timeout:5.0]);
+        XCTAssertEqual(promiseA.state, PZPromiseStateKept);
+        XCTAssertEqual(promiseB.state, PZPromiseStateBroken);
+        [expectation fulfill];
+    });
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.05 * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [promiseB breakWithReason:[NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil]];
+        [promiseA keepWithValue:@"A"];
+    });
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testWaitAllTimesOutWhenAnyPromiseIsPending
+{
+    PZPromise *promiseA = [[PZPromise alloc] initWithKeptValue:@"A"];
+    PZPromise *promiseB = [PZPromise new];
+    
+    XCTAssertFalse([PZPromise waitAll:@[promiseA, promiseB] timeout:0.05]);
+}
+
+
+#pragma mark - Continuation pool
+
+- (void)testChainingCountsContinuationRecords
+{
+    PZContinuationPoolStatistics before = [PZPromise continuationPoolStatistics];
+    
+    PZPromise *promise = [PZPromise new];
+    [promise thenOnKept:^id(id value) {
+        return value;
+    } onBroken:nil];
+    
+    PZContinuationPoolStatistics after = [PZPromise continuationPoolStatistics];
+    XCTAssertEqual(after.acquiredRecordCount - before.acquiredRecordCount, (uint64_t)1);
+}
+
+- (void)testContinuationRecordsAreReused
+{
+    // Records of a promise released before resolving are recycled on the thread releasing it, so the next record chained here is a recycled one.
+    @autoreleasepool
+    {
+        PZPromise *promise = [PZPromise new];
+        [promise thenOnKept:nil onBroken:nil];
+    }
+    
+    PZContinuationPoolStatistics before = [PZPromise continuationPoolStatistics];
+    
+    PZPromise *promise = [PZPromise new];
+    PZPromise *result = [promise thenOnKept:nil onBroken:nil];
+    
+    PZContinuationPoolStatistics after = [PZPromise continuationPoolStatistics];
+    XCTAssertEqual(after.acquiredRecordCount - before.acquiredRecordCount, (uint64_t)1);
+    XCTAssertEqual(after.reusedRecordCount - before.reusedRecordCount, (uint64_t)1);
+    
+    [promise keepWithValue:@"A"];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(result.keptValue, @"A");
+}
+
+- (void)testReleasedPromiseDoesNotKeepBlocksAlive
+{
+    __weak id weakObject;
+    PZPromise *promise = [PZPromise new];
+    @autoreleasepool
+    {
+        NSObject *object = [NSObject new];
+        weakObject = object;
+        [promise thenOnKept:^id(id value) {
+            return object;
+        } onBroken:nil];
+    }
+    
+    promise = nil;
+    XCTAssertNil(weakObject);
+}
+
+- (void)testConcurrentChainingPerformance
+{
+    static const NSUInteger threadCount = 64;
+    static const NSUInteger chainLength = 200;
+    
+    [self measureBlock:^{
+        PZContinuationPoolStatistics before = [PZPromise continuationPoolStatistics];
+        
+        dispatch_group_t group = dispatch_group_create();
+        for (NSUInteger thread = 0; thread < threadCount; thread++)
+        {
+            dispatch_queue_t queue = dispatch_queue_create("com.zachradke.promiseZ.tests.chaining", DISPATCH_QUEUE_SERIAL);
+            dispatch_group_async(group, queue, ^{
+                PZPromise *promise = [PZPromise new];
+                PZPromise *result = promise;
+                for (NSUInteger i = 0; i < chainLength; i++)
+                {
+                    result = [result thenOnKept:^id(NSNumber *value) {
+                        return @(value.integerValue + 1);
+                    } onBroken:nil];
+                }
+                
+                [promise keepWithValue:@0];
+                XCTAssertTrue([result waitWithTimeout:30.0]);
+                XCTAssertEqualObjects(result.keptValue, @(chainLength));
+                
+                // Threads only add their counts to the statistics now and then, so this one's are flushed before they are checked.
+                [PZPromise continuationPoolStatistics];
+            });
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        
+        PZContinuationPoolStatistics after = [PZPromise continuationPoolStatistics];
+        uint64_t acquired = after.acquiredRecordCount - before.acquiredRecordCount;
+        uint64_t reused = after.reusedRecordCount - before.reusedRecordCount;
+        XCTAssertTrue(acquired >= (uint64_t)(threadCount * chainLength));
+        XCTAssertTrue(reused <= acquired);
+    }];
+}
+
+
+#pragma mark - Memory
+
+- (void)testPendingPromiseIsCompact
+{
+    PZPromise *promise = [PZPromise new];
+    XCTAssertTrue(promise.retainedByteCount > 0);
+    XCTAssertTrue(promise.retainedByteCount <= (NSUInteger)96);
+}
+
+- (void)testRetainedByteCountIncludesContinuations
+{
+    PZPromise *promise = [PZPromise new];
+    NSUInteger byteCount = promise.retainedByteCount;
+    
+    PZPromise *result = [promise thenOnKept:nil onBroken:nil];
+    XCTAssertTrue(promise.retainedByteCount > byteCount);
+    
+    [promise keepWithValue:@"A"];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    
+    // The drain may still be finishing up after resolving the result.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (promise.retainedByteCount != byteCount && [deadline timeIntervalSinceNow] > 0.0)
+    {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertEqual(promise.retainedByteCount, byteCount);
+}
+
+- (void)testRetainedByteCountIncludesHandlers
+{
+    PZPromise *promise = [PZPromise new];
+    NSUInteger byteCount = promise.retainedByteCount;
+    
+    [promise onAbandoned:^{}];
+    XCTAssertTrue(promise.retainedByteCount > byteCount);
+    
+    // Resolving drops the handlers along with the side table holding them.
+    [promise keepWithValue:nil];
+    XCTAssertEqual(promise.retainedByteCount, byteCount);
+}
+
+- (void)testResultSlotHoldsValueOrReason
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *keptPromise = [[PZPromise alloc] initWithKeptValue:error];
+    PZPromise *brokenPromise = [[PZPromise alloc] initWithBrokenReason:error];
+    
+    XCTAssertEqualObjects(keptPromise.keptValue, error);
+    XCTAssertNil(keptPromise.brokenReason);
+    XCTAssertEqualObjects(brokenPromise.brokenReason, error);
+    XCTAssertNil(brokenPromise.keptValue);
+}
+
 @end
@@ -0,0 +1,66 @@
+//
+//  PZRateLimiterTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZRateLimiter.h>
+
+@interface PZRateLimiterTests : XCTestCase
+
+@end
+
+@implementation PZRateLimiterTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testBurstPassesImmediately
+{
+    PZRateLimiter *rateLimiter = [[PZRateLimiter alloc] initWithTokensPerSecond:1.0 burstSize:3];
+    
+    XCTAssertTrue([rateLimiter tryAcquire]);
+    XCTAssertEqual([rateLimiter acquire].state, PZPromiseStateKept);
+    XCTAssertTrue([rateLimiter tryAcquire]);
+    XCTAssertFalse([rateLimiter tryAcquire]);
+    XCTAssertEqual([rateLimiter acquire].state, PZPromiseStatePending);
+}
+
+- (void)testWaitersAreReleasedAtRate
+{
+    PZRateLimiter *rateLimiter = [[PZRateLimiter alloc] initWithTokensPerSecond:50.0 burstSize:1];
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    NSMutableArray *order = [NSMutableArray new];
+    
+    for (NSUInteger i = 0; i < 5; i++)
+    {
+        PZPromise *promise = [rateLimiter acquire];
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Waiter should be released."];
+        [self.KVOController observe:promise keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+            if (promise.state == PZPromiseStateKept)
+            {
+                @synchronized(order)
+                {
+                    [order addObject:@(i)];
+                }
+                [expectation fulfill];
+            }
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    // The first token comes from the full bucket, the other four need 20 milliseconds each.
+    XCTAssertGreaterThanOrEqual([NSProcessInfo processInfo].systemUptime - start, 0.07);
+    XCTAssertEqualObjects(order, (@[@0, @1, @2, @3, @4]));
+    XCTAssertEqual(rateLimiter.waiterCount, 0);
+}
+
+@end
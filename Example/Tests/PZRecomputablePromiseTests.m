@@ -0,0 +1,145 @@
+//
+//  PZRecomputablePromiseTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/26/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZRecomputablePromise.h>
+#import <libkern/OSAtomic.h>
+
+@interface PZRecomputablePromiseTests : XCTestCase
+
+@end
+
+@implementation PZRecomputablePromiseTests
+
+- (void)testFactoryIsNotCalledUntilNeeded
+{
+    __block NSUInteger callCount = 0;
+    PZRecomputablePromise *recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+        callCount += 1;
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    
+    XCTAssertEqual(recomputable.computationCount, (NSUInteger)0);
+    XCTAssertFalse(recomputable.hasKeptValue);
+    
+    PZPromise *result = [recomputable thenOnKept:nil onBroken:nil];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(result.keptValue, @"A");
+    XCTAssertEqual(callCount, (NSUInteger)1);
+}
+
+- (void)testConcurrentCallersShareOneComputation
+{
+    PZPromise *task = [PZPromise new];
+    __block int32_t callCount = 0;
+    PZRecomputablePromise *recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+        OSAtomicIncrement32(&callCount);
+        return task;
+    }];
+    
+    NSMutableArray *results = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 10; i++)
+    {
+        [results addObject:[recomputable thenOnKept:nil onBroken:nil]];
+    }
+    
+    // Pending promises are never discarded, so pressure can't start the task again.
+    [PZRecomputablePromise discardValuesForMemoryPressure];
+    [results addObject:[recomputable thenOnKept:nil onBroken:nil]];
+    
+    [task keepWithValue:@"A"];
+    XCTAssertTrue([PZPromise waitAll:results timeout:5.0]);
+    XCTAssertEqual(callCount, (int32_t)1);
+    XCTAssertEqual(recomputable.computationCount, (NSUInteger)1);
+}
+
+- (void)testDiscardedValueIsRecomputed
+{
+    __block NSUInteger callCount = 0;
+    PZRecomputablePromise *recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+        callCount += 1;
+        return [[PZPromise alloc] initWithKeptValue:@(callCount)];
+    }];
+    
+    XCTAssertTrue([[recomputable promise] waitWithTimeout:5.0]);
+    XCTAssertTrue(recomputable.hasKeptValue);
+    
+    [PZRecomputablePromise discardValuesForMemoryPressure];
+    XCTAssertFalse(recomputable.hasKeptValue);
+    
+    PZPromise *result = [recomputable thenOnKept:nil onBroken:nil];
+    XCTAssertTrue([result waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(result.keptValue, @2);
+    XCTAssertEqual(recomputable.computationCount, (NSUInteger)2);
+}
+
+- (void)testOptedOutValueIsNotDiscarded
+{
+    PZRecomputablePromise *recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    recomputable.discardsValueUnderMemoryPressure = NO;
+    
+    XCTAssertTrue([[recomputable promise] waitWithTimeout:5.0]);
+    [PZRecomputablePromise discardValuesForMemoryPressure];
+    XCTAssertTrue(recomputable.hasKeptValue);
+    
+    XCTAssertTrue([recomputable discardValue]);
+    XCTAssertFalse(recomputable.hasKeptValue);
+}
+
+- (void)testBrokenResultIsRetried
+{
+    __block NSUInteger callCount = 0;
+    PZRecomputablePromise *recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+        callCount += 1;
+        if (callCount == 1)
+        {
+            return [[PZPromise alloc] initWithBrokenReason:[NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil]];
+        }
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    
+    PZPromise *brokenResult = [recomputable thenOnKept:nil onBroken:nil];
+    XCTAssertTrue([brokenResult waitWithTimeout:5.0]);
+    XCTAssertEqual(brokenResult.state, PZPromiseStateBroken);
+    
+    PZPromise *keptResult = [recomputable thenOnKept:nil onBroken:nil];
+    XCTAssertTrue([keptResult waitWithTimeout:5.0]);
+    XCTAssertEqualObjects(keptResult.keptValue, @"A");
+}
+
+- (void)testDiscardingReleasesValue
+{
+    __weak id weakValue;
+    PZRecomputablePromise *recomputable;
+    
+    @autoreleasepool
+    {
+        recomputable = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+            return [[PZPromise alloc] initWithKeptValue:[NSMutableData dataWithLength:1024]];
+        }];
+        
+        PZPromise *promise = [recomputable promise];
+        XCTAssertTrue([promise waitWithTimeout:5.0]);
+        weakValue = promise.keptValue;
+        XCTAssertNotNil(weakValue);
+    }
+    
+    XCTAssertTrue([recomputable discardValue]);
+    
+    // The drain which kept the promise may still hold it briefly.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while (weakValue && [deadline timeIntervalSinceNow] > 0.0)
+    {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    XCTAssertNil(weakValue);
+}
+
+@end
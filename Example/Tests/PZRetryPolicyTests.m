@@ -0,0 +1,181 @@
+//
+//  PZRetryPolicyTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/10/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZRetryPolicy.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZRetryPolicyTests : XCTestCase
+
+@end
+
+@implementation PZRetryPolicyTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (PZRetryPolicy *)fastPolicy
+{
+    PZRetryPolicy *policy = [PZRetryPolicy defaultPolicy];
+    policy.initialDelay = 0.01;
+    policy.maximumDelay = 0.05;
+    policy.budget = nil;
+    return policy;
+}
+
+
+#pragma mark - Policy
+
+- (void)testDelayGrowsExponentially
+{
+    PZRetryPolicy *policy = [PZRetryPolicy defaultPolicy];
+    policy.usesFullJitter = NO;
+    policy.initialDelay = 1.0;
+    policy.multiplier = 2.0;
+    policy.maximumDelay = 5.0;
+    
+    XCTAssertEqualWithAccuracy([policy delayBeforeAttempt:2], 1.0, 0.0001);
+    XCTAssertEqualWithAccuracy([policy delayBeforeAttempt:3], 2.0, 0.0001);
+    XCTAssertEqualWithAccuracy([policy delayBeforeAttempt:4], 4.0, 0.0001);
+    XCTAssertEqualWithAccuracy([policy delayBeforeAttempt:5], 5.0, 0.0001);
+}
+
+- (void)testFullJitterStaysWithinDelay
+{
+    PZRetryPolicy *policy = [PZRetryPolicy defaultPolicy];
+    policy.initialDelay = 1.0;
+    
+    for (NSUInteger i = 0; i < 100; i++)
+    {
+        NSTimeInterval delay = [policy delayBeforeAttempt:2];
+        XCTAssertGreaterThanOrEqual(delay, 0.0);
+        XCTAssertLessThanOrEqual(delay, 1.0);
+    }
+}
+
+- (void)testBudgetLimitsRetries
+{
+    PZRetryBudget *budget = [[PZRetryBudget alloc] initWithRetryRatio:0.5 minimumRetriesPerSecond:0.0 maximumBalance:1.0];
+    
+    XCTAssertTrue([budget tryWithdrawRetry]);
+    XCTAssertFalse([budget tryWithdrawRetry]);
+    
+    [budget recordAttempt];
+    XCTAssertFalse([budget tryWithdrawRetry]);
+    
+    [budget recordAttempt];
+    XCTAssertTrue([budget tryWithdrawRetry]);
+}
+
+
+#pragma mark - Retrying
+
+- (void)testRetryKeepsAfterTransientFailures
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block NSInteger attemptCount = 0;
+    
+    PZPromise *promise = [PZPromise retry:^PZPromise *{
+        attemptCount += 1;
+        if (attemptCount < 3)
+        {
+            return [[PZPromise alloc] initWithBrokenReason:error];
+        }
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    } policy:[self fastPolicy]];
+    
+    [self waitForPromise:promise];
+    
+    XCTAssertEqual(promise.state, PZPromiseStateKept);
+    XCTAssertEqualObjects(promise.keptValue, @"A");
+    XCTAssertEqual(attemptCount, 3);
+}
+
+- (void)testRetryPromiseCannotBeResolvedManually
+{
+    PZPromise *attemptPromise = [PZPromise new];
+    PZPromise *promise = [PZPromise retry:^PZPromise *{
+        return attemptPromise;
+    } policy:[self fastPolicy]];
+    
+    XCTAssertFalse([promise keepWithValue:@"B"]);
+    XCTAssertFalse([promise breakWithReason:[NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil]]);
+    XCTAssertEqual(promise.state, PZPromiseStatePending);
+    
+    [attemptPromise keepWithValue:@"A"];
+    [self waitForPromise:promise];
+    
+    XCTAssertEqualObjects(promise.keptValue, @"A");
+}
+
+- (void)testRetryBreaksAfterMaximumAttempts
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block NSInteger attemptCount = 0;
+    
+    PZRetryPolicy *policy = [self fastPolicy];
+    policy.maximumAttempts = 4;
+    
+    PZPromise *promise = [PZPromise retry:^PZPromise *{
+        attemptCount += 1;
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    } policy:policy];
+    
+    [self waitForPromise:promise];
+    
+    XCTAssertEqual(promise.state, PZPromiseStateBroken);
+    XCTAssertEqualObjects(promise.brokenReason, error);
+    XCTAssertEqual(attemptCount, 4);
+}
+
+- (void)testRetryStopsWhenShouldRetryBlockDeclines
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block NSInteger attemptCount = 0;
+    
+    PZRetryPolicy *policy = [self fastPolicy];
+    policy.shouldRetryBlock = ^BOOL(NSError *reason, NSUInteger attempt) {
+        return reason.code != 900;
+    };
+    
+    PZPromise *promise = [PZPromise retry:^PZPromise *{
+        attemptCount += 1;
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    } policy:policy];
+    
+    [self waitForPromise:promise];
+    
+    XCTAssertEqual(promise.state, PZPromiseStateBroken);
+    XCTAssertEqual(attemptCount, 1);
+}
+
+- (void)testRetryStopsWhenBudgetIsExhausted
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block NSInteger attemptCount = 0;
+    
+    PZRetryPolicy *policy = [self fastPolicy];
+    policy.maximumAttempts = 10;
+    policy.budget = [[PZRetryBudget alloc] initWithRetryRatio:0.0 minimumRetriesPerSecond:0.0 maximumBalance:1.0];
+    
+    PZPromise *promise = [PZPromise retry:^PZPromise *{
+        attemptCount += 1;
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    } policy:policy];
+    
+    [self waitForPromise:promise];
+    
+    XCTAssertEqual(promise.state, PZPromiseStateBroken);
+    XCTAssertEqual(attemptCount, 2);
+}
+
+@end
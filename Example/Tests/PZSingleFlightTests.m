@@ -0,0 +1,144 @@
+//
+//  PZSingleFlightTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/6/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZSingleFlight.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZSingleFlightTests : XCTestCase
+
+@end
+
+@implementation PZSingleFlightTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+
+#pragma mark - Deduplication
+
+- (void)testConcurrentCallersSharePromise
+{
+    PZSingleFlight *singleFlight = [PZSingleFlight new];
+    PZPromise *taskPromise = [PZPromise new];
+    __block NSInteger invocationCount = 0;
+    
+    PZPromiseFactoryBlock block = ^PZPromise *{
+        invocationCount += 1;
+        return taskPromise;
+    };
+    
+    PZPromise *promiseA = [singleFlight promiseForKey:@"A" usingBlock:block];
+    PZPromise *promiseB = [singleFlight promiseForKey:@"A" usingBlock:block];
+    
+    XCTAssertEqual(promiseA, promiseB);
+    XCTAssertEqual([singleFlight existingPromiseForKey:@"A"], promiseA);
+    
+    [self expectPromise:promiseA toReachState:PZPromiseStateKept];
+    
+    [taskPromise keepWithValue:@"A"];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(invocationCount, 1);
+    XCTAssertEqualObjects(promiseA.keptValue, @"A");
+}
+
+- (void)testDifferentKeysDoNotSharePromise
+{
+    PZSingleFlight *singleFlight = [[PZSingleFlight alloc] initWithShardCount:1];
+    
+    PZPromise *promiseA = [singleFlight promiseForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    PZPromise *promiseB = [singleFlight promiseForKey:@"B" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"B"];
+    }];
+    
+    XCTAssertNotEqual(promiseA, promiseB);
+}
+
+- (void)testSettledPromiseIsDropped
+{
+    PZSingleFlight *singleFlight = [PZSingleFlight new];
+    PZPromise *promise = [singleFlight promiseForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    
+    [self expectPromise:promise toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    // Removal happens in a continuation of the shared promise, so give it a moment.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while ([singleFlight existingPromiseForKey:@"A"] && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertNil([singleFlight existingPromiseForKey:@"A"]);
+}
+
+
+#pragma mark - Settled results
+
+- (void)testKeptResultIsCached
+{
+    PZSingleFlight *singleFlight = [PZSingleFlight new];
+    singleFlight.settledResultLifetime = 60.0;
+    
+    __block NSInteger invocationCount = 0;
+    PZPromiseFactoryBlock block = ^PZPromise *{
+        invocationCount += 1;
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    };
+    
+    PZPromise *promiseA = [singleFlight promiseForKey:@"A" usingBlock:block];
+    
+    [self expectPromise:promiseA toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    PZPromise *promiseB = [singleFlight promiseForKey:@"A" usingBlock:block];
+    
+    XCTAssertEqual(promiseA, promiseB);
+    XCTAssertEqual(invocationCount, 1);
+    
+    [singleFlight removePromiseForKey:@"A"];
+    
+    XCTAssertNil([singleFlight existingPromiseForKey:@"A"]);
+}
+
+- (void)testBrokenResultIsNotCached
+{
+    PZSingleFlight *singleFlight = [PZSingleFlight new];
+    singleFlight.settledResultLifetime = 60.0;
+    
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *promise = [singleFlight promiseForKey:@"A" usingBlock:^PZPromise *{
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    }];
+    
+    [self expectPromise:promise toReachState:PZPromiseStateBroken];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5.0];
+    while ([singleFlight existingPromiseForKey:@"A"] && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    
+    XCTAssertNil([singleFlight existingPromiseForKey:@"A"]);
+    XCTAssertEqualObjects(promise.brokenReason, error);
+}
+
+@end
@@ -0,0 +1,145 @@
+//
+//  PZTaskGroupTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/16/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZTaskGroup.h>
+#import <PromiseZ/PZCancellationToken.h>
+#import "XCTestCase+PZPromise.h"
+
+@interface PZTaskGroupTests : XCTestCase
+
+@end
+
+@implementation PZTaskGroupTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testGroupKeepsWithValuesInOrder
+{
+    PZTaskGroup *group = [PZTaskGroup new];
+    PZPromise *promiseA = [PZPromise new];
+    PZPromise *promiseB = [PZPromise new];
+    
+    [group addTask:^PZPromise *{
+        return promiseA;
+    }];
+    [group addTask:^PZPromise *{
+        return promiseB;
+    }];
+    [group addTask:^PZPromise *{
+        return nil;
+    }];
+    [group close];
+    
+    [self expectPromise:group.promise toReachState:PZPromiseStateKept];
+    
+    [promiseB keepWithValue:@"B"];
+    [promiseA keepWithValue:@"A"];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(group.promise.keptValue, (@[@"A", @"B", [NSNull null]]));
+}
+
+- (void)testGroupWaitsUntilClosed
+{
+    PZTaskGroup *group = [PZTaskGroup new];
+    
+    PZPromise *childPromise = [group addTask:^PZPromise *{
+        return [[PZPromise alloc] initWithKeptValue:@"A"];
+    }];
+    
+    [self expectPromise:childPromise toReachState:PZPromiseStateKept];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    XCTAssertEqual(group.promise.state, PZPromiseStatePending);
+    
+    [self expectPromise:group.promise toReachState:PZPromiseStateKept];
+    [group close];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testBrokenChildCancelsSiblings
+{
+    PZTaskGroup *group = [PZTaskGroup new];
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *slowPromise = [PZPromise new];
+    NSOperation *slowOperation = [NSBlockOperation blockOperationWithBlock:^{}];
+    [group.cancellationToken linkOperation:slowOperation];
+    
+    PZPromise *siblingPromise = [group addTask:^PZPromise *{
+        return slowPromise;
+    }];
+    [group addTask:^PZPromise *{
+        return [[PZPromise alloc] initWithBrokenReason:error];
+    }];
+    [group close];
+    
+    [self expectPromise:group.promise toReachState:PZPromiseStateBroken];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(group.promise.brokenReason, error);
+    XCTAssertEqual(siblingPromise.state, PZPromiseStateBroken);
+    XCTAssertEqual(siblingPromise.brokenReason.code, PZCancelledError);
+    XCTAssertTrue(group.cancellationToken.isCancelled);
+    XCTAssertTrue(slowOperation.isCancelled);
+    XCTAssertEqual(slowPromise.state, PZPromiseStatePending);
+}
+
+- (void)testCancelBreaksGroup
+{
+    PZTaskGroup *group = [PZTaskGroup new];
+    PZPromise *childPromise = [group addTask:^PZPromise *{
+        return [PZPromise new];
+    }];
+    
+    [self expectPromise:group.promise toReachState:PZPromiseStateBroken];
+    [group cancel];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(group.promise.brokenReason.code, PZCancelledError);
+    XCTAssertEqual(childPromise.brokenReason.code, PZCancelledError);
+}
+
+- (void)testClosedGroupRejectsTasks
+{
+    PZTaskGroup *group = [PZTaskGroup new];
+    [group close];
+    
+    __block BOOL didInvoke = NO;
+    PZPromise *childPromise = [group addTask:^PZPromise *{
+        didInvoke = YES;
+        return nil;
+    }];
+    
+    XCTAssertFalse(didInvoke);
+    XCTAssertEqual(childPromise.state, PZPromiseStateBroken);
+    XCTAssertEqual(childPromise.brokenReason.code, PZCancelledError);
+}
+
+- (void)testAbandonedGroupBreaksPromise
+{
+    PZPromise *promise;
+    
+    @autoreleasepool
+    {
+        PZTaskGroup *group = [PZTaskGroup new];
+        promise = group.promise;
+    }
+    
+    XCTAssertEqual(promise.state, PZPromiseStateBroken);
+    XCTAssertEqual(promise.brokenReason.code, PZAbandonedError);
+}
+
+@end
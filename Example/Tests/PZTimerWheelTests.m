@@ -0,0 +1,173 @@
+//
+//  PZTimerWheelTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/13/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZTimerWheel.h>
+
+static const NSUInteger PZTimerWheelBenchmarkCount = 1000000;
+
+@interface PZTimerWheelTests : XCTestCase
+
+@end
+
+@implementation PZTimerWheelTests
+
+- (void)waitForTimerWheel:(PZTimerWheel *)timerWheel
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10.0];
+    while (timerWheel.timerCount > 0 && [deadline timeIntervalSinceNow] > 0)
+    {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+}
+
+
+#pragma mark - Scheduling
+
+- (void)testTimerFiresAfterDelay
+{
+    PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:64];
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Timer should fire."];
+    PZTimerWheelTimer timer = [timerWheel scheduleAfter:0.05 block:^{
+        XCTAssertGreaterThanOrEqual([NSProcessInfo processInfo].systemUptime - start, 0.05);
+        [expectation fulfill];
+    }];
+    
+    XCTAssertNotEqual(timer, 0);
+    XCTAssertEqual(timerWheel.timerCount, 1);
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqual(timerWheel.timerCount, 0);
+}
+
+- (void)testTimersBeyondOneRotationWaitForTheirRound
+{
+    // Four slots at 10 milliseconds is a 40 millisecond rotation, so this timer shares a slot with earlier ticks.
+    PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:4];
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Timer should fire."];
+    [timerWheel scheduleAfter:0.15 block:^{
+        XCTAssertGreaterThanOrEqual([NSProcessInfo processInfo].systemUptime - start, 0.15);
+        [expectation fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testCancelledTimerDoesNotFire
+{
+    PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:64];
+    __block BOOL didFire = NO;
+    
+    PZTimerWheelTimer timer = [timerWheel scheduleAfter:0.02 block:^{
+        didFire = YES;
+    }];
+    
+    XCTAssertTrue([timerWheel cancelTimer:timer]);
+    XCTAssertFalse([timerWheel cancelTimer:timer]);
+    XCTAssertEqual(timerWheel.timerCount, 0);
+    
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    
+    XCTAssertFalse(didFire);
+}
+
+- (void)testStaleHandleDoesNotCancelReusedTimer
+{
+    PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:64];
+    
+    PZTimerWheelTimer timerA = [timerWheel scheduleAfter:1.0 block:^{}];
+    XCTAssertTrue([timerWheel cancelTimer:timerA]);
+    
+    PZTimerWheelTimer timerB = [timerWheel scheduleAfter:1.0 block:^{}];
+    XCTAssertNotEqual(timerA, timerB);
+    XCTAssertFalse([timerWheel cancelTimer:timerA]);
+    XCTAssertEqual(timerWheel.timerCount, 1);
+    XCTAssertTrue([timerWheel cancelTimer:timerB]);
+}
+
+- (void)testCancellingReleasesBlock
+{
+    PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:64];
+    __weak id weakObject;
+    PZTimerWheelTimer timer;
+    
+    @autoreleasepool
+    {
+        NSObject *object = [NSObject new];
+        weakObject = object;
+        timer = [timerWheel scheduleAfter:1.0 block:^{
+            [object description];
+        }];
+    }
+    
+    XCTAssertNotNil(weakObject);
+    [timerWheel cancelTimer:timer];
+    XCTAssertNil(weakObject);
+}
+
+
+#pragma mark - Performance
+
+- (void)testInsertPerformance
+{
+    [self measureBlock:^{
+        PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:4096];
+        for (NSUInteger i = 0; i < PZTimerWheelBenchmarkCount; i++)
+        {
+            [timerWheel scheduleAfter:60.0 + (double)(i % 1000) block:^{}];
+        }
+    }];
+}
+
+- (void)testCancelPerformance
+{
+    PZTimerWheelTimer *timers = malloc(sizeof(PZTimerWheelTimer) * PZTimerWheelBenchmarkCount);
+    
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.01 slotCount:4096];
+        for (NSUInteger i = 0; i < PZTimerWheelBenchmarkCount; i++)
+        {
+            timers[i] = [timerWheel scheduleAfter:60.0 + (double)(i % 1000) block:^{}];
+        }
+        
+        [self startMeasuring];
+        for (NSUInteger i = 0; i < PZTimerWheelBenchmarkCount; i++)
+        {
+            [timerWheel cancelTimer:timers[i]];
+        }
+        [self stopMeasuring];
+        
+        XCTAssertEqual(timerWheel.timerCount, 0);
+    }];
+    
+    free(timers);
+}
+
+- (void)testExpiryPerformance
+{
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        PZTimerWheel *timerWheel = [[PZTimerWheel alloc] initWithTickInterval:0.001 slotCount:4096];
+        
+        [self startMeasuring];
+        for (NSUInteger i = 0; i < PZTimerWheelBenchmarkCount; i++)
+        {
+            [timerWheel scheduleAfter:0.001 * (double)(i % 100) block:^{}];
+        }
+        [self waitForTimerWheel:timerWheel];
+        [self stopMeasuring];
+        
+        XCTAssertEqual(timerWheel.timerCount, 0);
+    }];
+}
+
+@end
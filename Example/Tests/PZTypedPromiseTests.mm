@@ -0,0 +1,268 @@
+//
+//  PZTypedPromiseTests.mm
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/23/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <KVOController/FBKVOController.h>
+#import <PromiseZ/PZTypedPromise.h>
+#import "XCTestCase+PZPromise.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+static const NSUInteger PZTypedPromiseChainLength = 1000;
+
+@interface PZTypedPromiseTests : XCTestCase
+
+@end
+
+@implementation PZTypedPromiseTests
+
+- (void)tearDown
+{
+    [self.KVOController unobserveAll];
+    [super tearDown];
+}
+
+- (void)testKeepingRunsChainedFunctions
+{
+    pz::Promise<int64_t> promise;
+    pz::Future<int64_t> future = promise.future().then([](int64_t value) {
+        return value + 1;
+    }).then([](int64_t value) {
+        return value * 2;
+    });
+    
+    XCTAssertEqual(future.state(), PZPromiseStatePending);
+    
+    XCTAssertTrue(promise.keep(1));
+    XCTAssertFalse(promise.keep(2));
+    
+    XCTAssertEqual(future.state(), PZPromiseStateKept);
+    XCTAssertEqual(future.value(), (int64_t)4);
+}
+
+- (void)testMoveOnlyValues
+{
+    pz::Future<std::string> future = pz::Future<std::unique_ptr<int>>::kept(std::make_unique<int>(41)).then([](std::unique_ptr<int> value) {
+        *value += 1;
+        return value;
+    }).then([](std::unique_ptr<int> value) {
+        return std::to_string(*value);
+    });
+    
+    XCTAssertTrue(future.value() == "42");
+}
+
+- (void)testBrokenReasonPassesThroughToRecover
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    __block BOOL didRunOnKept = NO;
+    
+    pz::Future<NSInteger> future = pz::Future<NSInteger>::broken(error).then([&](NSInteger value) {
+        didRunOnKept = YES;
+        return value;
+    }).recover([](NSError *reason) {
+        return reason.code;
+    });
+    
+    XCTAssertFalse(didRunOnKept);
+    XCTAssertEqual(future.value(), (NSInteger)900);
+}
+
+- (void)testExceptionBreaksFuture
+{
+    pz::Future<int> future = pz::Future<int>::kept(1).then([](int value) -> int {
+        throw std::runtime_error("Expected exception.");
+    });
+    
+    XCTAssertEqual(future.state(), PZPromiseStateBroken);
+    XCTAssertEqual(future.reason().code, PZExceptionError);
+}
+
+- (void)testAdoptsReturnedFuture
+{
+    pz::Promise<int> inner;
+    pz::Future<int> innerFuture = inner.future();
+    pz::Future<int> future = pz::Future<int>::kept(1).then([&](int value) {
+        return std::move(innerFuture);
+    });
+    
+    XCTAssertEqual(future.state(), PZPromiseStatePending);
+    
+    inner.keep(5);
+    
+    XCTAssertEqual(future.value(), 5);
+}
+
+- (void)testAdoptsReturnedPromise
+{
+    PZPromise *inner = [PZPromise new];
+    pz::Future<id> future = pz::Future<int>::kept(1).then([&](int value) {
+        return inner;
+    });
+    
+    PZPromise *promise = std::move(future).to_promise();
+    
+    [self expectPromise:promise toReachState:PZPromiseStateKept];
+    [inner keepWithValue:@"A"];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promise.keptValue, @"A");
+}
+
+- (void)testFutureFromThenable
+{
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:900 userInfo:nil];
+    PZPromise *promise = std::move(pz::future_from_thenable([[PZPromise alloc] initWithBrokenReason:error])).to_promise();
+    
+    [self expectPromise:promise toReachState:PZPromiseStateBroken];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(promise.brokenReason, error);
+}
+
+- (void)testToPromiseBoxesValues
+{
+    PZPromise *number = pz::Future<int64_t>::kept(42).to_promise();
+    PZPromise *object = pz::Future<NSString *>::kept(@"A").to_promise();
+    PZPromise *structure = pz::Future<NSRange>::kept(NSMakeRange(1, 2)).to_promise();
+    
+    XCTAssertEqualObjects(number.keptValue, @42);
+    XCTAssertEqualObjects(object.keptValue, @"A");
+    XCTAssertTrue(NSEqualRanges([structure.keptValue rangeValue], NSMakeRange(1, 2)));
+}
+
+- (void)testDestroyingPendingPromiseAbandonsFuture
+{
+    pz::Future<int> future;
+    {
+        pz::Promise<int> promise;
+        future = promise.future();
+    }
+    
+    XCTAssertEqual(future.state(), PZPromiseStateBroken);
+    XCTAssertEqual(future.reason().code, PZAbandonedError);
+}
+
+- (void)testPipelineRunsFusedStages
+{
+    pz::Promise<int64_t> promise;
+    pz::Future<std::string> future = promise.future().map([](int64_t value) {
+        return value * 2;
+    }).map([](int64_t value) {
+        return std::to_string(value);
+    });
+    
+    promise.keep(21);
+    
+    XCTAssertTrue(future.value() == "42");
+}
+
+- (void)testPipelineEndedWithThenAdoptsFuture
+{
+    pz::Promise<int> inner;
+    pz::Future<int> innerFuture = inner.future();
+    pz::Future<int> future = pz::Future<int>::kept(1).map([](int value) {
+        return value + 1;
+    }).then([&](int value) {
+        return std::move(innerFuture);
+    });
+    
+    XCTAssertEqual(future.state(), PZPromiseStatePending);
+    
+    inner.keep(5);
+    
+    XCTAssertEqual(future.value(), 5);
+}
+
+- (void)testPipelineExceptionIsRecovered
+{
+    pz::Future<int> future = pz::Future<int>::kept(1).map([](int value) -> int {
+        throw std::runtime_error("Expected exception.");
+    }).map([](int value) {
+        return value + 1;
+    }).recover([](NSError *reason) {
+        return (int)reason.code;
+    });
+    
+    XCTAssertEqual(future.value(), (int)PZExceptionError);
+}
+
+
+#pragma mark - Performance
+
+- (void)testTypedChainPerformance
+{
+    [self measureBlock:^{
+        pz::Promise<int64_t> promise;
+        pz::Future<int64_t> future = promise.future();
+        for (NSUInteger i = 0; i < PZTypedPromiseChainLength; i++)
+        {
+            future = std::move(future).then([](int64_t value) {
+                return value + 1;
+            });
+        }
+        
+        promise.keep(0);
+        XCTAssertEqual(future.value(), (int64_t)PZTypedPromiseChainLength);
+    }];
+}
+
+- (void)testTypedPipelinePerformance
+{
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < PZTypedPromiseChainLength / 10; i++)
+        {
+            pz::Promise<int64_t> promise;
+            pz::Future<int64_t> future = promise.future().map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            }).map([](int64_t value) {
+                return value + 1;
+            });
+            
+            promise.keep(0);
+            XCTAssertEqual(future.value(), (int64_t)10);
+        }
+    }];
+}
+
+- (void)testBoxedChainPerformance
+{
+    [self measureBlock:^{
+        PZPromise *promise = [PZPromise new];
+        PZPromise *future = promise;
+        for (NSUInteger i = 0; i < PZTypedPromiseChainLength; i++)
+        {
+            future = [future thenOnKept:^id(NSNumber *value) {
+                return @(value.longLongValue + 1);
+            } onBroken:nil];
+        }
+        
+        [promise keepWithValue:@0];
+        XCTAssertTrue([future waitWithTimeout:30.0]);
+        XCTAssertEqualObjects(future.keptValue, @(PZTypedPromiseChainLength));
+    }];
+}
+
+@end
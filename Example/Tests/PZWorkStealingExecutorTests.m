@@ -0,0 +1,287 @@
+//
+//  PZWorkStealingExecutorTests.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/20/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZWorkStealingExecutor.h>
+#import <PromiseZ/PZPromise.h>
+#import <libkern/OSAtomic.h>
+
+// A binary tree of blocks 16 levels deep, whose 65536 leaves each do a little arithmetic.
+static const NSUInteger PZWorkStealingBenchmarkDepth = 16;
+static const NSUInteger PZWorkStealingBenchmarkLeafIterations = 2000;
+
+static const NSUInteger PZWorkStealingChainCount = 64;
+static const NSUInteger PZWorkStealingChainLength = 1000;
+
+static volatile uint32_t PZWorkStealingBenchmarkSink;
+
+// Every block schedules its children from a worker, so they land on that worker's deque and the other workers can only get them by stealing.
+static void PZWorkStealingFanOut(PZWorkStealingExecutor *executor, NSUInteger depth, dispatch_group_t group)
+{
+    if (depth == 0)
+    {
+        uint32_t value = (uint32_t)(uintptr_t)group;
+        for (NSUInteger i = 0; i < PZWorkStealingBenchmarkLeafIterations; i++)
+        {
+            value ^= value << 13;
+            value ^= value >> 17;
+            value ^= value << 5;
+        }
+        PZWorkStealingBenchmarkSink = value;
+        return;
+    }
+    
+    for (NSUInteger i = 0; i < 2; i++)
+    {
+        dispatch_group_enter(group);
+        [executor executeBlock:^{
+            PZWorkStealingFanOut(executor, depth - 1, group);
+            dispatch_group_leave(group);
+        }];
+    }
+}
+
+@interface PZWorkStealingExecutorTests : XCTestCase
+
+@end
+
+@implementation PZWorkStealingExecutorTests
+
+- (void)tearDown
+{
+    [PZPromise setDefaultExecutor:nil];
+    [super tearDown];
+}
+
+- (void)testExecutesEveryBlock
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:4];
+    __block int32_t count = 0;
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Every block should execute."];
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        [executor executeBlock:^{
+            if (OSAtomicIncrement32(&count) == 10000)
+            {
+                [expectation fulfill];
+            }
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testNestedBlocksRunInLIFOOrder
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:1];
+    NSMutableArray *order = [NSMutableArray new];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Nested blocks should execute."];
+    [executor executeBlock:^{
+        [executor executeBlock:^{
+            [order addObject:@"A"];
+            [expectation fulfill];
+        }];
+        [executor executeBlock:^{
+            [order addObject:@"B"];
+        }];
+        
+        // Submitting from a worker never executes the block right away.
+        XCTAssertEqual(order.count, 0);
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    XCTAssertEqualObjects(order, (@[@"B", @"A"]));
+}
+
+- (void)testIdleWorkerStealsBlock
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:2];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"The nested block should be stolen."];
+    [executor executeBlock:^{
+        dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+        
+        // The block is pushed onto this worker's deque, so it can only run while this worker waits if the other worker steals it.
+        [executor executeBlock:^{
+            dispatch_semaphore_signal(semaphore);
+        }];
+        
+        if (dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5.0 * NSEC_PER_SEC))) == 0)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
+- (void)testDeallocatedExecutorFinishesQueuedBlocks
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Queued block should execute."];
+    
+    @autoreleasepool
+    {
+        PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:1];
+        [executor executeBlock:^{
+            [expectation fulfill];
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testExecutePendingBlockRunsQueuedBlockOnCaller
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:1];
+    dispatch_semaphore_t startedSemaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t gateSemaphore = dispatch_semaphore_create(0);
+    
+    // Occupies the only worker, so the next block stays in the shared queue.
+    [executor executeBlock:^{
+        dispatch_semaphore_signal(startedSemaphore);
+        dispatch_semaphore_wait(gateSemaphore, DISPATCH_TIME_FOREVER);
+    }];
+    dispatch_semaphore_wait(startedSemaphore, DISPATCH_TIME_FOREVER);
+    
+    __block BOOL didExecuteOnCaller = NO;
+    [executor executeBlock:^{
+        didExecuteOnCaller = [NSThread isMainThread];
+    }];
+    
+    XCTAssertTrue([executor executePendingBlock]);
+    XCTAssertTrue(didExecuteOnCaller);
+    XCTAssertFalse([executor executePendingBlock]);
+    
+    dispatch_semaphore_signal(gateSemaphore);
+}
+
+- (void)testWaitingWorkerExecutesContinuations
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:1];
+    [PZPromise setDefaultExecutor:executor];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Wait should return."];
+    [executor executeBlock:^{
+        PZPromise *promiseA = [PZPromise new];
+        PZPromise *promiseB = [promiseA thenOnKept:^id(NSString *value) {
+            return [value stringByAppendingString:@"B"];
+        } onBroken:nil];
+        
+        // The continuation is pushed onto this worker's deque, and the only worker is the one waiting, so the wait must execute it.
+        [promiseA keepWithValue:@"A"];
+        
+        XCTAssertTrue([promiseB waitWithTimeout:1.0]);
+        XCTAssertEqualObjects(promiseB.keptValue, @"AB");
+        [expectation fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testPromiseContinuationsRunInOrder
+{
+    PZPromise *promise = [PZPromise new];
+    NSMutableArray *order = [NSMutableArray new];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Continuations should execute."];
+    NSMutableArray *promises = [NSMutableArray new];
+    for (NSUInteger i = 0; i < 100; i++)
+    {
+        [promises addObject:[promise thenOnKept:^id(id value) {
+            [order addObject:@(i)];
+            if (order.count == 100)
+            {
+                [expectation fulfill];
+            }
+            return nil;
+        } onBroken:nil]];
+    }
+    
+    [promise keepWithValue:nil];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    for (NSUInteger i = 0; i < 100; i++)
+    {
+        XCTAssertEqualObjects(order[i], @(i));
+    }
+}
+
+
+#pragma mark - Performance
+
+- (void)measureFanOutWithWorkerCount:(NSUInteger)workerCount
+{
+    PZWorkStealingExecutor *executor = [[PZWorkStealingExecutor alloc] initWithWorkerCount:workerCount];
+    
+    [self measureBlock:^{
+        dispatch_group_t group = dispatch_group_create();
+        dispatch_group_enter(group);
+        [executor executeBlock:^{
+            PZWorkStealingFanOut(executor, PZWorkStealingBenchmarkDepth, group);
+            dispatch_group_leave(group);
+        }];
+        
+        XCTAssertEqual(dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(30.0 * NSEC_PER_SEC))), 0);
+    }];
+}
+
+- (void)testFanOutWithOneWorkerPerformance
+{
+    [self measureFanOutWithWorkerCount:1];
+}
+
+- (void)testFanOutWithTwoWorkersPerformance
+{
+    [self measureFanOutWithWorkerCount:2];
+}
+
+- (void)testFanOutWithFourWorkersPerformance
+{
+    [self measureFanOutWithWorkerCount:4];
+}
+
+- (void)testFanOutWithAllProcessorsPerformance
+{
+    [self measureFanOutWithWorkerCount:[NSProcessInfo processInfo].activeProcessorCount];
+}
+
+- (void)testPromiseChainPerformance
+{
+    [self measureBlock:^{
+        __block int32_t finishedCount = 0;
+        XCTestExpectation *expectation = [self expectationWithDescription:@"Every chain should finish."];
+        NSMutableArray *promises = [NSMutableArray new];
+        
+        // Independent chains can run on different workers, while the links of a chain stay on one worker's deque.
+        for (NSUInteger i = 0; i < PZWorkStealingChainCount; i++)
+        {
+            PZPromise *promise = [[PZPromise alloc] initWithKeptValue:@0];
+            for (NSUInteger j = 0; j < PZWorkStealingChainLength; j++)
+            {
+                promise = [promise thenOnKept:^id(NSNumber *value) {
+                    return @(value.unsignedIntegerValue + 1);
+                } onBroken:nil];
+            }
+            
+            [promises addObject:[promise thenOnKept:^id(id value) {
+                if (OSAtomicIncrement32(&finishedCount) == PZWorkStealingChainCount)
+                {
+                    [expectation fulfill];
+                }
+                return nil;
+            } onBroken:nil]];
+        }
+        
+        [self waitForExpectationsWithTimeout:30.0 handler:nil];
+    }];
+}
+
+@end
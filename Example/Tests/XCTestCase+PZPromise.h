@@ -0,0 +1,32 @@
+//
+//  XCTestCase+PZPromise.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/26/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <PromiseZ/PZPromise.h>
+
+/**
+ *  Expectations shared by the test cases. Promises are observed through the test case's KVOController, so test cases using these should call -unobserveAll on it in -tearDown.
+ */
+@interface XCTestCase (PZPromise)
+
+/**
+ *  Adds an expectation which is fulfilled once the promise reaches the given state. Wait for it with -waitForExpectationsWithTimeout:handler:.
+ *
+ *  @param promise The promise to observe.
+ *  @param state   The state the promise is expected to reach.
+ */
+- (void)expectPromise:(PZPromise *)promise toReachState:(PZPromiseState)state;
+
+/**
+ *  Waits up to 5 seconds for the promise to be kept or broken.
+ *
+ *  @param promise The promise to wait for.
+ */
+- (void)waitForPromise:(PZPromise *)promise;
+
+@end
@@ -0,0 +1,38 @@
+//
+//  XCTestCase+PZPromise.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/26/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "XCTestCase+PZPromise.h"
+#import <KVOController/FBKVOController.h>
+
+@implementation XCTestCase (PZPromise)
+
+- (void)expectPromise:(PZPromise *)promise toReachState:(PZPromiseState)state
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Promise should resolve."];
+    [self.KVOController observe:promise keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+        if (promise.state == state)
+        {
+            [expectation fulfill];
+        }
+    }];
+}
+
+- (void)waitForPromise:(PZPromise *)promise
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Promise should resolve."];
+    [self.KVOController observe:promise keyPath:NSStringFromSelector(@selector(state)) options:NSKeyValueObservingOptionInitial block:^(id observer, id object, NSDictionary *change) {
+        if (promise.state != PZPromiseStatePending)
+        {
+            [expectation fulfill];
+        }
+    }];
+    
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+@end
@@ -0,0 +1,169 @@
+//
+//  PZAsyncCache.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/8/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  Block used by PZAsyncCache to measure the cost of a kept value.
+ *
+ *  @param value The kept value being cached.
+ *
+ *  @return The cost of the value, for example the length of an NSData.
+ */
+typedef NSUInteger(^PZAsyncCacheCostBlock)(id value);
+
+/**
+ *  A memoizing cache for promise returning tasks. The results of settled tasks are stored as already resolved promises, so cache hits return a promise without going through the [PZThenable thenOnKept:onBroken:] machinery. Concurrent misses for the same key are deduplicated via a PZSingleFlight registry.
+ *
+ *  Kept values are cached for a per-entry lifetime and evicted in least-recently-used order when the count or cost limits are exceeded. Broken reasons can optionally be cached for a (usually shorter) lifetime, and expired kept values can optionally be served while a fresh value is loaded in the background.
+ *
+ *  This class is thread safe.
+ */
+@interface PZAsyncCache : NSObject
+
+/**
+ *  @name Creating caches
+ */
+
+/**
+ *  The designated initializer.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init NS_DESIGNATED_INITIALIZER;
+
+
+/**
+ *  @name Configuring the cache
+ */
+
+/**
+ *  How long kept values are cached when no explicit lifetime is given. Defaults to 0, which caches kept values until they are evicted.
+ */
+@property (assign, atomic) NSTimeInterval defaultLifetime;
+
+/**
+ *  How long broken reasons are cached. Defaults to 0, which never caches broken reasons so the next caller retries the task.
+ */
+@property (assign, atomic) NSTimeInterval brokenReasonLifetime;
+
+/**
+ *  How long after expiring a kept value may still be returned while a fresh value is loaded in the background. Defaults to 0, which never returns expired values.
+ */
+@property (assign, atomic) NSTimeInterval staleWhileRevalidateInterval;
+
+/**
+ *  The maximum number of cached entries. Defaults to 0, which means no limit.
+ */
+@property (assign, atomic) NSUInteger countLimit;
+
+/**
+ *  The maximum total cost of cached kept values as measured by the costBlock. Defaults to 0, which means no limit.
+ */
+@property (assign, atomic) NSUInteger totalCostLimit;
+
+/**
+ *  Block which measures the cost of kept values. If nil, all values have a cost of 0.
+ */
+@property (copy, atomic) PZAsyncCacheCostBlock costBlock;
+
+
+/**
+ *  @name Accessing promises
+ */
+
+/**
+ *  Returns a promise for the key using the defaultLifetime.
+ *
+ *  @see -promiseForKey:lifetime:usingBlock:
+ */
+- (PZPromise *)promiseForKey:(id<NSCopying>)key usingBlock:(PZPromiseFactoryBlock)block;
+
+/**
+ *  Returns a cached promise for the key if it exists, or starts the task via the block and caches its result.
+ *
+ *  @param key      The key identifying the task. This must not be nil.
+ *  @param lifetime How long a kept value is cached. A value of 0 or less caches the value until it is evicted.
+ *  @param block    The block which starts the task and returns a promise for its result. This must not be nil.
+ *
+ *  @return An already resolved promise on a cache hit, otherwise the pending promise shared by all callers missing the key.
+ */
+- (PZPromise *)promiseForKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime usingBlock:(PZPromiseFactoryBlock)block;
+
+/**
+ *  Returns the cached promise for the key without starting any task or counting a hit or miss.
+ *
+ *  @param key The key identifying the task. This must not be nil.
+ *
+ *  @return The cached, already resolved promise, or nil if there is none or it has expired.
+ */
+- (PZPromise *)cachedPromiseForKey:(id<NSCopying>)key;
+
+/**
+ *  Caches a kept value for the key, replacing any existing entry.
+ *
+ *  @param value    The value to cache. This can be nil.
+ *  @param key      The key identifying the value. This must not be nil.
+ *  @param lifetime How long the value is cached. A value of 0 or less caches the value until it is evicted.
+ */
+- (void)setKeptValue:(id)value forKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime;
+
+/**
+ *  Removes the cached entry for the key. Tasks already in flight keep running, but their results are no longer cached.
+ *
+ *  @param key The key identifying the entry. This must not be nil.
+ */
+- (void)removePromiseForKey:(id<NSCopying>)key;
+
+/**
+ *  Removes all cached entries. Like -removePromiseForKey:, the results of tasks already in flight are no longer cached.
+ */
+- (void)removeAllPromises;
+
+
+/**
+ *  @name Monitoring the cache
+ */
+
+/**
+ *  The number of entries currently cached.
+ */
+@property (assign, nonatomic, readonly) NSUInteger count;
+
+/**
+ *  The total cost of the kept values currently cached.
+ */
+@property (assign, nonatomic, readonly) NSUInteger totalCost;
+
+/**
+ *  The number of requests answered from a fresh cached entry, including cached broken reasons.
+ */
+@property (assign, nonatomic, readonly) NSUInteger hitCount;
+
+/**
+ *  The number of requests answered with an expired kept value while it was revalidated.
+ */
+@property (assign, nonatomic, readonly) NSUInteger staleHitCount;
+
+/**
+ *  The number of requests which had to wait for a task.
+ */
+@property (assign, nonatomic, readonly) NSUInteger missCount;
+
+/**
+ *  The number of entries removed to stay within the count or cost limits.
+ */
+@property (assign, nonatomic, readonly) NSUInteger evictionCount;
+
+/**
+ *  Resets the hit, stale hit, miss, and eviction counters to 0.
+ */
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,435 @@
+//
+//  PZAsyncCache.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/8/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZAsyncCache.h"
+#import "PZSingleFlight.h"
+#import <libkern/OSAtomic.h>
+
+// Stands in for the generation of a value which wasn't loaded by the cache, and is always stored.
+static const uint64_t _PZAsyncCacheNoLoadGeneration = 0;
+
+@interface _PZAsyncCacheEntry : NSObject
+
+@property (strong, nonatomic) id key;
+
+// An already resolved promise, handed out as-is on every hit.
+@property (strong, nonatomic) PZPromise *promise;
+
+@property (assign, nonatomic) NSUInteger cost;
+@property (assign, nonatomic) NSTimeInterval expiration;
+
+// The least-recently-used list links. Entries are owned by the cache's dictionary, so these are unretained.
+@property (unsafe_unretained, nonatomic) _PZAsyncCacheEntry *previous;
+@property (unsafe_unretained, nonatomic) _PZAsyncCacheEntry *next;
+
+@end
+
+@implementation _PZAsyncCacheEntry
+@end
+
+
+#pragma mark - PZAsyncCache
+
+@interface PZAsyncCache ()
+{
+    OSSpinLock _spinLock;
+    
+    // Most recently used entries are at the head, eviction candidates at the tail.
+    __unsafe_unretained _PZAsyncCacheEntry *_head;
+    __unsafe_unretained _PZAsyncCacheEntry *_tail;
+    
+    uint64_t _lastLoadGeneration;
+}
+
+@property (strong, nonatomic, readonly) NSMutableDictionary *entries;
+
+// The generation of the load in flight for each key. Removing a key drops its generation, so the load finishing afterwards knows not to store its result.
+@property (strong, nonatomic, readonly) NSMutableDictionary *loadGenerations;
+
+@property (strong, nonatomic, readonly) PZSingleFlight *singleFlight;
+
+@end
+
+@implementation PZAsyncCache
+@synthesize totalCost = _totalCost;
+@synthesize hitCount = _hitCount;
+@synthesize staleHitCount = _staleHitCount;
+@synthesize missCount = _missCount;
+@synthesize evictionCount = _evictionCount;
+
+#pragma mark Creating caches
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _entries = [NSMutableDictionary new];
+    _loadGenerations = [NSMutableDictionary new];
+    _lastLoadGeneration = _PZAsyncCacheNoLoadGeneration;
+    _singleFlight = [PZSingleFlight new];
+    
+    return self;
+}
+
+
+#pragma mark Accessing promises
+
+- (PZPromise *)promiseForKey:(id<NSCopying>)key usingBlock:(PZPromiseFactoryBlock)block
+{
+    return [self promiseForKey:key lifetime:self.defaultLifetime usingBlock:block];
+}
+
+- (PZPromise *)promiseForKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime usingBlock:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(key);
+    NSParameterAssert(block);
+    
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSTimeInterval staleInterval = self.staleWhileRevalidateInterval;
+    PZPromise *promise;
+    BOOL shouldRevalidate = NO;
+    _PZAsyncCacheEntry *expiredEntry;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    _PZAsyncCacheEntry *entry = self.entries[key];
+    if (entry && now < entry.expiration)
+    {
+        _hitCount += 1;
+        promise = entry.promise;
+        [self _moveEntryToHead:entry];
+    }
+    else if (entry && entry.promise.state == PZPromiseStateKept && now < entry.expiration + staleInterval)
+    {
+        _staleHitCount += 1;
+        promise = entry.promise;
+        shouldRevalidate = YES;
+        [self _moveEntryToHead:entry];
+    }
+    else
+    {
+        _missCount += 1;
+        
+        if (entry)
+        {
+            expiredEntry = entry;
+            [self _removeEntry:entry];
+        }
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // The expired entry is released outside of the lock.
+    expiredEntry = nil;
+    
+    if (promise)
+    {
+        if (shouldRevalidate)
+        {
+            [self _loadPromiseForKey:key lifetime:lifetime usingBlock:block];
+        }
+        
+        return promise;
+    }
+    
+    return [self _loadPromiseForKey:key lifetime:lifetime usingBlock:block];
+}
+
+- (PZPromise *)cachedPromiseForKey:(id<NSCopying>)key
+{
+    NSParameterAssert(key);
+    
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    
+    OSSpinLockLock(&_spinLock);
+    _PZAsyncCacheEntry *entry = self.entries[key];
+    PZPromise *promise = (entry && now < entry.expiration) ? entry.promise : nil;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return promise;
+}
+
+- (void)setKeptValue:(id)value forKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime
+{
+    NSParameterAssert(key);
+    
+    [self _storeKeptValue:value forKey:key lifetime:lifetime loadGeneration:_PZAsyncCacheNoLoadGeneration];
+}
+
+- (void)removePromiseForKey:(id<NSCopying>)key
+{
+    NSParameterAssert(key);
+    
+    OSSpinLockLock(&_spinLock);
+    _PZAsyncCacheEntry *entry = self.entries[key];
+    if (entry)
+    {
+        [self _removeEntry:entry];
+    }
+    [self.loadGenerations removeObjectForKey:key];
+    OSSpinLockUnlock(&_spinLock);
+    
+    entry = nil;
+}
+
+- (void)removeAllPromises
+{
+    NSDictionary *entries;
+    
+    OSSpinLockLock(&_spinLock);
+    entries = [self.entries copy];
+    [self.entries removeAllObjects];
+    [self.loadGenerations removeAllObjects];
+    _head = nil;
+    _tail = nil;
+    _totalCost = 0;
+    OSSpinLockUnlock(&_spinLock);
+    
+    entries = nil;
+}
+
+
+#pragma mark Monitoring the cache
+
+- (NSUInteger)count
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger count = self.entries.count;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return count;
+}
+
+- (NSUInteger)totalCost
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger totalCost = _totalCost;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return totalCost;
+}
+
+- (NSUInteger)hitCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger hitCount = _hitCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return hitCount;
+}
+
+- (NSUInteger)staleHitCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger staleHitCount = _staleHitCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return staleHitCount;
+}
+
+- (NSUInteger)missCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger missCount = _missCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return missCount;
+}
+
+- (NSUInteger)evictionCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger evictionCount = _evictionCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return evictionCount;
+}
+
+- (void)resetStatistics
+{
+    OSSpinLockLock(&_spinLock);
+    _hitCount = 0;
+    _staleHitCount = 0;
+    _missCount = 0;
+    _evictionCount = 0;
+    OSSpinLockUnlock(&_spinLock);
+}
+
+
+#pragma mark Private
+
+- (PZPromise *)_loadPromiseForKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime usingBlock:(PZPromiseFactoryBlock)block
+{
+    __weak typeof(self) weakSelf = self;
+    
+    // The single flight runs the block later, so the generation is taken now, before the key can be removed.
+    uint64_t loadGeneration = [self _loadGenerationForKey:key];
+    
+    return [self.singleFlight promiseForKey:key usingBlock:^PZPromise *{
+        PZPromise *taskPromise = block() ?: [PZPromise keptNil];
+        
+        // The result is stored before the shared promise resolves, so callers arriving after it resolves find the cached entry.
+        return [taskPromise thenOnKept:^id(id value) {
+            [weakSelf _storeKeptValue:value forKey:key lifetime:lifetime loadGeneration:loadGeneration];
+            return value;
+        } onBroken:^id(NSError *reason) {
+            PZPromise *brokenPromise = [[PZPromise alloc] initWithBrokenReason:reason];
+            
+            typeof(self) strongSelf = weakSelf;
+            NSTimeInterval brokenReasonLifetime = strongSelf.brokenReasonLifetime;
+            [strongSelf _storePromise:(brokenReasonLifetime > 0.0) ? brokenPromise : nil forKey:key cost:0 lifetime:brokenReasonLifetime loadGeneration:loadGeneration];
+            
+            return brokenPromise;
+        }];
+    }];
+}
+
+// Returns the generation of the load in flight for the key, starting a new one if there is none. Callers joining a load in flight through the single flight share its generation.
+- (uint64_t)_loadGenerationForKey:(id<NSCopying>)key
+{
+    OSSpinLockLock(&_spinLock);
+    
+    NSNumber *loadGeneration = self.loadGenerations[key];
+    if (!loadGeneration)
+    {
+        _lastLoadGeneration += 1;
+        loadGeneration = @(_lastLoadGeneration);
+        self.loadGenerations[[(id)key copy]] = loadGeneration;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return loadGeneration.unsignedLongLongValue;
+}
+
+- (void)_storeKeptValue:(id)value forKey:(id<NSCopying>)key lifetime:(NSTimeInterval)lifetime loadGeneration:(uint64_t)loadGeneration
+{
+    PZPromise *promise = [[PZPromise alloc] initWithKeptValue:value];
+    PZAsyncCacheCostBlock costBlock = self.costBlock;
+    NSUInteger cost = costBlock ? costBlock(value) : 0;
+    
+    [self _storePromise:promise forKey:key cost:cost lifetime:lifetime loadGeneration:loadGeneration];
+}
+
+// Stores the promise unless it is the result of a load whose key was removed while it was in flight. A nil promise only finishes the load.
+- (void)_storePromise:(PZPromise *)promise forKey:(id<NSCopying>)key cost:(NSUInteger)cost lifetime:(NSTimeInterval)lifetime loadGeneration:(uint64_t)loadGeneration
+{
+    _PZAsyncCacheEntry *entry = [_PZAsyncCacheEntry new];
+    entry.key = [(id)key copy];
+    entry.promise = promise;
+    entry.cost = cost;
+    entry.expiration = (lifetime > 0.0) ? [NSProcessInfo processInfo].systemUptime + lifetime : DBL_MAX;
+    
+    NSUInteger countLimit = self.countLimit;
+    NSUInteger totalCostLimit = self.totalCostLimit;
+    NSMutableArray *releasedEntries = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (loadGeneration != _PZAsyncCacheNoLoadGeneration)
+    {
+        BOOL isCurrentLoad = [self.loadGenerations[entry.key] isEqual:@(loadGeneration)];
+        if (isCurrentLoad)
+        {
+            [self.loadGenerations removeObjectForKey:entry.key];
+        }
+        
+        if (!isCurrentLoad || !promise)
+        {
+            OSSpinLockUnlock(&_spinLock);
+            return;
+        }
+    }
+    
+    _PZAsyncCacheEntry *existingEntry = self.entries[entry.key];
+    if (existingEntry)
+    {
+        [releasedEntries addObject:existingEntry];
+        [self _removeEntry:existingEntry];
+    }
+    
+    self.entries[entry.key] = entry;
+    [self _insertEntryAtHead:entry];
+    _totalCost += cost;
+    
+    while (_tail && _tail != entry && ((countLimit > 0 && self.entries.count > countLimit) || (totalCostLimit > 0 && _totalCost > totalCostLimit)))
+    {
+        _PZAsyncCacheEntry *evictedEntry = _tail;
+        [releasedEntries addObject:evictedEntry];
+        [self _removeEntry:evictedEntry];
+        _evictionCount += 1;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    [releasedEntries removeAllObjects];
+}
+
+// The following list helpers must be called while holding the lock.
+
+- (void)_insertEntryAtHead:(_PZAsyncCacheEntry *)entry
+{
+    entry.previous = nil;
+    entry.next = _head;
+    _head.previous = entry;
+    _head = entry;
+    
+    if (!_tail)
+    {
+        _tail = entry;
+    }
+}
+
+- (void)_unlinkEntry:(_PZAsyncCacheEntry *)entry
+{
+    if (entry.previous)
+    {
+        entry.previous.next = entry.next;
+    }
+    else
+    {
+        _head = entry.next;
+    }
+    
+    if (entry.next)
+    {
+        entry.next.previous = entry.previous;
+    }
+    else
+    {
+        _tail = entry.previous;
+    }
+    
+    entry.previous = nil;
+    entry.next = nil;
+}
+
+- (void)_moveEntryToHead:(_PZAsyncCacheEntry *)entry
+{
+    if (_head == entry)
+    {
+        return;
+    }
+    
+    [self _unlinkEntry:entry];
+    [self _insertEntryAtHead:entry];
+}
+
+// The caller must keep the entry alive until the lock is released, since removing it from the dictionary may release it.
+- (void)_removeEntry:(_PZAsyncCacheEntry *)entry
+{
+    [self _unlinkEntry:entry];
+    _totalCost -= entry.cost;
+    [self.entries removeObjectForKey:entry.key];
+}
+
+@end
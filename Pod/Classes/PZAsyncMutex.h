@@ -0,0 +1,54 @@
+//
+//  PZAsyncMutex.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A mutual exclusion lock which is acquired through promises. Unlike a blocking lock taken inside an on-kept block, waiting for a PZAsyncMutex does not stall the thread running the continuation, so shared state can be serialized across promise chains without tying up workers.
+ *
+ *  Waiters acquire the lock in FIFO order. The lock is not reentrant, and it is not owned by a thread, so it may be unlocked from any thread.
+ *
+ *  This class is thread safe.
+ */
+@interface PZAsyncMutex : NSObject
+
+/**
+ *  Whether the lock is currently held.
+ */
+@property (assign, nonatomic, readonly, getter=isLocked) BOOL locked;
+
+/**
+ *  Requests the lock. Every kept promise returned by this method must be balanced by a call to -unlock.
+ *
+ *  @return A promise which is kept with `nil` once the caller holds the lock.
+ */
+- (PZPromise *)lock;
+
+/**
+ *  Takes the lock only if it is free and nobody is waiting for it.
+ *
+ *  @return YES if the caller now holds the lock, otherwise NO.
+ */
+- (BOOL)tryLock;
+
+/**
+ *  Releases the lock, handing it to the longest waiting caller if there is one.
+ */
+- (void)unlock;
+
+/**
+ *  Runs a task while holding the lock. The lock is acquired before the block is invoked and released once the block's promise is kept or broken.
+ *
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the block's promise.
+ */
+- (PZPromise *)withLock:(PZPromiseFactoryBlock)block;
+
+@end
@@ -0,0 +1,66 @@
+//
+//  PZAsyncMutex.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZAsyncMutex.h"
+#import "PZAsyncSemaphore.h"
+
+@interface PZAsyncMutex ()
+
+// A mutex is a semaphore with a single permit, which also gives it the semaphore's FIFO ordering and skipping of abandoned waiters.
+@property (strong, nonatomic, readonly) PZAsyncSemaphore *semaphore;
+
+@end
+
+@implementation PZAsyncMutex
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _semaphore = [[PZAsyncSemaphore alloc] initWithValue:1];
+    
+    return self;
+}
+
+- (BOOL)isLocked
+{
+    return self.semaphore.availablePermits == 0;
+}
+
+- (PZPromise *)lock
+{
+    return [self.semaphore acquire];
+}
+
+- (BOOL)tryLock
+{
+    return [self.semaphore tryAcquire];
+}
+
+- (void)unlock
+{
+    [self.semaphore signal];
+}
+
+- (PZPromise *)withLock:(PZPromiseFactoryBlock)block
+{
+    return [self.semaphore withPermit:block];
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@:%p> locked:%@, waiterCount:%lu", [self class], self, self.isLocked ? @"YES" : @"NO", (unsigned long)self.semaphore.waiterCount];
+}
+
+@end
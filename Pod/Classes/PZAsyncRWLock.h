@@ -0,0 +1,73 @@
+//
+//  PZAsyncRWLock.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A reader-writer lock which is acquired through promises. Any number of readers may hold the lock at once, while a writer holds it exclusively.
+ *
+ *  Waiters are served in FIFO order, so a steady stream of readers cannot starve a writer. Readers which queue up back to back are batched: the whole batch is let through together when the lock becomes available. Each reader still has its own promise, so a reader which is abandoned is skipped without holding up the rest of its batch.
+ *
+ *  This class is thread safe.
+ */
+@interface PZAsyncRWLock : NSObject
+
+/**
+ *  The number of readers currently holding the lock.
+ */
+@property (assign, nonatomic, readonly) NSUInteger readerCount;
+
+/**
+ *  Whether a writer currently holds the lock.
+ */
+@property (assign, nonatomic, readonly, getter=isWriting) BOOL writing;
+
+/**
+ *  Requests the lock for reading. Every kept promise returned by this method must be balanced by a call to -unlockRead.
+ *
+ *  @return A promise which is kept with `nil` once the caller holds the lock for reading.
+ */
+- (PZPromise *)lockRead;
+
+/**
+ *  Requests the lock for writing. Every kept promise returned by this method must be balanced by a call to -unlockWrite.
+ *
+ *  @return A promise which is kept with `nil` once the caller holds the lock exclusively.
+ */
+- (PZPromise *)lockWrite;
+
+/**
+ *  Releases a read hold on the lock.
+ */
+- (void)unlockRead;
+
+/**
+ *  Releases the write hold on the lock.
+ */
+- (void)unlockWrite;
+
+/**
+ *  Runs a task while holding the lock for reading, releasing it once the block's promise is kept or broken.
+ *
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the block's promise.
+ */
+- (PZPromise *)withReadLock:(PZPromiseFactoryBlock)block;
+
+/**
+ *  Runs a task while holding the lock for writing, releasing it once the block's promise is kept or broken.
+ *
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the block's promise.
+ */
+- (PZPromise *)withWriteLock:(PZPromiseFactoryBlock)block;
+
+@end
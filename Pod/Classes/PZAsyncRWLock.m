@@ -0,0 +1,347 @@
+//
+//  PZAsyncRWLock.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/18/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZAsyncRWLock.h"
+#import "PZDeferred.h"
+#import <libkern/OSAtomic.h>
+
+#pragma mark - _PZAsyncRWLockWaiter
+
+// A queued reader or writer. Readers queued back to back are granted the lock together.
+@interface _PZAsyncRWLockWaiter : NSObject
+
+@property (strong, nonatomic) PZDeferred *deferred;
+@property (assign, nonatomic) BOOL isWriter;
+@property (assign, atomic) BOOL abandoned;
+
+// Whether the waiter can still be granted the lock. Abandoned waiters are skipped, since nobody would release a lock granted to them.
+@property (assign, nonatomic, readonly, getter=isLive) BOOL live;
+
+@end
+
+@implementation _PZAsyncRWLockWaiter
+
+- (BOOL)isLive
+{
+    // The promise is marked abandoned under its own lock before the handler setting the flag is executed, so checking it too closes the gap.
+    PZPromise *promise = self.deferred.promise;
+    return !self.abandoned && !promise.isAbandoned && promise.state == PZPromiseStatePending;
+}
+
+@end
+
+
+#pragma mark - _PZAsyncRWLockScope
+
+// Keeps a promise returned by -withReadLock: or -withWriteLock: alive until its task finishes, so the lock is always released.
+@interface _PZAsyncRWLockScope : NSObject
+
+@property (strong, atomic) PZPromise *promise;
+
+@end
+
+@implementation _PZAsyncRWLockScope
+@end
+
+
+#pragma mark - PZAsyncRWLock
+
+@interface PZAsyncRWLock ()
+{
+    OSSpinLock _spinLock;
+    NSUInteger _readerCount;
+    BOOL _writing;
+}
+
+@property (strong, nonatomic, readonly) NSMutableArray *waiters;
+
+@end
+
+@implementation PZAsyncRWLock
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _readerCount = 0;
+    _writing = NO;
+    _waiters = [NSMutableArray new];
+    
+    return self;
+}
+
+- (NSUInteger)readerCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger readerCount = _readerCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return readerCount;
+}
+
+- (BOOL)isWriting
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL writing = _writing;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return writing;
+}
+
+
+#pragma mark Locking
+
+- (PZPromise *)lockRead
+{
+    NSMutableArray *abandonedWaiters = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    [self _removeAbandonedWaitersAddingTo:abandonedWaiters];
+    
+    if (!_writing && self.waiters.count == 0)
+    {
+        _readerCount += 1;
+        OSSpinLockUnlock(&_spinLock);
+        
+        abandonedWaiters = nil;
+        return [[PZPromise alloc] initWithKeptValue:nil];
+    }
+    
+    // Every reader has its own promise, so one abandoning its request doesn't affect the rest of its batch.
+    _PZAsyncRWLockWaiter *waiter = [_PZAsyncRWLockWaiter new];
+    waiter.deferred = [PZDeferred deferred];
+    waiter.isWriter = NO;
+    [self.waiters addObject:waiter];
+    
+    PZPromise *promise = waiter.deferred.promise;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    abandonedWaiters = nil;
+    
+    [self _observeAbandonmentOfWaiter:waiter];
+    
+    return promise;
+}
+
+- (PZPromise *)lockWrite
+{
+    NSMutableArray *abandonedWaiters = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    [self _removeAbandonedWaitersAddingTo:abandonedWaiters];
+    
+    if (!_writing && _readerCount == 0 && self.waiters.count == 0)
+    {
+        _writing = YES;
+        OSSpinLockUnlock(&_spinLock);
+        
+        abandonedWaiters = nil;
+        return [[PZPromise alloc] initWithKeptValue:nil];
+    }
+    
+    _PZAsyncRWLockWaiter *waiter = [_PZAsyncRWLockWaiter new];
+    waiter.deferred = [PZDeferred deferred];
+    waiter.isWriter = YES;
+    [self.waiters addObject:waiter];
+    
+    PZPromise *promise = waiter.deferred.promise;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    abandonedWaiters = nil;
+    
+    [self _observeAbandonmentOfWaiter:waiter];
+    
+    return promise;
+}
+
+- (void)unlockRead
+{
+    NSMutableArray *abandonedWaiters = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    NSAssert(_readerCount > 0, @"Lock (%@) was unlocked for reading more times than it was locked.", self);
+    _readerCount -= 1;
+    NSArray *grantedWaiters = [self _dequeueGrantableWaitersAddingAbandonedWaitersTo:abandonedWaiters];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    abandonedWaiters = nil;
+    for (_PZAsyncRWLockWaiter *waiter in grantedWaiters)
+    {
+        [waiter.deferred keepWithValue:nil];
+    }
+}
+
+- (void)unlockWrite
+{
+    NSMutableArray *abandonedWaiters = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    NSAssert(_writing, @"Lock (%@) was unlocked for writing while not locked for writing.", self);
+    _writing = NO;
+    NSArray *grantedWaiters = [self _dequeueGrantableWaitersAddingAbandonedWaitersTo:abandonedWaiters];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    abandonedWaiters = nil;
+    for (_PZAsyncRWLockWaiter *waiter in grantedWaiters)
+    {
+        [waiter.deferred keepWithValue:nil];
+    }
+}
+
+
+#pragma mark Scoped locking
+
+- (PZPromise *)withReadLock:(PZPromiseFactoryBlock)block
+{
+    return [self _withLockPromise:[self lockRead] isWriter:NO block:block];
+}
+
+- (PZPromise *)withWriteLock:(PZPromiseFactoryBlock)block
+{
+    return [self _withLockPromise:[self lockWrite] isWriter:YES block:block];
+}
+
+
+#pragma mark Private
+
+// Must be called while holding the lock. Marks the waiters at the head of the queue as holding the lock if it can be granted, and returns them so they can be kept outside of the lock. Abandoned waiters removed on the way are added to the array, so they are released outside of the lock as well.
+- (NSArray *)_dequeueGrantableWaitersAddingAbandonedWaitersTo:(NSMutableArray *)abandonedWaiters
+{
+    [self _removeAbandonedWaitersAddingTo:abandonedWaiters];
+    
+    _PZAsyncRWLockWaiter *waiter = self.waiters.firstObject;
+    if (!waiter || _writing)
+    {
+        return nil;
+    }
+    
+    if (waiter.isWriter)
+    {
+        if (_readerCount > 0)
+        {
+            return nil;
+        }
+        
+        _writing = YES;
+        [self.waiters removeObjectAtIndex:0];
+        return @[waiter];
+    }
+    
+    // The readers at the head of the queue are let through together. Only the tail of the queue can grow, so any reader arriving later queues behind the next writer. Readers which were abandoned are skipped rather than counted, since they would never unlock.
+    NSMutableArray *grantedWaiters = [NSMutableArray new];
+    while (self.waiters.count > 0 && ![self.waiters[0] isWriter])
+    {
+        waiter = self.waiters[0];
+        [self.waiters removeObjectAtIndex:0];
+        
+        if (waiter.isLive)
+        {
+            [grantedWaiters addObject:waiter];
+        }
+        else
+        {
+            [abandonedWaiters addObject:waiter];
+        }
+    }
+    _readerCount += grantedWaiters.count;
+    
+    return grantedWaiters;
+}
+
+// Must be called while holding the lock. Removes the waiters at the head of the queue which can no longer be granted the lock, so nothing queues behind them. They are added to the array so they can be released outside of the lock, since their deferreds break their promises when deallocated.
+- (void)_removeAbandonedWaitersAddingTo:(NSMutableArray *)abandonedWaiters
+{
+    while (self.waiters.count > 0 && ![self.waiters[0] isLive])
+    {
+        [abandonedWaiters addObject:self.waiters[0]];
+        [self.waiters removeObjectAtIndex:0];
+    }
+}
+
+// Nobody will release a lock granted to an abandoned waiter, so it is marked to be skipped instead.
+- (void)_observeAbandonmentOfWaiter:(_PZAsyncRWLockWaiter *)waiter
+{
+    __weak _PZAsyncRWLockWaiter *weakWaiter = waiter;
+    [waiter.deferred.promise onAbandoned:^{
+        weakWaiter.abandoned = YES;
+    }];
+}
+
+- (PZPromise *)_withLockPromise:(PZPromise *)lockPromise isWriter:(BOOL)isWriter block:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(block);
+    
+    dispatch_block_t unlock = ^{
+        if (isWriter)
+        {
+            [self unlockWrite];
+        }
+        else
+        {
+            [self unlockRead];
+        }
+    };
+    
+    _PZAsyncRWLockScope *scope = [_PZAsyncRWLockScope new];
+    PZPromise *promise = [lockPromise thenOnKept:^id(id value) {
+        PZPromise *taskPromise;
+        @try
+        {
+            taskPromise = block() ?: [PZPromise keptNil];
+        }
+        @catch (NSException *exception)
+        {
+            // The continuation drain turns the exception into a PZExceptionError, but the lock must be released first.
+            unlock();
+            scope.promise = nil;
+            @throw;
+        }
+        
+        return [taskPromise thenOnKept:^id(id value) {
+            unlock();
+            scope.promise = nil;
+            return value;
+        } onBroken:^id(NSError *reason) {
+            unlock();
+            scope.promise = nil;
+            return [[PZPromise alloc] initWithBrokenReason:reason];
+        }];
+    } onBroken:nil];
+    
+    scope.promise = promise;
+    
+    return promise;
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger readerCount = _readerCount;
+    BOOL writing = _writing;
+    NSUInteger waiterCount = self.waiters.count;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return [NSString stringWithFormat:@"<%@:%p> readerCount:%lu, writing:%@, waiterCount:%lu", [self class], self, (unsigned long)readerCount, writing ? @"YES" : @"NO", (unsigned long)waiterCount];
+}
+
+@end
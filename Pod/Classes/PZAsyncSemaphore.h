@@ -0,0 +1,68 @@
+//
+//  PZAsyncSemaphore.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A counting semaphore which hands out permits through promises instead of blocking threads. Waiting for a permit costs a queued promise rather than a parked thread, so thousands of waiters can be throttled without tying up any workers.
+ *
+ *  Waiters are granted permits in the order they called -acquire. A waiter whose promise is abandoned (see -[PZPromise onAbandoned:]) before it is granted a permit is skipped.
+ *
+ *  This class is thread safe.
+ */
+@interface PZAsyncSemaphore : NSObject
+
+/**
+ *  The designated initializer.
+ *
+ *  @param value The number of permits initially available.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithValue:(NSUInteger)value NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  The number of permits which are available right now.
+ */
+@property (assign, nonatomic, readonly) NSUInteger availablePermits;
+
+/**
+ *  The number of callers waiting for a permit, including abandoned waiters which have not been skipped yet.
+ */
+@property (assign, nonatomic, readonly) NSUInteger waiterCount;
+
+/**
+ *  Requests a permit. Every kept promise returned by this method must be balanced by a call to -signal.
+ *
+ *  @return A promise which is kept with `nil` once the caller holds a permit. If a permit is available and nobody is waiting, the promise is already kept.
+ */
+- (PZPromise *)acquire;
+
+/**
+ *  Takes a permit only if one is available without waiting.
+ *
+ *  @return YES if the caller now holds a permit, otherwise NO.
+ */
+- (BOOL)tryAcquire;
+
+/**
+ *  Returns a permit, granting it to the longest waiting caller if there is one.
+ */
+- (void)signal;
+
+/**
+ *  Runs a task while holding a permit. The permit is acquired before the block is invoked and returned once the block's promise is kept or broken, even if nothing holds on to the returned promise.
+ *
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the block's promise.
+ */
+- (PZPromise *)withPermit:(PZPromiseFactoryBlock)block;
+
+@end
@@ -0,0 +1,244 @@
+//
+//  PZAsyncSemaphore.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZAsyncSemaphore.h"
+#import "PZDeferred.h"
+#import <libkern/OSAtomic.h>
+
+#pragma mark - _PZAsyncSemaphoreWaiter
+
+@interface _PZAsyncSemaphoreWaiter : NSObject
+
+@property (strong, nonatomic) PZDeferred *deferred;
+@property (assign, atomic) BOOL abandoned;
+
+// Whether the waiter can still be granted a permit.
+@property (assign, nonatomic, readonly, getter=isLive) BOOL live;
+
+@end
+
+@implementation _PZAsyncSemaphoreWaiter
+
+- (BOOL)isLive
+{
+    // The promise is marked abandoned under its own lock before the handler setting the flag is executed, so checking it too closes the gap.
+    PZPromise *promise = self.deferred.promise;
+    return !self.abandoned && !promise.isAbandoned && promise.state == PZPromiseStatePending;
+}
+
+@end
+
+
+#pragma mark - _PZAsyncSemaphoreScope
+
+// Keeps the promise returned by -withPermit: alive until its task finishes, so an acquired permit is always returned.
+@interface _PZAsyncSemaphoreScope : NSObject
+
+@property (strong, atomic) PZPromise *promise;
+
+@end
+
+@implementation _PZAsyncSemaphoreScope
+@end
+
+
+#pragma mark - PZAsyncSemaphore
+
+@interface PZAsyncSemaphore ()
+{
+    OSSpinLock _spinLock;
+    NSUInteger _value;
+}
+
+// Waiters in FIFO order. NSMutableArray is backed by a circular buffer, so removing from the front does not shift the remaining waiters.
+@property (strong, nonatomic, readonly) NSMutableArray *waiters;
+
+@end
+
+@implementation PZAsyncSemaphore
+
+- (instancetype)init
+{
+    return [self initWithValue:1];
+}
+
+- (instancetype)initWithValue:(NSUInteger)value
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _value = value;
+    _waiters = [NSMutableArray new];
+    
+    return self;
+}
+
+- (NSUInteger)availablePermits
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger value = _value;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return value;
+}
+
+- (NSUInteger)waiterCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger waiterCount = self.waiters.count;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return waiterCount;
+}
+
+
+#pragma mark Acquiring and signalling
+
+- (PZPromise *)acquire
+{
+    if ([self tryAcquire])
+    {
+        return [[PZPromise alloc] initWithKeptValue:nil];
+    }
+    
+    _PZAsyncSemaphoreWaiter *waiter = [_PZAsyncSemaphoreWaiter new];
+    waiter.deferred = [PZDeferred deferred];
+    PZPromise *promise = waiter.deferred.promise;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // A permit may have been returned since the first check.
+    if (_value > 0 && self.waiters.count == 0)
+    {
+        _value -= 1;
+        OSSpinLockUnlock(&_spinLock);
+        
+        [waiter.deferred keepWithValue:nil];
+        return promise;
+    }
+    
+    [self.waiters addObject:waiter];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // Nobody will use a permit granted to an abandoned waiter, so it is passed on to the next one instead.
+    __weak _PZAsyncSemaphoreWaiter *weakWaiter = waiter;
+    [promise onAbandoned:^{
+        weakWaiter.abandoned = YES;
+    }];
+    
+    return promise;
+}
+
+- (BOOL)tryAcquire
+{
+    BOOL didAcquire = NO;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // Permits are never taken out from under waiters, which keeps the queue fair.
+    if (_value > 0 && self.waiters.count == 0)
+    {
+        _value -= 1;
+        didAcquire = YES;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return didAcquire;
+}
+
+- (void)signal
+{
+    _PZAsyncSemaphoreWaiter *waiter = nil;
+    NSMutableArray *abandonedWaiters;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    while (self.waiters.count > 0)
+    {
+        waiter = self.waiters[0];
+        [self.waiters removeObjectAtIndex:0];
+        
+        if (waiter.isLive)
+        {
+            break;
+        }
+        
+        if (!abandonedWaiters)
+        {
+            abandonedWaiters = [NSMutableArray new];
+        }
+        [abandonedWaiters addObject:waiter];
+        waiter = nil;
+    }
+    
+    if (!waiter)
+    {
+        _value += 1;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // Abandoned waiters are released and the granted waiter is kept outside of the lock, since both notify observers which run arbitrary code. The deferred of an abandoned waiter breaks its promise when deallocated.
+    abandonedWaiters = nil;
+    [waiter.deferred keepWithValue:nil];
+}
+
+- (PZPromise *)withPermit:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(block);
+    
+    _PZAsyncSemaphoreScope *scope = [_PZAsyncSemaphoreScope new];
+    PZPromise *promise = [[self acquire] thenOnKept:^id(id value) {
+        PZPromise *taskPromise;
+        @try
+        {
+            taskPromise = block() ?: [PZPromise keptNil];
+        }
+        @catch (NSException *exception)
+        {
+            // The continuation drain turns the exception into a PZExceptionError, but the permit must be returned first.
+            [self signal];
+            scope.promise = nil;
+            @throw;
+        }
+        
+        return [taskPromise thenOnKept:^id(id value) {
+            [self signal];
+            scope.promise = nil;
+            return value;
+        } onBroken:^id(NSError *reason) {
+            [self signal];
+            scope.promise = nil;
+            return [[PZPromise alloc] initWithBrokenReason:reason];
+        }];
+    } onBroken:nil];
+    
+    scope.promise = promise;
+    
+    return promise;
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger value = _value;
+    NSUInteger waiterCount = self.waiters.count;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return [NSString stringWithFormat:@"<%@:%p> availablePermits:%lu, waiterCount:%lu", [self class], self, (unsigned long)value, (unsigned long)waiterCount];
+}
+
+@end
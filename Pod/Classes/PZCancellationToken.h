@@ -0,0 +1,58 @@
+//
+//  PZCancellationToken.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/14/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  A token which lets the consumer of a promise chain tell the producers that their results are no longer needed.
+ *
+ *  Passing a token to -[PZPromise thenOnKept:onBroken:cancellationToken:] ties the returned promise to it. When the token is cancelled, every pending promise tied to it is broken with a PZCancelledError, and any on-kept or on-broken blocks that have not started yet are skipped. Operations doing the underlying work can be linked with -linkOperation: so they are cancelled as well.
+ *
+ *  A token can only be cancelled once, and it holds neither the promises tied to it nor the operations linked to it. This class is thread safe.
+ */
+@interface PZCancellationToken : NSObject
+
+/**
+ *  Whether the receiver has been cancelled. This is KVC compliant.
+ */
+@property (assign, nonatomic, readonly, getter=isCancelled) BOOL cancelled;
+
+/**
+ *  Cancels the receiver, executing its cancellation handlers in the order they were added. Subsequent calls have no effect.
+ */
+- (void)cancel;
+
+/**
+ *  Adds a block which is executed when the receiver is cancelled. The block is executed on the thread which calls -cancel.
+ *
+ *  @note If the receiver is already cancelled, the block is executed immediately.
+ *
+ *  @param handler The block to execute. This must not be nil.
+ *
+ *  @return An opaque registration which can be passed to -removeCancellationHandler:, or nil if the receiver was already cancelled.
+ */
+- (id)addCancellationHandler:(dispatch_block_t)handler;
+
+/**
+ *  Removes a cancellation handler so it is not executed and is released.
+ *
+ *  @param registration A registration returned by -addCancellationHandler:. Passing nil or a registration which was already removed has no effect.
+ */
+- (void)removeCancellationHandler:(id)registration;
+
+/**
+ *  Cancels the operation when the receiver is cancelled. The operation is referenced weakly, so linking it does not extend its life.
+ *
+ *  The link is removed once the operation finishes. This wraps the operation's completion block, so a completion block must be set before the operation is linked, or the link stays until the receiver is cancelled or deallocated.
+ *
+ *  @param operation The operation to link. If the receiver is already cancelled, the operation is cancelled immediately.
+ */
+- (void)linkOperation:(NSOperation *)operation;
+
+@end
+
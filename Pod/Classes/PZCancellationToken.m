@@ -0,0 +1,174 @@
+//
+//  PZCancellationToken.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/14/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZCancellationToken.h"
+#import <libkern/OSAtomic.h>
+
+// The property's getter is renamed, so the key can't be derived from a selector.
+static NSString *const _PZCancelledKey = @"cancelled";
+
+@interface PZCancellationToken ()
+{
+    OSSpinLock _spinLock;
+    NSUInteger _nextRegistration;
+}
+
+// Handlers keyed by their registration. Registrations increase monotonically, so sorting the keys recovers the order handlers were added in.
+@property (strong, nonatomic, readonly) NSMutableDictionary *handlers;
+
+@end
+
+@implementation PZCancellationToken
+@synthesize cancelled = _cancelled;
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _nextRegistration = 0;
+    _cancelled = NO;
+    _handlers = [NSMutableDictionary new];
+    
+    return self;
+}
+
+- (BOOL)isCancelled
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL cancelled = _cancelled;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return cancelled;
+}
+
+- (void)cancel
+{
+    OSSpinLockLock(&_spinLock);
+    if (_cancelled)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return;
+    }
+    OSSpinLockUnlock(&_spinLock);
+    
+    // As with PZPromise, KVC notifications are sent outside of the lock so observers can safely call back into the receiver.
+    [self willChangeValueForKey:_PZCancelledKey];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // Another thread may have won the race while the lock was released.
+    BOOL didCancel = !_cancelled;
+    _cancelled = YES;
+    
+    NSArray *handlers = nil;
+    if (didCancel)
+    {
+        NSArray *registrations = [[self.handlers allKeys] sortedArrayUsingSelector:@selector(compare:)];
+        handlers = [self.handlers objectsForKeys:registrations notFoundMarker:[NSNull null]];
+        [self.handlers removeAllObjects];
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    [self didChangeValueForKey:_PZCancelledKey];
+    
+    for (dispatch_block_t handler in handlers)
+    {
+        handler();
+    }
+}
+
+
+#pragma mark Handlers
+
+- (id)addCancellationHandler:(dispatch_block_t)handler
+{
+    NSParameterAssert(handler);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (_cancelled)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        handler();
+        return nil;
+    }
+    
+    _nextRegistration += 1;
+    NSNumber *registration = @(_nextRegistration);
+    self.handlers[registration] = [handler copy];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return registration;
+}
+
+- (void)removeCancellationHandler:(id)registration
+{
+    if (!registration)
+    {
+        return;
+    }
+    
+    OSSpinLockLock(&_spinLock);
+    dispatch_block_t handler = self.handlers[registration];
+    [self.handlers removeObjectForKey:registration];
+    OSSpinLockUnlock(&_spinLock);
+    
+    // The handler is released outside of the lock since it may release arbitrary objects.
+    handler = nil;
+}
+
+- (void)linkOperation:(NSOperation *)operation
+{
+    if (!operation)
+    {
+        return;
+    }
+    
+    __weak NSOperation *weakOperation = operation;
+    id registration = [self addCancellationHandler:^{
+        [weakOperation cancel];
+    }];
+    
+    if (!registration)
+    {
+        return;
+    }
+    
+    // The handler is removed once the operation finishes, so a long lived token doesn't collect one for every operation ever linked to it. Any completion block the operation already had still runs.
+    __weak typeof(self) weakSelf = self;
+    dispatch_block_t completionBlock = operation.completionBlock;
+    operation.completionBlock = ^{
+        [weakSelf removeCancellationHandler:registration];
+        if (completionBlock)
+        {
+            completionBlock();
+        }
+    };
+    
+    // An operation which finished before its completion block was replaced never runs the new one.
+    if (operation.isFinished)
+    {
+        [self removeCancellationHandler:registration];
+    }
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@:%p> cancelled:%@", [self class], self, self.isCancelled ? @"YES" : @"NO"];
+}
+
+@end
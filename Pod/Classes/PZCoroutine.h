@@ -0,0 +1,385 @@
+//
+//  PZCoroutine.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/22/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+#import "PZDeferred.h"
+
+// Coroutines need Objective-C++ compiled as C++20 or later. Anywhere else this header is empty, so it can still be imported from plain Objective-C.
+#if defined(__OBJC__) && defined(__cplusplus) && __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <pthread.h>
+#include <type_traits>
+#include <utility>
+
+namespace pz {
+
+/**
+ *  Thrown by `co_await` when the awaited thenable is broken. If it escapes a pz::task, the task's promise is broken with the same reason, so errors pass through coroutines the way they pass through promise chains.
+ */
+class broken_promise : public std::exception
+{
+public:
+    explicit broken_promise(NSError *reason) noexcept : _reason(reason) {}
+    
+    /**
+     *  The reason the awaited thenable was broken.
+     */
+    NSError *reason() const noexcept { return _reason; }
+    
+    const char *what() const noexcept override { return "The awaited promise was broken."; }
+
+private:
+    NSError *_reason;
+};
+
+template <typename T = id>
+class task;
+
+namespace detail {
+
+// Coroutine frames are recycled through per-thread free lists, one for every 64 byte size class up to 1 KB, so a steady stream of coroutines allocates nothing once the lists are warm. A frame is returned to the list of whichever thread finishes it, so each list is capped.
+struct frame_cache
+{
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t class_count = 16;
+    static constexpr std::size_t max_cached_frames = 32;
+    
+    struct node
+    {
+        node *next;
+    };
+    
+    node *heads[class_count] = {};
+    std::size_t counts[class_count] = {};
+    
+    ~frame_cache()
+    {
+        for (std::size_t index = 0; index < class_count; index++)
+        {
+            while (node *head = heads[index])
+            {
+                heads[index] = head->next;
+                std::free(head);
+            }
+        }
+    }
+    
+    // A pthread key rather than thread_local, which the older deployment targets do not support.
+    static pthread_key_t key() noexcept
+    {
+        static pthread_key_t cacheKey = [] {
+            pthread_key_t newKey;
+            pthread_key_create(&newKey, [](void *cache) {
+                delete static_cast<frame_cache *>(cache);
+            });
+            return newKey;
+        }();
+        return cacheKey;
+    }
+    
+    static frame_cache *current() noexcept
+    {
+        frame_cache *cache = static_cast<frame_cache *>(pthread_getspecific(key()));
+        if (!cache)
+        {
+            cache = new (std::nothrow) frame_cache();
+            pthread_setspecific(key(), cache);
+        }
+        return cache;
+    }
+};
+
+inline void *allocate_frame(std::size_t size)
+{
+    std::size_t index = (size - 1) / frame_cache::granularity;
+    if (index < frame_cache::class_count)
+    {
+        frame_cache *cache = frame_cache::current();
+        if (cache && cache->heads[index])
+        {
+            frame_cache::node *node = cache->heads[index];
+            cache->heads[index] = node->next;
+            cache->counts[index] -= 1;
+            return node;
+        }
+        
+        // Rounding up lets the frame be reused by any coroutine of the same size class.
+        size = (index + 1) * frame_cache::granularity;
+    }
+    
+    if (void *pointer = std::malloc(size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+inline void deallocate_frame(void *pointer, std::size_t size) noexcept
+{
+    std::size_t index = (size - 1) / frame_cache::granularity;
+    if (index < frame_cache::class_count)
+    {
+        frame_cache *cache = frame_cache::current();
+        if (cache && cache->counts[index] < frame_cache::max_cached_frames)
+        {
+            frame_cache::node *node = static_cast<frame_cache::node *>(pointer);
+            node->next = cache->heads[index];
+            cache->heads[index] = node;
+            cache->counts[index] += 1;
+            return;
+        }
+    }
+    
+    std::free(pointer);
+}
+
+inline NSError *exception_error(NSString *reason)
+{
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Unexpected exception raised while running a coroutine.",
+                               NSLocalizedFailureReasonErrorKey: reason ?: @"Unknown exception."};
+    return [NSError errorWithDomain:PZErrorDomain code:PZExceptionError userInfo:userInfo];
+}
+
+// Awaits any thenable. PZPromise instances are observed with -[PZPromise onResolved:], which skips the bound promise and continuation that -thenOnKept:onBroken: allocates for every step. Awaiting nil resumes right away with nil, like a task kept with nil.
+class thenable_awaiter
+{
+public:
+    explicit thenable_awaiter(id<PZThenable> thenable) noexcept : _thenable(thenable), _promise([thenable isKindOfClass:[PZPromise class]] ? (PZPromise *)thenable : nil), _state(PZPromiseStatePending) {}
+    
+    bool await_ready() const noexcept
+    {
+        if (!_thenable)
+        {
+            return true;
+        }
+        return _promise && _promise.state != PZPromiseStatePending;
+    }
+    
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        if (_promise)
+        {
+            // The handler runs on the thread resolving the promise, so the coroutine is resumed on the default executor with the promise's priority rather than inside that thread's call.
+            PZPromisePriority priority = _promise.priority;
+            [_promise onResolved:^{
+                [[PZPromise defaultExecutor] executeBlock:^{
+                    handle.resume();
+                } priority:priority];
+            }];
+            return;
+        }
+        
+        // Other thenables can only be observed by binding to them. Their blocks already run asynchronously, so the coroutine is resumed right there. The awaiter lives in the suspended frame, so it outlives the blocks.
+        thenable_awaiter *awaiter = this;
+        [_thenable thenOnKept:^id(id value) {
+            awaiter->_keptValue = value;
+            awaiter->_state = PZPromiseStateKept;
+            handle.resume();
+            return nil;
+        } onBroken:^id(NSError *reason) {
+            awaiter->_brokenReason = reason;
+            awaiter->_state = PZPromiseStateBroken;
+            handle.resume();
+            return nil;
+        }];
+    }
+    
+    id await_resume() const
+    {
+        if (!_thenable)
+        {
+            return nil;
+        }
+        
+        if (_promise)
+        {
+            if (_promise.state == PZPromiseStateBroken)
+            {
+                throw broken_promise(_promise.brokenReason);
+            }
+            return _promise.keptValue;
+        }
+        
+        if (_state == PZPromiseStateBroken)
+        {
+            throw broken_promise(_brokenReason);
+        }
+        return _keptValue;
+    }
+
+private:
+    id<PZThenable> _thenable;
+    PZPromise *_promise;
+    
+    // Only used by thenables which aren't PZPromise instances, which cannot be asked for their result afterward.
+    PZPromiseState _state;
+    id _keptValue;
+    NSError *_brokenReason;
+};
+
+class task_promise_base
+{
+public:
+    task_promise_base() : _deferred([PZDeferred deferred]) {}
+    
+    // Tasks start right away and free their frames as soon as they finish, since the result lives in the promise rather than the frame.
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    
+    void unhandled_exception() noexcept
+    {
+        try
+        {
+            throw;
+        }
+        catch (const broken_promise &exception)
+        {
+            [_deferred breakWithReason:exception.reason()];
+        }
+        catch (NSException *exception)
+        {
+            [_deferred breakWithReason:exception_error(exception.reason ?: exception.description)];
+        }
+        catch (const std::exception &exception)
+        {
+            [_deferred breakWithReason:exception_error(@(exception.what()))];
+        }
+        catch (...)
+        {
+            [_deferred breakWithReason:exception_error(nil)];
+        }
+    }
+    
+    template <typename Awaitable>
+    decltype(auto) await_transform(Awaitable &&awaitable) noexcept
+    {
+        if constexpr (std::is_convertible_v<Awaitable, id<PZThenable>>)
+        {
+            return thenable_awaiter(awaitable);
+        }
+        else
+        {
+            return std::forward<Awaitable>(awaitable);
+        }
+    }
+    
+    static void *operator new(std::size_t size)
+    {
+        return allocate_frame(size);
+    }
+    
+    static void operator delete(void *pointer, std::size_t size) noexcept
+    {
+        deallocate_frame(pointer, size);
+    }
+
+protected:
+    PZDeferred *_deferred;
+};
+
+template <typename T>
+class task_promise : public task_promise_base
+{
+public:
+    task<T> get_return_object() noexcept;
+    
+    void return_value(T value)
+    {
+        [_deferred keepWithValue:value];
+    }
+};
+
+template <>
+class task_promise<void> : public task_promise_base
+{
+public:
+    task<void> get_return_object() noexcept;
+    
+    void return_void()
+    {
+        [_deferred keepWithValue:nil];
+    }
+};
+
+} // namespace detail
+
+/**
+ *  Awaits a thenable from any coroutine. Inside a pz::task this is not needed, since thenables can be awaited directly.
+ *
+ *  @param thenable The thenable to wait for. Awaiting nil resumes right away with nil.
+ *
+ *  @return An awaiter which resumes with the kept value, or throws a pz::broken_promise with the broken reason.
+ */
+inline detail::thenable_awaiter await(id<PZThenable> thenable) noexcept
+{
+    return detail::thenable_awaiter(thenable);
+}
+
+/**
+ *  The return type of coroutines which produce a PZPromise. Thenables, including PZPromise instances and other tasks, can be awaited directly with `co_await`, which resumes with the kept value or throws a pz::broken_promise.
+ *
+ *  @code
+ *  pz::task<NSData *> PZFetchAvatar(NSURL *profileURL)
+ *  {
+ *      NSDictionary *profile = co_await PZFetchJSON(profileURL);
+ *      co_return co_await PZFetchData(profile[@"avatarURL"]);
+ *  }
+ *  @endcode
+ *
+ *  The coroutine starts right away on the calling thread, and after every suspension resumes on +[PZPromise defaultExecutor]. The task's promise is kept with the value passed to `co_return`, or broken when an exception escapes the coroutine. A pz::broken_promise breaks it with the awaited reason, while any other exception breaks it with a PZExceptionError.
+ *
+ *  Frames are allocated from a recycling per-thread cache, and awaiting a PZPromise allocates only the blocks which resume the coroutine. A coroutine awaiting a promise which never resolves is never resumed, and its frame is never freed.
+ *
+ *  @note T must be an Objective-C object pointer type, or void.
+ */
+template <typename T>
+class task
+{
+    static_assert(std::is_void_v<T> || std::is_convertible_v<T, id>, "pz::task values must be Objective-C objects.");
+
+public:
+    using promise_type = detail::task_promise<T>;
+    
+    /**
+     *  The promise settled by the coroutine.
+     */
+    PZPromise *promise() const noexcept { return _promise; }
+    
+    operator PZPromise *() const noexcept { return _promise; }
+
+private:
+    friend promise_type;
+    
+    explicit task(PZPromise *promise) noexcept : _promise(promise) {}
+    
+    PZPromise *_promise;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(_deferred.promise);
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(_deferred.promise);
+}
+
+} // namespace detail
+
+} // namespace pz
+
+#endif
@@ -0,0 +1,51 @@
+//
+//  PZDeferred.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/15/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  The resolving half of a promise. A PZDeferred owns a promise which cannot be kept or broken through its own -keepWithValue: or -breakWithReason: methods, so the code holding the deferred is the only code able to settle it. Hand out the promise to consumers and keep the deferred with the producer.
+ *
+ *  If the deferred is deallocated while its promise is still pending, the promise is broken with a PZAbandonedError. A producer which drops its work without reporting back, like a completion block which is never called, therefore can't leave consumers waiting forever.
+ *
+ *  This class is thread safe.
+ */
+@interface PZDeferred : NSObject
+
+/**
+ *  Convenience method which returns a new deferred.
+ *
+ *  @return A new deferred with a pending promise.
+ */
++ (instancetype)deferred;
+
+/**
+ *  The promise settled by the receiver. The promise does not retain the receiver.
+ */
+@property (strong, nonatomic, readonly) PZPromise *promise;
+
+/**
+ *  Keeps the receiver's promise with the given value.
+ *
+ *  @param value The value to keep the promise with. This can be nil.
+ *
+ *  @return YES if the promise was kept, or NO if it was already resolved.
+ */
+- (BOOL)keepWithValue:(id)value;
+
+/**
+ *  Breaks the receiver's promise with the given reason.
+ *
+ *  @param reason The reason to break the promise. This can be nil.
+ *
+ *  @return YES if the promise was broken, or NO if it was already resolved.
+ */
+- (BOOL)breakWithReason:(NSError *)reason;
+
+@end
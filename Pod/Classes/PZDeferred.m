@@ -0,0 +1,71 @@
+//
+//  PZDeferred.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/15/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZDeferred.h"
+
+// Methods implemented privately by PZPromise which let the deferred create and settle a sealed promise.
+@interface PZPromise (PZDeferredPrivate)
+
+- (instancetype)initSealed;
+- (BOOL)_transitionToState:(PZPromiseState)state valueOrReason:(id)valueOrReason isResolved:(BOOL)isResolved;
+
+@end
+
+
+@implementation PZDeferred
+
++ (instancetype)deferred
+{
+    return [self new];
+}
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _promise = [[PZPromise alloc] initSealed];
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    PZPromise *promise = _promise;
+    if (promise.state != PZPromiseStatePending)
+    {
+        return;
+    }
+    
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Promise abandoned error.",
+                               NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The deferred resolving the promise (<%@:%p>) was deallocated before settling it.", [promise class], promise]};
+    NSError *error = [NSError errorWithDomain:PZErrorDomain code:PZAbandonedError userInfo:userInfo];
+    [promise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
+}
+
+- (BOOL)keepWithValue:(id)value
+{
+    return [self.promise _transitionToState:PZPromiseStateKept valueOrReason:value isResolved:YES];
+}
+
+- (BOOL)breakWithReason:(NSError *)reason
+{
+    return [self.promise _transitionToState:PZPromiseStateBroken valueOrReason:reason isResolved:YES];
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@:%p> promise:%@", [self class], self, self.promise];
+}
+
+@end
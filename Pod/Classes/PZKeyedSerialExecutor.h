@@ -0,0 +1,51 @@
+//
+//  PZKeyedSerialExecutor.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/19/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  Runs asynchronous tasks one at a time per key, while tasks for unrelated keys run in parallel. A task submitted for a key starts only after every task previously submitted for that key has been kept or broken.
+ *
+ *  Keys are hashed onto a fixed number of serial lanes, and each lane only remembers the promise of its most recent task. Idle keys therefore cost nothing, no matter how many distinct keys have been used. Keys which hash onto the same lane are serialized with each other as well, so use more lanes to reduce false sharing between busy keys.
+ *
+ *  This class is thread safe.
+ */
+@interface PZKeyedSerialExecutor : NSObject
+
+/**
+ *  Initializes an executor with a lane count derived from the number of active processors.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param laneCount The number of serial lanes keys are spread across. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithLaneCount:(NSUInteger)laneCount NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) NSUInteger laneCount;
+
+/**
+ *  Submits a task for a key. The block is invoked once every earlier task for the key has finished, whether it was kept or broken.
+ *
+ *  @note The returned promise is bound to the lane, so it cannot be kept or broken manually. The task runs even if nothing holds on to the returned promise.
+ *
+ *  @param key   The key whose tasks must run in order. This must not be nil.
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the block's promise.
+ */
+- (PZPromise *)submitForKey:(id)key usingBlock:(PZPromiseFactoryBlock)block;
+
+@end
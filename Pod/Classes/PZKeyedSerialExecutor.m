@@ -0,0 +1,140 @@
+//
+//  PZKeyedSerialExecutor.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/19/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZKeyedSerialExecutor.h"
+#import <libkern/OSAtomic.h>
+
+#pragma mark - _PZKeyedSerialLane
+
+@interface _PZKeyedSerialLane : NSObject
+{
+    @public
+    OSSpinLock _spinLock;
+}
+
+// The promise of the most recently submitted task, until it settles. Each task's promise is bound to the one before it, so the lane retains its whole pending chain through this single reference.
+@property (strong, nonatomic) PZPromise *tail;
+
+@end
+
+@implementation _PZKeyedSerialLane
+
+- (instancetype)init
+{
+    if ((self = [super init]))
+    {
+        _spinLock = OS_SPINLOCK_INIT;
+    }
+    
+    return self;
+}
+
+@end
+
+
+#pragma mark - PZKeyedSerialExecutor
+
+@interface PZKeyedSerialExecutor ()
+
+@property (copy, nonatomic, readonly) NSArray *lanes;
+
+@end
+
+@implementation PZKeyedSerialExecutor
+
+- (instancetype)init
+{
+    return [self initWithLaneCount:MAX([NSProcessInfo processInfo].activeProcessorCount * 4, 1)];
+}
+
+- (instancetype)initWithLaneCount:(NSUInteger)laneCount
+{
+    NSParameterAssert(laneCount > 0);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    NSMutableArray *lanes = [NSMutableArray arrayWithCapacity:laneCount];
+    for (NSUInteger i = 0; i < laneCount; i++)
+    {
+        [lanes addObject:[_PZKeyedSerialLane new]];
+    }
+    
+    _lanes = [lanes copy];
+    _laneCount = laneCount;
+    
+    return self;
+}
+
+- (PZPromise *)submitForKey:(id)key usingBlock:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(key);
+    NSParameterAssert(block);
+    
+    _PZKeyedSerialLane *lane = [self _laneForKey:key];
+    
+    // Tasks run after the previous task whether it was kept or broken, so one failure doesn't stall the lane.
+    PZPromiseFactoryBlock task = [block copy];
+    PZOnKeptBlock onKept = ^id(id value) {
+        return task();
+    };
+    PZOnBrokenBlock onBroken = ^id(NSError *reason) {
+        return task();
+    };
+    
+    OSSpinLockLock(&lane->_spinLock);
+    
+    PZPromise *previous = lane.tail ?: [[PZPromise alloc] initWithKeptValue:nil];
+    PZPromise *promise = [previous thenOnKept:onKept onBroken:onBroken];
+    lane.tail = promise;
+    
+    OSSpinLockUnlock(&lane->_spinLock);
+    
+    // An idle lane would otherwise hold on to its last result forever. The handler may run right away, so it is added outside of the lock.
+    __weak typeof(self) weakSelf = self;
+    __weak PZPromise *weakPromise = promise;
+    [promise onResolved:^{
+        [weakSelf _clearLane:lane ifTailIsPromise:weakPromise];
+    }];
+    
+    return promise;
+}
+
+
+#pragma mark Private
+
+- (void)_clearLane:(_PZKeyedSerialLane *)lane ifTailIsPromise:(PZPromise *)promise
+{
+    PZPromise *settledTail;
+    
+    OSSpinLockLock(&lane->_spinLock);
+    
+    // A task submitted since then is now the tail, and must be kept so the next task still runs after it.
+    if (promise && lane.tail == promise)
+    {
+        settledTail = lane.tail;
+        lane.tail = nil;
+    }
+    
+    OSSpinLockUnlock(&lane->_spinLock);
+    
+    // The promise is released outside of the lock since its dealloc may do arbitrary work.
+    settledTail = nil;
+}
+
+- (_PZKeyedSerialLane *)_laneForKey:(id)key
+{
+    // Hashes of common keys (like small NSNumbers) are poorly distributed, so they are mixed before picking a lane.
+    uint64_t hash = (uint64_t)[key hash] * 0x9E3779B97F4A7C15ULL;
+    NSArray *lanes = self.lanes;
+    return lanes[(NSUInteger)((hash >> 32) % lanes.count)];
+}
+
+@end
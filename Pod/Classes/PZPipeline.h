@@ -0,0 +1,85 @@
+//
+//  PZPipeline.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/24/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A chain of on-kept blocks which run fused in a single continuation of a promise. Chaining n blocks with [PZThenable thenOnKept:onBroken:] binds n promises and schedules n blocks on the executor, while a pipeline binds one promise and runs the blocks back to back.
+ *
+ *  @code
+ *  PZPromise *promise = [[[response map:^id(NSData *data) {
+ *      return [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+ *  }] map:^id(NSDictionary *JSON) {
+ *      return JSON[@"name"];
+ *  }] promise];
+ *  @endcode
+ *
+ *  A block returning a thenable can't be fused with the blocks after it, since they need the thenable's value. In that case the remaining blocks are bound to the thenable as one fused continuation, so only blocks returning thenables cost an intermediate promise. Otherwise the result matches chaining the blocks one by one: a broken promise skips every block, and an exception raised by any block breaks the result with a PZExceptionError.
+ *
+ *  Pipelines are immutable, so they can be extended from several places and shared between threads.
+ */
+@interface PZPipeline : NSObject
+
+/**
+ *  Initializes a pipeline starting from a promise kept with nil.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param promise The promise whose kept value is passed to the first block. This must not be nil.
+ *
+ *  @return A pipeline without any blocks.
+ */
+- (instancetype)initWithPromise:(PZPromise *)promise NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  The promise the pipeline starts from.
+ */
+@property (strong, nonatomic, readonly) PZPromise *sourcePromise;
+
+/**
+ *  The blocks of the pipeline, in the order they run. Each stage only holds the block it adds, so this is built when called.
+ */
+@property (copy, nonatomic, readonly) NSArray *blocks;
+
+/**
+ *  Creates a pipeline which runs the receiver's blocks followed by the given block. The new pipeline shares the receiver's blocks rather than copying them, so extending a pipeline takes constant time.
+ *
+ *  @param block The block executed with the result of the previous block. This must not be nil.
+ *
+ *  @return A new pipeline. The receiver is not changed.
+ */
+- (PZPipeline *)map:(PZOnKeptBlock)block;
+
+/**
+ *  Binds a new promise to the source promise, which is resolved by running every block of the receiver. Each call binds and runs the pipeline again.
+ *
+ *  @return A promise for the result of the last block.
+ */
+- (PZPromise *)promise;
+
+@end
+
+
+@interface PZPromise (PZPipeline)
+
+/**
+ *  Starts a pipeline from the receiver.
+ *
+ *  @param block The first block of the pipeline. This must not be nil.
+ *
+ *  @return A pipeline with a single block.
+ */
+- (PZPipeline *)map:(PZOnKeptBlock)block;
+
+@end
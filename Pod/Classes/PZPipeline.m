@@ -0,0 +1,116 @@
+//
+//  PZPipeline.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/24/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZPipeline.h"
+
+// Runs the blocks from startIndex on, until one returns a thenable which the rest have to wait for. The rest are then bound to that thenable as another fused continuation, which the promise running this adopts.
+static id _PZRunPipelineBlocks(NSArray *blocks, NSUInteger startIndex, id value)
+{
+    NSUInteger blockCount = blocks.count;
+    for (NSUInteger index = startIndex; index < blockCount; index++)
+    {
+        PZOnKeptBlock block = blocks[index];
+        value = block(value);
+        
+        NSUInteger nextIndex = index + 1;
+        if (nextIndex < blockCount && [value conformsToProtocol:@protocol(PZThenable)])
+        {
+            return [(id<PZThenable>)value thenOnKept:^id(id thenableValue) {
+                return _PZRunPipelineBlocks(blocks, nextIndex, thenableValue);
+            } onBroken:nil];
+        }
+    }
+    
+    return value;
+}
+
+
+#pragma mark - PZPipeline
+
+@interface PZPipeline ()
+
+// The pipeline the receiver extends and the block it adds. Stages are linked rather than copied, so extending a pipeline doesn't copy its blocks.
+@property (strong, nonatomic, readonly) PZPipeline *parent;
+@property (copy, nonatomic, readonly) PZOnKeptBlock block;
+
+@property (assign, nonatomic, readonly) NSUInteger blockCount;
+
+@end
+
+@implementation PZPipeline
+
+- (instancetype)init
+{
+    return [self initWithPromise:[PZPromise keptNil]];
+}
+
+- (instancetype)initWithPromise:(PZPromise *)promise
+{
+    NSParameterAssert(promise);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _sourcePromise = promise;
+    _blockCount = 0;
+    
+    return self;
+}
+
+- (NSArray *)blocks
+{
+    NSMutableArray *blocks = [NSMutableArray arrayWithCapacity:self.blockCount];
+    for (PZPipeline *pipeline = self; pipeline.block; pipeline = pipeline.parent)
+    {
+        [blocks addObject:pipeline.block];
+    }
+    
+    // The stages are walked from the last one back.
+    return [[blocks reverseObjectEnumerator] allObjects];
+}
+
+- (PZPipeline *)map:(PZOnKeptBlock)block
+{
+    NSParameterAssert(block);
+    
+    PZPipeline *pipeline = [[PZPipeline alloc] initWithPromise:self.sourcePromise];
+    pipeline->_parent = self;
+    pipeline->_block = [block copy];
+    pipeline->_blockCount = self.blockCount + 1;
+    
+    return pipeline;
+}
+
+- (PZPromise *)promise
+{
+    NSArray *blocks = self.blocks;
+    if (blocks.count == 0)
+    {
+        return [self.sourcePromise thenOnKept:nil onBroken:nil];
+    }
+    
+    return [self.sourcePromise thenOnKept:^id(id value) {
+        return _PZRunPipelineBlocks(blocks, 0, value);
+    } onBroken:nil];
+}
+
+@end
+
+
+#pragma mark - PZPromise (PZPipeline)
+
+@implementation PZPromise (PZPipeline)
+
+- (PZPipeline *)map:(PZOnKeptBlock)block
+{
+    return [[[PZPipeline alloc] initWithPromise:self] map:block];
+}
+
+@end
@@ -0,0 +1,48 @@
+//
+//  PZPriorityExecutor.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/21/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  An executor which keeps one FIFO queue per PZPromisePriority and always executes the block with the highest effective priority next, so a backlog of low priority work does not delay latency sensitive chains.
+ *
+ *  To keep low priority work from starving, the effective priority of a waiting block rises by one level for every agingInterval its level has gone without being served. Under a steady stream of high priority work, each lower level is therefore still served about once every two aging intervals, while high priority blocks get every other turn no matter how large the low priority backlog is.
+ *
+ *  Blocks are executed on global dispatch queues by at most workerCount blocks at a time. Install an instance with +[PZPromise setDefaultExecutor:] to have promises use it.
+ *
+ *  This class is thread safe.
+ */
+@interface PZPriorityExecutor : NSObject <PZExecutor>
+
+/**
+ *  Initializes an executor with one worker per active processor and an aging interval of 50 milliseconds.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param workerCount   The maximum number of blocks executing at once. Must be greater than 0.
+ *  @param agingInterval The number of seconds a block must wait to be promoted by one priority level. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount agingInterval:(NSTimeInterval)agingInterval NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) NSUInteger workerCount;
+@property (assign, nonatomic, readonly) NSTimeInterval agingInterval;
+
+/**
+ *  The number of blocks waiting to be executed.
+ */
+@property (assign, nonatomic, readonly) NSUInteger pendingCount;
+
+@end
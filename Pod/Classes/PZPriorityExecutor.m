@@ -0,0 +1,213 @@
+//
+//  PZPriorityExecutor.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/21/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZPriorityExecutor.h"
+#import <libkern/OSAtomic.h>
+
+// The queues are held in a C array, so the level count must be a constant expression.
+enum
+{
+    _PZPriorityLevelCount = PZPromisePriorityHigh + 1
+};
+
+#pragma mark - _PZPriorityExecutorItem
+
+@interface _PZPriorityExecutorItem : NSObject
+
+@property (copy, nonatomic) dispatch_block_t block;
+@property (assign, nonatomic) NSTimeInterval enqueueTime;
+
+@end
+
+@implementation _PZPriorityExecutorItem
+@end
+
+
+#pragma mark - PZPriorityExecutor
+
+@interface PZPriorityExecutor ()
+{
+    OSSpinLock _spinLock;
+    NSMutableArray *_queues[_PZPriorityLevelCount];
+    
+    // When a block of every level was last executed. Blocks only age while their level is being passed over, otherwise a large low priority backlog would age past every high priority block at once.
+    NSTimeInterval _lastServedTimes[_PZPriorityLevelCount];
+    NSUInteger _pendingCount;
+    NSUInteger _activeWorkerCount;
+}
+
+@end
+
+@implementation PZPriorityExecutor
+
+- (instancetype)init
+{
+    return [self initWithWorkerCount:MAX([NSProcessInfo processInfo].activeProcessorCount, 1) agingInterval:0.05];
+}
+
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount agingInterval:(NSTimeInterval)agingInterval
+{
+    NSParameterAssert(workerCount > 0);
+    NSParameterAssert(agingInterval > 0.0);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _workerCount = workerCount;
+    _agingInterval = agingInterval;
+    _pendingCount = 0;
+    _activeWorkerCount = 0;
+    
+    for (NSUInteger i = 0; i < _PZPriorityLevelCount; i++)
+    {
+        _queues[i] = [NSMutableArray new];
+        _lastServedTimes[i] = 0.0;
+    }
+    
+    return self;
+}
+
+- (NSUInteger)pendingCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger pendingCount = _pendingCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return pendingCount;
+}
+
+
+#pragma mark PZExecutor
+
+- (void)executeBlock:(dispatch_block_t)block priority:(PZPromisePriority)priority
+{
+    NSParameterAssert(block);
+    NSParameterAssert(priority >= PZPromisePriorityLow && priority <= PZPromisePriorityHigh);
+    
+    _PZPriorityExecutorItem *item = [_PZPriorityExecutorItem new];
+    item.block = block;
+    item.enqueueTime = [NSProcessInfo processInfo].systemUptime;
+    
+    NSUInteger level = (NSUInteger)MIN(MAX(priority, PZPromisePriorityLow), PZPromisePriorityHigh);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    [_queues[level] addObject:item];
+    _pendingCount += 1;
+    
+    BOOL shouldStartWorker = (_activeWorkerCount < self.workerCount);
+    if (shouldStartWorker)
+    {
+        _activeWorkerCount += 1;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldStartWorker)
+    {
+        // Workers retain the receiver only while they have blocks to execute, so an idle executor holds no threads and can be deallocated.
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self _runWorker];
+        });
+    }
+}
+
+- (BOOL)executePendingBlock
+{
+    // The calling thread is blocked waiting anyway, so the block does not count against workerCount.
+    OSSpinLockLock(&_spinLock);
+    _PZPriorityExecutorItem *item = [self _dequeueItem];
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (!item)
+    {
+        return NO;
+    }
+    
+    item.block();
+    return YES;
+}
+
+
+#pragma mark Private
+
+- (void)_runWorker
+{
+    while (YES)
+    {
+        @autoreleasepool
+        {
+            OSSpinLockLock(&_spinLock);
+            
+            _PZPriorityExecutorItem *item = [self _dequeueItem];
+            if (!item)
+            {
+                // A worker only stops while holding the lock with nothing queued, so blocks added afterwards always start a new one.
+                _activeWorkerCount -= 1;
+                OSSpinLockUnlock(&_spinLock);
+                return;
+            }
+            
+            OSSpinLockUnlock(&_spinLock);
+            
+            item.block();
+        }
+    }
+}
+
+// Must be called while holding the lock. Only the head of every queue needs to be considered, since it has waited the longest within its level.
+- (_PZPriorityExecutorItem *)_dequeueItem
+{
+    if (_pendingCount == 0)
+    {
+        return nil;
+    }
+    
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSInteger bestLevel = -1;
+    double bestScore = 0.0;
+    
+    // Levels are visited from the highest down, so ties go to the higher level.
+    for (NSInteger level = _PZPriorityLevelCount - 1; level >= 0; level--)
+    {
+        _PZPriorityExecutorItem *head = _queues[level].firstObject;
+        if (!head)
+        {
+            continue;
+        }
+        
+        NSTimeInterval waitingSince = MAX(head.enqueueTime, _lastServedTimes[level]);
+        double score = level + (now - waitingSince) / self.agingInterval;
+        if (bestLevel < 0 || score > bestScore)
+        {
+            bestLevel = level;
+            bestScore = score;
+        }
+    }
+    
+    NSMutableArray *queue = _queues[bestLevel];
+    _PZPriorityExecutorItem *item = queue.firstObject;
+    [queue removeObjectAtIndex:0];
+    _pendingCount -= 1;
+    _lastServedTimes[bestLevel] = now;
+    
+    return item;
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@:%p> workerCount:%lu, agingInterval:%g, pendingCount:%lu", [self class], self, (unsigned long)self.workerCount, self.agingInterval, (unsigned long)self.pendingCount];
+}
+
+@end
@@ -31,6 +31,16 @@ typedef id(^PZOnKeptBlock)(id value);
  */
 typedef id(^PZOnBrokenBlock)(NSError *reason);
 
+@class PZPromise;
+@class PZCancellationToken;
+
+/**
+ *  Block which starts an arbitrary task and returns a promise for its result. Used by helpers that need to start (or restart) work on demand, like PZSingleFlight.
+ *
+ *  @return A promise which will be kept or broken when the task finishes. Returning `nil` is treated as a task kept with `nil`.
+ */
+typedef PZPromise *(^PZPromiseFactoryBlock)(void);
+
 /**
  *  Possible states for a PZPromise.
  */
@@ -50,11 +60,61 @@ typedef NS_ENUM(NSInteger, PZPromiseState)
     PZPromiseStateBroken
 };
 
+/**
+ *  Priorities for the on-kept and on-broken blocks of a promise chain. Executors serve blocks with a higher priority first.
+ */
+typedef NS_ENUM(NSInteger, PZPromisePriority)
+{
+    /**
+     *  Bulk or prefetching work which nobody is waiting on.
+     */
+    PZPromisePriorityLow = 0,
+    /**
+     *  The priority of promises which were not given one.
+     */
+    PZPromisePriorityDefault,
+    /**
+     *  Latency sensitive work, such as a chain the user is waiting on.
+     */
+    PZPromisePriorityHigh
+};
+
+/**
+ *  Counters describing how the continuation records PZPromise keeps for every pair of chained blocks are recycled. Each thread adds its counts in batches, so they may lag behind by a few dozen records per thread.
+ *
+ *  @see +[PZPromise continuationPoolStatistics]
+ */
+typedef struct PZContinuationPoolStatistics
+{
+    /**
+     *  The number of records used since launch.
+     */
+    uint64_t acquiredRecordCount;
+    /**
+     *  The number of those records which were reused instead of allocated. Divided by acquiredRecordCount, this is the pool's hit rate.
+     */
+    uint64_t reusedRecordCount;
+    /**
+     *  The number of records waiting in the shared pool, not counting the small cache each thread keeps.
+     */
+    NSUInteger pooledRecordCount;
+} PZContinuationPoolStatistics;
+
 /**
  *  The maximum recursion depth allowed by PZPromise when resolving returned PZThenable conformers. After this depth has been reached, the pending promise will be broken with a PZRecursionError.
  */
 FOUNDATION_EXPORT NSInteger const PZMaximumResolutionRecursionDepth;
 
+/**
+ *  The maximum number of nested waits on a single thread which help the default executor. Deeper waits park the thread without executing other blocks, so blocks which wait on each other cannot grow the stack without bound.
+ */
+FOUNDATION_EXPORT NSInteger const PZMaximumWaitHelpDepth;
+
+/**
+ *  The maximum number of promises interned by +[PZPromise promiseWithKeptValue:]. Once the table is full, values which aren't in it yet get a new promise each time.
+ */
+FOUNDATION_EXPORT NSUInteger const PZMaximumInternedPromiseCount;
+
 /**
  *  The error domain for PromiseZ.
  */
@@ -73,7 +133,19 @@ enum
     /**
      *  Error when a promise is put in an inconsistent state. For example, if a promise somehow attempts to begin resolving on-kept or on-broken blocks before being resolved itself, it will be broken with this error.
      */
-    PZInternalError = 1930
+    PZInternalError = 1930,
+    /**
+     *  Error when a promise returned by -[PZPromise timeoutAfter:] or -[PZPromise withDeadline:] is broken because the receiving promise was not resolved in time.
+     */
+    PZTimeoutError = 1940,
+    /**
+     *  Error when a promise tied to a PZCancellationToken is broken because the token was cancelled.
+     */
+    PZCancelledError = 1950,
+    /**
+     *  Error when a promise created by a PZDeferred is broken because the deferred was deallocated before settling it.
+     */
+    PZAbandonedError = 1960
 };
 
 
@@ -100,12 +172,40 @@ enum
 @end
 
 
+/**
+ *  Protocol for objects which execute the on-kept and on-broken blocks of promises.
+ *
+ *  @see +[PZPromise setDefaultExecutor:]
+ */
+@protocol PZExecutor <NSObject>
+@required
+
+/**
+ *  Executes a block asynchronously. Implementations must never execute the block before returning.
+ *
+ *  @param block    The block to execute. This must not be nil.
+ *  @param priority The priority of the chain the block belongs to. Executors may ignore it.
+ */
+- (void)executeBlock:(dispatch_block_t)block priority:(PZPromisePriority)priority;
+
+@optional
+
+/**
+ *  Executes one pending block on the calling thread, if one is ready. Threads blocked in -[PZPromise waitWithTimeout:] call this on the default executor to help with the work they are waiting for instead of sitting idle.
+ *
+ *  @return YES if a block was executed, or NO if there was nothing to execute.
+ */
+- (BOOL)executePendingBlock;
+
+@end
+
+
 /**
  *  A concrete conformer of the PZThenable protocol and the Promises/A+ spec. A PZPromise represents a possible future value which can be asynchronously accessed.
  *
- *  Because PZPromise conforms to the [Promises/A+ spec](https://promisesaplus.com), it has a specific implementation of the [PZThenable thenOnKept:onBroken:] method. First, the method will always return a new promise which cannot be resolved manually via the -keepWithValue: or -breakWithReason: methods. Second, if you provide an on-kept or on-broken block, the return value of the block will resolve the new returned promise. If the block returns a PZPromise or PZThenable, the returned promise will adopt the state of the block's promise. And if any other object is returned (including `nil`), it will -keepWithValue: the new promise using the block value. In the absense of an on-kept or on-broken block, the new promise will simply adopt the state of the receiving promise.
+ *  Because PZPromise conforms to the [Promises/A+ spec](https://promisesaplus.com), it has a specific implementation of the [PZThenable thenOnKept:onBroken:] method. First, the method will return a new promise which cannot be resolved manually via the -keepWithValue: or -breakWithReason: methods. The only exception is a receiver which is already resolved and has no block for its result, which returns itself, since it can no longer change. Second, if you provide an on-kept or on-broken block, the return value of the block will resolve the new returned promise. If the block returns a PZPromise or PZThenable, the returned promise will adopt the state of the block's promise. And if any other object is returned (including `nil`), it will -keepWithValue: the new promise using the block value. In the absense of an on-kept or on-broken block, the new promise will simply adopt the state of the receiving promise.
  *
- *  @note The [PZThenable thenOnKept:onBroken:] method in PZPromise is not guaranteed to execute blocks on the main thread.
+ *  @note The [PZThenable thenOnKept:onBroken:] method in PZPromise is not guaranteed to execute blocks on the main thread. Blocks are executed by the default executor, which is the shared PZWorkStealingExecutor unless replaced, one at a time and in the order they were added for any given promise.
  */
 @interface PZPromise : NSObject <PZThenable>
 
@@ -138,6 +238,26 @@ enum
  */
 - (instancetype)initWithBrokenReason:(NSError *)brokenReason;
 
+/**
+ *  A shared promise kept with nil. A resolved promise can never change, so this can be returned wherever a new promise kept with nil would be, without allocating.
+ *
+ *  @note The blocks chained to a promise are executed one at a time, so blocks chained to a shared promise wait for those chained to it elsewhere. Long running work should be chained to a promise of its own.
+ *
+ *  @return The shared promise kept with nil.
+ */
++ (PZPromise *)keptNil;
+
+/**
+ *  Returns a kept promise for the value, which is shared with every caller passing an equal value of the same kind if the value is small and immutable. NSNull, NSNumber instances, short strings and empty collections are interned this way, so returning constants like @YES or @0 costs no allocation after the first time. Other values always get a new promise.
+ *
+ *  @param value The value to keep the promise with. If nil, keptNil is returned.
+ *
+ *  @note The blocks chained to a promise are executed one at a time, so blocks chained to a shared promise wait for those chained to it elsewhere. Long running work should be chained to a promise of its own.
+ *
+ *  @return A kept promise, which may be shared. Its keptValue is equal to, but may not be identical to, the given value.
+ */
++ (PZPromise *)promiseWithKeptValue:(id)value;
+
 
 /**
  *  @name State properties
@@ -170,7 +290,7 @@ enum
 /**
  *  Keeps the receiver with the given value. This method is thread safe.
  *
- *  @note This method will have no effect if the promise is already kept, broken, or if it is bound to another promise via the [PZThenable thenOnKept:onBroken:] method.
+ *  @note This method will have no effect if the promise is already kept, broken, if it is bound to another promise via the [PZThenable thenOnKept:onBroken:] method, or if it belongs to a PZDeferred.
  *
  *  @param value The value to keep the promise with. This can be nil.
  *
@@ -181,7 +301,7 @@ enum
 /**
  *  Breaks the receiver with the given reason. This method is thread safe.
  *
- *  @note This method will have no effect if the promise is already kept, broken, or if it is bound to another promise via the [PZThenable thenOnKept:onBroken:] method.
+ *  @note This method will have no effect if the promise is already kept, broken, if it is bound to another promise via the [PZThenable thenOnKept:onBroken:] method, or if it belongs to a PZDeferred.
  *
  *  @param reason The reason to break the promise. This can be nil.
  *
@@ -189,4 +309,213 @@ enum
  */
 - (BOOL)breakWithReason:(NSError *)reason;
 
+
+/**
+ *  @name Prioritizing
+ */
+
+/**
+ *  The priority of the chain the receiver belongs to. The blocks which resolve the receiver are scheduled with this priority.
+ *
+ *  Promises created directly have PZPromisePriorityDefault. Promises returned by [PZThenable thenOnKept:onBroken:] inherit the priority of the receiver, so setting a priority with -thenOnKept:onBroken:priority: applies to the rest of the chain.
+ */
+@property (assign, nonatomic, readonly) PZPromisePriority priority;
+
+/**
+ *  Behaves like [PZThenable thenOnKept:onBroken:], but gives the returned promise, and the promises chained to it, the given priority.
+ *
+ *  @note The blocks of a single promise are executed in the order they were added, so the receiver executes all of its pending blocks with the highest priority among them.
+ *
+ *  @param onKept   An optional block executed when the receiver is kept.
+ *  @param onBroken An optional block executed when the receiver is broken.
+ *  @param priority The priority of the returned promise.
+ *
+ *  @return A new promise bound to the receiver.
+ */
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken priority:(PZPromisePriority)priority;
+
+/**
+ *  The priority the receiver is actually needed with, which is the highest of its own priority and the priorities of the promises waiting on it while it is pending. Once resolved, this is the same as priority.
+ *
+ *  A promise waits on the promise it is bound to, and on any promise it is adopting the state of, with its effective priority. So when a high priority chain is bound to a low priority one, every pending promise upstream is raised until the high priority chain is resolved or deallocated, and the blocks resolving it are scheduled accordingly.
+ */
+@property (assign, nonatomic, readonly) PZPromisePriority effectivePriority;
+
+/**
+ *  Adds a block which is executed each time the receiver's effectivePriority changes, so its producer can be sped up while higher priority work waits on it, and slowed down again afterward.
+ *
+ *  The block is executed synchronously on whichever thread changed the priority, and should be quick. It is executed a last time when the receiver resolves, if it was raised at the time. Adding a handler to a resolved promise has no effect.
+ *
+ *  @param handler The block to execute with the new effective priority. This must not be nil.
+ */
+- (void)onEffectivePriorityChanged:(void (^)(PZPromisePriority effectivePriority))handler;
+
+/**
+ *  Raises the queuePriority and qualityOfService of the operation producing the receiver while the receiver's effectivePriority is above its priority, and restores them afterward. The operation is never lowered below its own settings.
+ *
+ *  Neither the operation nor the receiver are retained, so an operation can link the promise it owns.
+ *
+ *  @param operation The operation producing the receiver. This must not be nil.
+ */
+- (void)linkOperation:(NSOperation *)operation;
+
+
+/**
+ *  @name Scheduling
+ */
+
+/**
+ *  The executor used to execute the on-kept and on-broken blocks of every promise. By default this is the shared PZWorkStealingExecutor.
+ *
+ *  @return The current default executor.
+ */
++ (id<PZExecutor>)defaultExecutor;
+
+/**
+ *  Replaces the executor used to execute the on-kept and on-broken blocks of every promise, for example with a PZPriorityExecutor when chains of different priorities compete. Blocks which were already scheduled are not moved.
+ *
+ *  @param executor The new default executor, or nil to restore the shared PZWorkStealingExecutor.
+ */
++ (void)setDefaultExecutor:(id<PZExecutor>)executor;
+
+
+/**
+ *  @name Abandonment
+ */
+
+/**
+ *  Whether every promise bound to the receiver went away while the receiver was still pending.
+ *
+ *  Each promise returned by [PZThenable thenOnKept:onBroken:] counts as a consumer of the receiver until it resolves or is deallocated. A receiver which never had a consumer is never abandoned, since it may still be observed in other ways.
+ */
+@property (assign, nonatomic, readonly, getter=isAbandoned) BOOL abandoned;
+
+/**
+ *  Adds a block which is executed when the receiver is abandoned, so the producer of the receiver can stop work nobody will read. For example, an operation producing the receiver can cancel itself from this block.
+ *
+ *  The block is executed asynchronously on a global queue, at most once. Adding a handler to an abandoned promise executes it right away, and adding one to a resolved promise has no effect.
+ *
+ *  @param handler The block to execute. This must not be nil.
+ */
+- (void)onAbandoned:(dispatch_block_t)handler;
+
+
+/**
+ *  @name Cancelling
+ */
+
+/**
+ *  Behaves like [PZThenable thenOnKept:onBroken:], but ties the returned promise to a cancellation token.
+ *
+ *  If the token is cancelled before the returned promise resolves, the returned promise is broken with a PZCancelledError and the on-kept and on-broken blocks are skipped if they have not started yet. Blocks which are already executing are not interrupted, but their results are ignored.
+ *
+ *  @param onKept            An optional block executed when the receiver is kept.
+ *  @param onBroken          An optional block executed when the receiver is broken.
+ *  @param cancellationToken The token to tie the returned promise to. If this is nil, this method behaves exactly like [PZThenable thenOnKept:onBroken:].
+ *
+ *  @return A new promise bound to the receiver and the token.
+ */
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken cancellationToken:(PZCancellationToken *)cancellationToken;
+
+
+/**
+ *  @name Timing out
+ */
+
+/**
+ *  Returns a promise which adopts the state of the receiver if it resolves within the given interval, or is broken with a PZTimeoutError otherwise.
+ *
+ *  The returned promise cannot be kept or broken manually. It is created at the receiver's priority, and waiters on it raise the receiver's effective priority just as they would for a promise bound to it. A receiver which is already resolved is returned as is.
+ *
+ *  The returned promise does not retain the receiver, and once the interval elapses the receiver no longer references the returned promise either. A slow receiver is therefore released as soon as nothing else holds it. If the returned promise is abandoned, the timer is cancelled and the receiver is released right away.
+ *
+ *  @note Timing out does not affect the receiver itself, which may still be kept or broken later.
+ *
+ *  @param interval The number of seconds to wait for the receiver to resolve.
+ *
+ *  @return A new promise bounded by the interval.
+ */
+- (PZPromise *)timeoutAfter:(NSTimeInterval)interval;
+
+/**
+ *  Returns a promise which adopts the state of the receiver if it resolves before the given date, or is broken with a PZTimeoutError otherwise.
+ *
+ *  @see -timeoutAfter:
+ *
+ *  @param deadline The date by which the receiver must resolve. This must not be nil.
+ *
+ *  @return A new promise bounded by the deadline.
+ */
+- (PZPromise *)withDeadline:(NSDate *)deadline;
+
+/**
+ *  Returns a promise which is kept with `nil` after the given delay. Delays are scheduled on the shared PZTimerWheel, so they are only precise to its tick interval.
+ *
+ *  @param delay The number of seconds to wait before keeping the promise.
+ *
+ *  @return A new promise kept after the delay.
+ */
++ (PZPromise *)after:(NSTimeInterval)delay;
+
+
+/**
+ *  @name Observing
+ */
+
+/**
+ *  Adds a block which is executed once the receiver is resolved, without binding a new promise to it. This is the cheapest way to be told about resolution, for code like the awaiters in PZCoroutine.h which reads the result from the receiver itself.
+ *
+ *  The block is executed synchronously on the thread which resolves the receiver, before the receiver's on-kept and on-broken blocks are scheduled, so it should be quick and hand any real work off to an executor. If the receiver is already resolved, the block is executed right away. The block does not count as a consumer, so it does not keep the receiver from being abandoned.
+ *
+ *  @param handler The block to execute. This must not be nil.
+ */
+- (void)onResolved:(dispatch_block_t)handler;
+
+
+/**
+ *  @name Waiting
+ */
+
+/**
+ *  Blocks the calling thread until the receiver is resolved or the timeout elapses, for synchronous boundaries which need the result on the calling thread. Afterward the result can be read from keptValue or brokenReason.
+ *
+ *  The thread is parked without spinning and is woken as soon as the receiver resolves. On the main thread the run loop keeps running in its default mode instead, so timers, sources and the main queue are still serviced while waiting. The main queue is not serviced if the wait is itself called from a block on the main queue, so work the receiver depends on should not be scheduled there.
+ *
+ *  Other threads first help the default executor, if it implements -[PZExecutor executePendingBlock], by executing its pending blocks until the receiver resolves or nothing is left, and only then park. This usually resolves the receiver without waking another worker, and keeps executor threads which wait on each other from exhausting the pool. Since those blocks may wait in turn, helping is limited to PZMaximumWaitHelpDepth nested waits per thread, beyond which waits simply park.
+ *
+ *  @param timeout The longest time to wait, in seconds.
+ *
+ *  @return YES if the receiver is resolved, or NO if the timeout elapsed first.
+ */
+- (BOOL)waitWithTimeout:(NSTimeInterval)timeout;
+
+/**
+ *  Blocks the calling thread until every promise is resolved or the timeout elapses, in the same way as -waitWithTimeout:.
+ *
+ *  @param promises The PZPromise instances to wait for. This must not be nil.
+ *  @param timeout  The longest time to wait for all of them, in seconds.
+ *
+ *  @return YES if every promise is resolved, or NO if the timeout elapsed first.
+ */
++ (BOOL)waitAll:(NSArray *)promises timeout:(NSTimeInterval)timeout;
+
+
+/**
+ *  @name Diagnostics
+ */
+
+/**
+ *  Describes how well continuation records are being recycled. Chaining blocks to a promise uses a small record which is recycled once the blocks run, through a cache on each thread and a shared pool, so a steady stream of chained blocks allocates no bookkeeping of its own once the pool is warm.
+ *
+ *  @return The current statistics.
+ */
++ (PZContinuationPoolStatistics)continuationPoolStatistics;
+
+/**
+ *  The number of bytes the receiver holds on to itself: its own instance, the continuation records queued on it, and the side table holding its handlers, if it has one. A pending promise with no blocks chained to it and no handlers costs a single small allocation. This is meant for sizing caches of many promises. The blocks, values and other objects the receiver retains are not counted, since they are usually shared.
+ *
+ *  @return The number of bytes retained by the receiver.
+ */
+- (NSUInteger)retainedByteCount;
+
 @end
@@ -7,293 +7,1629 @@
 //
 
 #import "PZPromise.h"
+#import "PZCancellationToken.h"
+#import "PZPromiseArena.h"
+#import "PZTimerWheel.h"
+#import "PZWorkStealingExecutor.h"
 #import <libkern/OSAtomic.h>
+#import <malloc/malloc.h>
+#import <objc/runtime.h>
+#import <pthread.h>
 
 NSInteger const PZMaximumResolutionRecursionDepth = 30;
 
+NSInteger const PZMaximumWaitHelpDepth = 4;
+
+NSUInteger const PZMaximumInternedPromiseCount = 1024;
+
 NSString *const PZErrorDomain = @"com.zachradke.promiseZ.errorDomain";
 
-@interface _PZResolutionOperation : NSOperation
+static OSSpinLock _PZDefaultExecutorSpinLock = OS_SPINLOCK_INIT;
+static id<PZExecutor> _PZDefaultExecutor;
+
+// Converts a deadline in system uptime into a dispatch time, waiting forever for deadlines too far away to represent.
+static dispatch_time_t _PZDispatchTimeForDeadline(NSTimeInterval deadline)
+{
+    NSTimeInterval remaining = MAX(deadline - [NSProcessInfo processInfo].systemUptime, 0.0);
+    if (remaining >= (NSTimeInterval)(INT64_MAX / NSEC_PER_SEC))
+    {
+        return DISPATCH_TIME_FOREVER;
+    }
+    
+    return dispatch_time(DISPATCH_TIME_NOW, (int64_t)(remaining * NSEC_PER_SEC));
+}
+
+// Counts the waits on the current thread which are executing blocks for the default executor.
+static pthread_key_t _PZWaitHelpDepthKey;
+
+static NSInteger _PZWaitHelpDepth(void)
+{
+    return (NSInteger)(intptr_t)pthread_getspecific(_PZWaitHelpDepthKey);
+}
+
+static void _PZSetWaitHelpDepth(NSInteger depth)
+{
+    pthread_setspecific(_PZWaitHelpDepthKey, (void *)(intptr_t)depth);
+}
+
+// The run loop source used to wake the main thread only needs to be signalled, so it has nothing to perform.
+static void _PZPerformWakeSource(void *info)
+{
+}
+
+// Stands in for the priority of a waiter which is not registered, so adding and removing waiters are moves too.
+static const PZPromisePriority _PZNoPriority = -1;
+
+// Priorities outside of the enum would be truncated by the two bit fields they are stored in, and would index past the waiter counts.
+static inline PZPromisePriority _PZClampPriority(PZPromisePriority priority)
+{
+    return MIN(MAX(priority, PZPromisePriorityLow), PZPromisePriorityHigh);
+}
+
+static const NSUInteger _PZMaximumInternedStringLength = 32;
+
+// Only values which can't change are interned, since every caller shares the promise. Copying an immutable object returns the object itself, which tells them apart from mutable ones without relying on class names.
+static BOOL _PZCanInternValue(id value)
+{
+    if (value == [NSNull null] || [value isKindOfClass:[NSNumber class]])
+    {
+        return YES;
+    }
+    
+    if ([value isKindOfClass:[NSString class]])
+    {
+        return [value length] <= _PZMaximumInternedStringLength && [value copy] == value;
+    }
+    
+    if ([value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSSet class]] || [value isKindOfClass:[NSOrderedSet class]])
+    {
+        return [value count] == 0 && [value copy] == value;
+    }
+    
+    return NO;
+}
+
+// Interned values are looked up by equality, which considers @YES equal to @1 and @1 equal to @1.0, so the interned value must also be the same kind of object to be handed out.
+static BOOL _PZInternedValueMatches(id internedValue, id value)
+{
+    if ([internedValue class] != [value class])
+    {
+        return NO;
+    }
+    
+    if ([value isKindOfClass:[NSNumber class]])
+    {
+        return strcmp([internedValue objCType], [value objCType]) == 0;
+    }
+    
+    return YES;
+}
+
+// A pair of on-kept and on-broken blocks waiting for a binding promise to resolve, along with the promise they resolve. Records are plain structs linked into their binding promise's queue, so adding one costs no object allocation, and they are recycled once executed.
+typedef struct _PZContinuationRecord
+{
+    struct _PZContinuationRecord *next;
+    
+    // A weak reference, which is only accessed through objc_storeWeak() and objc_loadWeak(), so a promise nobody holds can be released before its blocks run.
+    __unsafe_unretained id promise;
+    
+    // Retained copies of the blocks.
+    const void *onKept;
+    const void *onBroken;
+    
+    // The priority of the promise the record resolves, captured when it is added.
+    PZPromisePriority priority;
+    
+    // The arena the record was allocated from, or NULL if it is recycled through the pool. The allocation retains the arena.
+    const void *arena;
+} _PZContinuationRecord;
+
+static const NSUInteger _PZMaximumCachedRecordsPerThread = 64;
+static const int32_t _PZMaximumPooledRecords = 4096;
+static const int64_t _PZRecordStatisticsFlushInterval = 64;
+
+// Records are usually added on one thread and executed on an executor thread, so a small cache per thread sits in front of a shared lock-free pool which moves records back to the threads adding them.
+static OSQueueHead _PZRecordPool = OS_ATOMIC_QUEUE_INIT;
+static volatile int32_t _PZPooledRecordCount = 0;
+static volatile int64_t _PZAcquiredRecordCount = 0;
+static volatile int64_t _PZReusedRecordCount = 0;
+static pthread_key_t _PZRecordCacheKey;
+
+// Statistics are counted per thread and added to the shared counters in batches, so counting doesn't make every thread contend on them.
+typedef struct _PZRecordCache
+{
+    _PZContinuationRecord *head;
+    NSUInteger count;
+    int64_t acquiredCount;
+    int64_t reusedCount;
+} _PZRecordCache;
+
+// A promise's first continuation record shares a word with its state and two flags. Records are allocated with 16 byte alignment by both malloc and arenas, which leaves the low four bits of their address free.
+static const uintptr_t _PZStateWordStateMask = 0x3;
+static const uintptr_t _PZStateWordSealedFlag = 0x4;
+static const uintptr_t _PZStateWordDrainRunningFlag = 0x8;
+static const uintptr_t _PZStateWordContinuationMask = ~(uintptr_t)0xF;
+
+static inline PZPromiseState _PZStateWordGetState(uintptr_t word)
+{
+    return (PZPromiseState)(word & _PZStateWordStateMask);
+}
+
+static inline uintptr_t _PZStateWordSetState(uintptr_t word, PZPromiseState state)
+{
+    return (word & ~_PZStateWordStateMask) | ((uintptr_t)state & _PZStateWordStateMask);
+}
+
+static inline _PZContinuationRecord *_PZStateWordGetFirstContinuation(uintptr_t word)
+{
+    return (_PZContinuationRecord *)(word & _PZStateWordContinuationMask);
+}
+
+static inline uintptr_t _PZStateWordSetFirstContinuation(uintptr_t word, _PZContinuationRecord *continuation)
+{
+    return (word & ~_PZStateWordContinuationMask) | (uintptr_t)continuation;
+}
+
+static id __autoreleasing *_PZRecordPromiseLocation(_PZContinuationRecord *record)
+{
+    return (id __autoreleasing *)(void *)&record->promise;
+}
+
+static void _PZFlushRecordStatistics(_PZRecordCache *cache)
+{
+    OSAtomicAdd64(cache->acquiredCount, &_PZAcquiredRecordCount);
+    OSAtomicAdd64(cache->reusedCount, &_PZReusedRecordCount);
+    cache->acquiredCount = 0;
+    cache->reusedCount = 0;
+}
+
+static void _PZPoolRecord(_PZContinuationRecord *record)
+{
+    if (_PZPooledRecordCount < _PZMaximumPooledRecords)
+    {
+        OSAtomicIncrement32(&_PZPooledRecordCount);
+        OSAtomicEnqueue(&_PZRecordPool, record, offsetof(_PZContinuationRecord, next));
+    }
+    else
+    {
+        free(record);
+    }
+}
+
+static void _PZDestroyRecordCache(void *value)
+{
+    _PZRecordCache *cache = value;
+    _PZFlushRecordStatistics(cache);
+    
+    while (cache->head)
+    {
+        _PZContinuationRecord *record = cache->head;
+        cache->head = record->next;
+        _PZPoolRecord(record);
+    }
+    
+    free(cache);
+}
+
+static _PZRecordCache *_PZCurrentRecordCache(void)
+{
+    _PZRecordCache *cache = pthread_getspecific(_PZRecordCacheKey);
+    if (!cache)
+    {
+        cache = calloc(1, sizeof(_PZRecordCache));
+        pthread_setspecific(_PZRecordCacheKey, cache);
+    }
+    
+    return cache;
+}
+
+static _PZContinuationRecord *_PZCreateContinuationRecord(PZPromise *promise, PZOnKeptBlock onKept, PZOnBrokenBlock onBroken, PZPromisePriority priority)
+{
+    _PZContinuationRecord *record = NULL;
+    
+    // Records from an arena are neither recycled nor counted, since the arena frees them all at once.
+    PZPromiseArena *arena = [PZPromiseArena currentArena];
+    if (arena && (record = [arena allocateBytes:sizeof(_PZContinuationRecord)]))
+    {
+        record->arena = (__bridge const void *)arena;
+    }
+    
+    _PZRecordCache *cache = record ? NULL : _PZCurrentRecordCache();
+    if (cache)
+    {
+        record = cache->head;
+        if (record)
+        {
+            cache->head = record->next;
+            cache->count -= 1;
+        }
+        else if ((record = OSAtomicDequeue(&_PZRecordPool, offsetof(_PZContinuationRecord, next))))
+        {
+            OSAtomicDecrement32(&_PZPooledRecordCount);
+        }
+        
+        cache->acquiredCount += 1;
+        cache->reusedCount += record ? 1 : 0;
+        if (cache->acquiredCount >= _PZRecordStatisticsFlushInterval)
+        {
+            _PZFlushRecordStatistics(cache);
+        }
+    }
+    
+    if (!record)
+    {
+        record = malloc(sizeof(_PZContinuationRecord));
+        record->arena = NULL;
+    }
+    NSCAssert(((uintptr_t)record & ~_PZStateWordContinuationMask) == 0, @"Continuation record (%p) is not aligned to 16 bytes.", record);
+    
+    record->next = NULL;
+    record->promise = nil;
+    objc_storeWeak(_PZRecordPromiseLocation(record), promise);
+    record->onKept = onKept ? CFBridgingRetain([onKept copy]) : NULL;
+    record->onBroken = onBroken ? CFBridgingRetain([onBroken copy]) : NULL;
+    record->priority = priority;
+    
+    return record;
+}
+
+// Hands the record's promise, blocks and arena over to the caller and recycles the record.
+static PZPromise *_PZTakeContinuationRecord(_PZContinuationRecord *record, PZOnKeptBlock __strong *onKept, PZOnBrokenBlock __strong *onBroken, PZPromiseArena *__strong *arena)
+{
+    PZPromise *promise = objc_loadWeak(_PZRecordPromiseLocation(record));
+    objc_storeWeak(_PZRecordPromiseLocation(record), nil);
+    
+    *onKept = CFBridgingRelease(record->onKept);
+    *onBroken = CFBridgingRelease(record->onBroken);
+    
+    // The caller's reference keeps the arena alive after the record is relinquished.
+    *arena = (__bridge PZPromiseArena *)record->arena;
+    if (*arena)
+    {
+        [*arena relinquishBytes:record];
+        return promise;
+    }
+    
+    _PZRecordCache *cache = _PZCurrentRecordCache();
+    if (cache && cache->count < _PZMaximumCachedRecordsPerThread)
+    {
+        record->next = cache->head;
+        cache->head = record;
+        cache->count += 1;
+    }
+    else
+    {
+        _PZPoolRecord(record);
+    }
+    
+    return promise;
+}
+
+
+// Links a promise returned by -timeoutAfter: to its source. The source's continuation, the timer and the abandonment of the returned promise all release the observation, whichever comes first, so the source is never retained past the timeout. The other two also cancel the timer, so finished timeouts don't linger in the timer wheel.
+@interface _PZTimeout : NSObject
+{
+    OSSpinLock _spinLock;
+    PZPromisePriority _forwardedPriority;
+}
+
+@property (strong, atomic) PZPromise *observationPromise;
+@property (assign, atomic) PZTimerWheelTimer timer;
+
+// Records the priority at which the returned promise's waiters are forwarded to the observation, returning the one recorded before.
+- (PZPromisePriority)exchangeForwardedPriority:(PZPromisePriority)priority;
+
+@end
+
+@implementation _PZTimeout
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _forwardedPriority = _PZNoPriority;
+    
+    return self;
+}
+
+- (PZPromisePriority)exchangeForwardedPriority:(PZPromisePriority)priority
+{
+    OSSpinLockLock(&_spinLock);
+    PZPromisePriority formerPriority = _forwardedPriority;
+    _forwardedPriority = priority;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return formerPriority;
+}
+
+@end
+
+
+// A waiter registration to move on an upstream promise, queued while a priority change propagates.
+@interface _PZWaiterMove : NSObject
+
+@property (strong, nonatomic) PZPromise *promise;
+@property (assign, nonatomic) PZPromisePriority fromPriority;
+@property (assign, nonatomic) PZPromisePriority toPriority;
+
+@end
+
+@implementation _PZWaiterMove
+@end
+
+static void _PZAddWaiterMove(NSMutableArray *moves, PZPromise *promise, PZPromisePriority fromPriority, PZPromisePriority toPriority)
+{
+    if (!promise)
+    {
+        return;
+    }
+    
+    _PZWaiterMove *move = [_PZWaiterMove new];
+    move.promise = promise;
+    move.fromPriority = fromPriority;
+    move.toPriority = toPriority;
+    [moves addObject:move];
+}
+
+
+// Holds the data few promises ever need, so the others don't pay for it. A promise creates its side table on first use and drops it once resolved. It is only accessed while holding the promise's lock.
+@interface _PZPromiseSideTable : NSObject
 
-- (instancetype)initWithPromise:(PZPromise *)promise onKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken NS_DESIGNATED_INITIALIZER;
+// Set for promises returned by -thenOnKept:onBroken:cancellationToken:, so the cancellation handler can be removed once it can no longer matter.
+@property (strong, nonatomic) PZCancellationToken *cancellationToken;
+@property (strong, nonatomic) id cancellationRegistration;
 
-@property (weak, nonatomic, readonly) PZPromise *promise;
-@property (copy, nonatomic, readonly) PZOnKeptBlock onKept;
-@property (copy, nonatomic, readonly) PZOnBrokenBlock onBroken;
+@property (strong, nonatomic) NSMutableArray *abandonmentHandlers;
+@property (strong, nonatomic) NSMutableArray *effectivePriorityHandlers;
 
-// These properties are atomic and readwrite because they can be changed from multiple threads during promise resolution
-@property (strong, atomic) id<PZThenable> retainedThenable;
-@property (assign, atomic) NSUInteger resolutionCount;
+// Executed synchronously once the promise is resolved. These wake blocked threads and resume awaiting coroutines, so unlike continuations they must not depend on an executor being free.
+@property (strong, nonatomic) NSMutableArray *settlementHandlers;
 
 @end
 
+@implementation _PZPromiseSideTable
+@end
+
 
 #pragma mark - PZPromise
 
 @interface PZPromise ()
 {
     OSSpinLock _spinLock;
+    
+    // Priorities are packed next to the lock. Each is a PZPromisePriority, which fits in two bits. A drain is only scheduled while others are if it has a higher priority than all of them, so at most one per priority is ever scheduled.
+    struct
+    {
+        unsigned int priority : 2;
+        
+        // The priority the receiver is registered with on its binding promise and adopted thenable, which is the highest of its own priority and its waiters' while pending.
+        unsigned int effectivePriority : 2;
+        
+        // The highest priority waiting on the receiver's continuations since the last drain was scheduled, which the next drain is scheduled with.
+        unsigned int pendingDrainPriority : 2;
+        
+        unsigned int scheduledDrainPriority : 2;
+        unsigned int scheduledDrainCount : 4;
+        unsigned int abandoned : 1;
+    } _flags;
+    
+    // The state, whether the receiver is sealed and whether a drain is running, packed with the first continuation. Sealed promises belong to a PZDeferred, and can only be resolved through it.
+    //
+    // Continuations are queued in a linked list and executed in the order they were added, one at a time, by a drain scheduled on the default executor once the receiver is resolved. Usually one drain is scheduled at a time, but when higher priority work starts waiting on a scheduled drain, another is scheduled at the higher priority. Whichever runs first executes every continuation, and the others find nothing left to do.
+    uintptr_t _stateWord;
+    _PZContinuationRecord *_lastContinuation;
+    
+    // The kept value or the broken reason, depending on the state.
+    id _valueOrReason;
+    
+    // Promises bound to the receiver count as its consumers. When the last one goes away while the receiver is pending, the receiver is abandoned.
+    uint32_t _consumerCount;
+    
+    // Promises waiting on the receiver, counted by the priority they are registered with. These are the bound promises, plus the promises adopting the state of one. The counts are signed because registrations are moved outside of the lock, so a removal may briefly be applied before the matching addition.
+    int32_t _waiterCounts[PZPromisePriorityHigh + 1];
+    
+    _PZPromiseSideTable *_sideTable;
 }
 
-@property (strong, nonatomic, readonly) NSOperationQueue *resolutionQueue;
 @property (strong, nonatomic, readonly) PZPromise *bindingPromise;
 
+// The thenable returned by an on-kept or on-broken block which the receiver is adopting the state of. Holding it here rather than in the continuation means it goes away with the receiver, so its own producer can be abandoned. The receiver waits on it with its effective priority.
+@property (strong, nonatomic) id<PZThenable> adoptedThenable;
+
 @end
 
 @implementation PZPromise
-@synthesize state = _state;
-@synthesize keptValue = _keptValue;
-@synthesize brokenReason = _brokenReason;
 @synthesize bindingPromise = _bindingPromise;
+@synthesize adoptedThenable = _adoptedThenable;
 
 #pragma mark Creating promises
 
++ (void)initialize
+{
+    if (self == [PZPromise class])
+    {
+        pthread_key_create(&_PZWaitHelpDepthKey, NULL);
+        pthread_key_create(&_PZRecordCacheKey, _PZDestroyRecordCache);
+    }
+}
+
 - (instancetype)init
 {
     if ((self = [super init]))
     {
-        _state = PZPromiseStatePending;
+        _stateWord = _PZStateWordSetState(0, PZPromiseStatePending);
         
         // The spinlock will enforce thread safety for our properties
         _spinLock = OS_SPINLOCK_INIT;
+        _flags.scheduledDrainCount = 0;
+        _flags.scheduledDrainPriority = PZPromisePriorityLow;
+        _flags.pendingDrainPriority = PZPromisePriorityLow;
+        _flags.priority = PZPromisePriorityDefault;
+        _flags.effectivePriority = PZPromisePriorityDefault;
+    }
+    
+    return self;
+}
+
+- (instancetype)initWithKeptValue:(id)keptValue
+{
+    if ((self = [self init]))
+    {
+        _stateWord = _PZStateWordSetState(_stateWord, PZPromiseStateKept);
+        _valueOrReason = keptValue;
+    }
+    
+    return self;
+}
+
+- (instancetype)initWithBrokenReason:(NSError *)brokenReason
+{
+    if ((self = [self init]))
+    {
+        _stateWord = _PZStateWordSetState(_stateWord, PZPromiseStateBroken);
+        _valueOrReason = brokenReason;
+    }
+    
+    return self;
+}
+
+- (instancetype)initWithBindingPromise:(PZPromise *)bindingPromise priority:(PZPromisePriority)priority
+{
+    NSParameterAssert(priority >= PZPromisePriorityLow && priority <= PZPromisePriorityHigh);
+    
+    if (!(self = [self init]))
+    {
+        return nil;
+    }
+    
+    priority = _PZClampPriority(priority);
+    _bindingPromise = bindingPromise;
+    _flags.priority = priority;
+    _flags.effectivePriority = priority;
+    [bindingPromise _addConsumerWithPriority:priority];
+    
+    return self;
+}
+
+- (instancetype)initSealed
+{
+    if (!(self = [self init]))
+    {
+        return nil;
+    }
+    
+    _stateWord |= _PZStateWordSealedFlag;
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    // Continuations which never ran still hold their blocks.
+    _PZContinuationRecord *continuation = _PZStateWordGetFirstContinuation(_stateWord);
+    while (continuation)
+    {
+        _PZContinuationRecord *nextContinuation = continuation->next;
         
-        // The resolution queue is how we'll stack up thenOnKept:onBroken: blocks to be resolved later.
-        _resolutionQueue = [NSOperationQueue new];
-        _resolutionQueue.maxConcurrentOperationCount = 1;
+        PZOnKeptBlock onKept;
+        PZOnBrokenBlock onBroken;
+        PZPromiseArena *arena;
+        _PZTakeContinuationRecord(continuation, &onKept, &onBroken, &arena);
+        
+        continuation = nextContinuation;
+    }
+    
+    [_bindingPromise _removeConsumerWithPriority:_flags.effectivePriority];
+    [_sideTable.cancellationToken removeCancellationHandler:_sideTable.cancellationRegistration];
+    
+    if ([_adoptedThenable isKindOfClass:[PZPromise class]])
+    {
+        [(PZPromise *)_adoptedThenable _moveWaiterFromPriority:_flags.effectivePriority toPriority:_PZNoPriority];
+    }
+}
+
+
++ (PZPromise *)keptNil
+{
+    static PZPromise *keptNil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keptNil = [[PZPromise alloc] initWithKeptValue:nil];
+    });
+    
+    return keptNil;
+}
+
++ (PZPromise *)promiseWithKeptValue:(id)value
+{
+    if (!value)
+    {
+        return [PZPromise keptNil];
+    }
+    
+    if (!_PZCanInternValue(value))
+    {
+        return [[PZPromise alloc] initWithKeptValue:value];
+    }
+    
+    static OSSpinLock spinLock = OS_SPINLOCK_INIT;
+    static NSMutableDictionary *internedPromises;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        internedPromises = [NSMutableDictionary new];
+    });
+    
+    OSSpinLockLock(&spinLock);
+    PZPromise *promise = internedPromises[value];
+    OSSpinLockUnlock(&spinLock);
+    
+    if (promise)
+    {
+        return _PZInternedValueMatches(promise->_valueOrReason, value) ? promise : [[PZPromise alloc] initWithKeptValue:value];
+    }
+    
+    promise = [[PZPromise alloc] initWithKeptValue:value];
+    
+    OSSpinLockLock(&spinLock);
+    PZPromise *internedPromise = internedPromises[value];
+    if (!internedPromise && internedPromises.count < PZMaximumInternedPromiseCount)
+    {
+        internedPromises[value] = promise;
+    }
+    OSSpinLockUnlock(&spinLock);
+    
+    // Another thread may have interned an equal value in the meantime.
+    if (internedPromise && _PZInternedValueMatches(internedPromise->_valueOrReason, value))
+    {
+        return internedPromise;
+    }
+    
+    return promise;
+}
+
+
+#pragma mark State properties
+
+- (PZPromiseState)state
+{
+    OSSpinLockLock(&_spinLock);
+    PZPromiseState state = _PZStateWordGetState(_stateWord);
+    OSSpinLockUnlock(&_spinLock);
+    
+    return state;
+}
+
+- (id)keptValue
+{
+    OSSpinLockLock(&_spinLock);
+    id keptValue = (_PZStateWordGetState(_stateWord) == PZPromiseStateKept) ? _valueOrReason : nil;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return keptValue;
+}
+
+- (NSError *)brokenReason
+{
+    OSSpinLockLock(&_spinLock);
+    NSError *brokenReason = (_PZStateWordGetState(_stateWord) == PZPromiseStateBroken) ? _valueOrReason : nil;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return brokenReason;
+}
+
+
+#pragma mark Keeping and breaking promises
+
+- (BOOL)keepWithValue:(id)value
+{
+    return [self _transitionToState:PZPromiseStateKept valueOrReason:value isResolved:NO];
+}
+
+- (BOOL)breakWithReason:(NSError *)reason
+{
+    return [self _transitionToState:PZPromiseStateBroken valueOrReason:reason isResolved:NO];
+}
+
+
+#pragma mark Abandonment
+
+- (BOOL)isAbandoned
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL abandoned = _flags.abandoned;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return abandoned;
+}
+
+- (void)onAbandoned:(dispatch_block_t)handler
+{
+    NSParameterAssert(handler);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (_PZStateWordGetState(_stateWord) != PZPromiseStatePending)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return;
+    }
+    
+    if (!_flags.abandoned)
+    {
+        _PZPromiseSideTable *sideTable = [self _loadSideTable];
+        if (!sideTable.abandonmentHandlers)
+        {
+            sideTable.abandonmentHandlers = [NSMutableArray new];
+        }
+        [sideTable.abandonmentHandlers addObject:[handler copy]];
+        
+        OSSpinLockUnlock(&_spinLock);
+        return;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), handler);
+}
+
+
+#pragma mark Cancelling
+
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken cancellationToken:(PZCancellationToken *)cancellationToken
+{
+    if (!cancellationToken)
+    {
+        return [self thenOnKept:onKept onBroken:onBroken];
+    }
+    
+    if (cancellationToken.isCancelled)
+    {
+        return [[[self class] alloc] initWithBrokenReason:[self _cancelledError]];
+    }
+    
+    PZPromisePriority priority = self.priority;
+    PZPromise *returnPromise = [[[self class] alloc] initWithBindingPromise:self priority:priority];
+    
+    // The token must not retain the returned promise, otherwise a long lived token would keep every chain tied to it alive.
+    __weak PZPromise *weakReturnPromise = returnPromise;
+    NSError *error = [self _cancelledError];
+    
+    // The handler is registered before the continuation is added, so it is in place before the blocks could possibly start. If the token was cancelled in the meantime, it breaks the returned promise right here. Continuations skip their blocks once their promise is resolved, so breaking it is all it takes.
+    id registration = [cancellationToken addCancellationHandler:^{
+        [weakReturnPromise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
+    }];
+    
+    [returnPromise _setCancellationToken:cancellationToken registration:registration];
+    
+    _PZContinuationRecord *continuation = _PZCreateContinuationRecord(returnPromise, onKept, onBroken, priority);
+    
+    PZPromisePriority drainPriority;
+    OSSpinLockLock(&_spinLock);
+    BOOL shouldDrain = [self _addContinuation:continuation drainPriority:&drainPriority];
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldDrain)
+    {
+        [self _scheduleDrainWithPriority:drainPriority];
+    }
+    
+    return returnPromise;
+}
+
+
+#pragma mark Prioritizing
+
+- (PZPromisePriority)priority
+{
+    OSSpinLockLock(&_spinLock);
+    PZPromisePriority priority = _flags.priority;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return priority;
+}
+
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken priority:(PZPromisePriority)priority
+{
+    NSParameterAssert(priority >= PZPromisePriorityLow && priority <= PZPromisePriorityHigh);
+    priority = _PZClampPriority(priority);
+    
+    OSSpinLockLock(&_spinLock);
+    PZPromiseState state = _PZStateWordGetState(_stateWord);
+    id valueOrReason = _valueOrReason;
+    PZPromisePriority ownPriority = _flags.priority;
+    OSSpinLockUnlock(&_spinLock);
+    
+    // A resolved promise never changes, so it can stand in for the promise it would pass its result to, unless that promise needs a different priority.
+    BOOL passesResultThrough = (state == PZPromiseStateKept && !onKept) || (state == PZPromiseStateBroken && !onBroken);
+    if (passesResultThrough && priority == ownPriority)
+    {
+        return self;
+    }
+    
+    PZPromise *returnPromise;
+    if (state == PZPromiseStateKept && !onKept)
+    {
+        returnPromise = [[[self class] alloc] initWithKeptValue:valueOrReason];
+        returnPromise->_flags.priority = priority;
+        returnPromise->_flags.effectivePriority = priority;
+        return returnPromise;
+    }
+    else if (state == PZPromiseStateBroken && !onBroken)
+    {
+        returnPromise = [[[self class] alloc] initWithBrokenReason:valueOrReason];
+        returnPromise->_flags.priority = priority;
+        returnPromise->_flags.effectivePriority = priority;
+        return returnPromise;
+    }
+    
+    // The returned promise registers itself as a consumer, which takes the receiver's lock, so it must be created outside of it. Continuations can be added in any state, so nothing is lost if the receiver resolves in between.
+    returnPromise = [[[self class] alloc] initWithBindingPromise:self priority:priority];
+    _PZContinuationRecord *continuation = _PZCreateContinuationRecord(returnPromise, onKept, onBroken, priority);
+    
+    PZPromisePriority drainPriority;
+    OSSpinLockLock(&_spinLock);
+    BOOL shouldDrain = [self _addContinuation:continuation drainPriority:&drainPriority];
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldDrain)
+    {
+        [self _scheduleDrainWithPriority:drainPriority];
+    }
+    
+    return returnPromise;
+}
+
+- (PZPromisePriority)effectivePriority
+{
+    OSSpinLockLock(&_spinLock);
+    PZPromisePriority effectivePriority = _flags.effectivePriority;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return effectivePriority;
+}
+
+- (void)onEffectivePriorityChanged:(void (^)(PZPromisePriority))handler
+{
+    NSParameterAssert(handler);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (_PZStateWordGetState(_stateWord) == PZPromiseStatePending)
+    {
+        _PZPromiseSideTable *sideTable = [self _loadSideTable];
+        if (!sideTable.effectivePriorityHandlers)
+        {
+            sideTable.effectivePriorityHandlers = [NSMutableArray new];
+        }
+        [sideTable.effectivePriorityHandlers addObject:[handler copy]];
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+}
+
+- (void)linkOperation:(NSOperation *)operation
+{
+    NSParameterAssert(operation);
+    
+    NSOperationQueuePriority originalQueuePriority = operation.queuePriority;
+    BOOL supportsQualityOfService = [operation respondsToSelector:@selector(setQualityOfService:)];
+    NSQualityOfService originalQualityOfService = supportsQualityOfService ? operation.qualityOfService : NSQualityOfServiceDefault;
+    PZPromisePriority priority = self.priority;
+    
+    // Neither the operation nor the receiver are retained, since the operation usually owns the receiver.
+    __weak NSOperation *weakOperation = operation;
+    void (^applyPriority)(PZPromisePriority) = ^(PZPromisePriority effectivePriority) {
+        NSOperation *strongOperation = weakOperation;
+        
+        // The operation is only ever raised above its own settings, and gets them back once nothing of higher priority is waiting.
+        NSOperationQueuePriority queuePriority = originalQueuePriority;
+        NSQualityOfService qualityOfService = originalQualityOfService;
+        if (effectivePriority > priority)
+        {
+            queuePriority = MAX(queuePriority, [PZPromise _queuePriorityForPriority:effectivePriority]);
+            qualityOfService = MAX(qualityOfService, [PZPromise _qualityOfServiceForPriority:effectivePriority]);
+        }
+        
+        strongOperation.queuePriority = queuePriority;
+        if (supportsQualityOfService)
+        {
+            strongOperation.qualityOfService = qualityOfService;
+        }
+    };
+    
+    __weak PZPromise *weakSelf = self;
+    [self onEffectivePriorityChanged:^(PZPromisePriority effectivePriority) {
+        // Handlers may run concurrently, so the current value is applied rather than the one passed in, which may already be stale.
+        PZPromise *strongSelf = weakSelf;
+        applyPriority(strongSelf ? strongSelf.effectivePriority : priority);
+    }];
+    
+    applyPriority(self.effectivePriority);
+}
+
+
+#pragma mark Scheduling
+
++ (id<PZExecutor>)defaultExecutor
+{
+    OSSpinLockLock(&_PZDefaultExecutorSpinLock);
+    id<PZExecutor> executor = _PZDefaultExecutor;
+    OSSpinLockUnlock(&_PZDefaultExecutorSpinLock);
+    
+    return executor ?: [PZWorkStealingExecutor sharedExecutor];
+}
+
++ (void)setDefaultExecutor:(id<PZExecutor>)executor
+{
+    OSSpinLockLock(&_PZDefaultExecutorSpinLock);
+    id<PZExecutor> previousExecutor = _PZDefaultExecutor;
+    _PZDefaultExecutor = executor;
+    OSSpinLockUnlock(&_PZDefaultExecutorSpinLock);
+    
+    // The previous executor is released outside of the lock since its dealloc may do arbitrary work.
+    previousExecutor = nil;
+}
+
+
+#pragma mark Timing out
+
+- (PZPromise *)timeoutAfter:(NSTimeInterval)interval
+{
+    // A receiver which already settled can't time out, so it is passed through instead of leaving a timer in the wheel for the full interval.
+    if (self.state != PZPromiseStatePending)
+    {
+        return [self thenOnKept:nil onBroken:nil];
+    }
+    
+    // The returned promise is sealed, so only the receiver or the timer can resolve it.
+    PZPromisePriority priority = self.priority;
+    PZPromise *timeoutPromise = [[PZPromise alloc] initSealed];
+    timeoutPromise->_flags.priority = priority;
+    timeoutPromise->_flags.effectivePriority = priority;
+    __weak PZPromise *weakTimeoutPromise = timeoutPromise;
+    
+    // The timeout only holds the observation of the receiver. The returned promise is referenced weakly so whoever holds it decides how long it lives.
+    _PZTimeout *timeout = [_PZTimeout new];
+    timeout.observationPromise = [self thenOnKept:^id(id value) {
+        [weakTimeoutPromise _transitionToState:PZPromiseStateKept valueOrReason:value isResolved:YES];
+        [[PZTimerWheel sharedTimerWheel] cancelTimer:timeout.timer];
+        timeout.observationPromise = nil;
+        return nil;
+    } onBroken:^id(NSError *reason) {
+        [weakTimeoutPromise _transitionToState:PZPromiseStateBroken valueOrReason:reason isResolved:YES];
+        [[PZTimerWheel sharedTimerWheel] cancelTimer:timeout.timer];
+        timeout.observationPromise = nil;
+        return nil;
+    }];
+    
+    // Handlers registered on the returned promise live as long as it does, so they reference the timeout weakly. Otherwise they would retain the observation, and with it the receiver.
+    __weak _PZTimeout *weakTimeout = timeout;
+    
+    // Waiters on the returned promise are forwarded to the observation, which passes them on to the receiver.
+    [timeoutPromise onEffectivePriorityChanged:^(PZPromisePriority effectivePriority) {
+        _PZTimeout *strongTimeout = weakTimeout;
+        PZPromise *observationPromise = strongTimeout.observationPromise;
+        [observationPromise _moveWaiterFromPriority:[strongTimeout exchangeForwardedPriority:effectivePriority] toPriority:effectivePriority];
+    }];
+    
+    // Once nobody is interested in the returned promise, the timer and the observation are dropped right away, which in turn lets the receiver be abandoned.
+    [timeoutPromise onAbandoned:^{
+        _PZTimeout *strongTimeout = weakTimeout;
+        [[PZTimerWheel sharedTimerWheel] cancelTimer:strongTimeout.timer];
+        strongTimeout.observationPromise = nil;
+    }];
+    
+    // Only the class and address are captured for the error description, since capturing the receiver would retain it.
+    Class receiverClass = [self class];
+    const void *receiverAddress = (__bridge const void *)self;
+    
+    timeout.timer = [[PZTimerWheel sharedTimerWheel] scheduleAfter:interval block:^{
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Promise timeout error.",
+                                   NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The promise (<%@:%p>) was not resolved within %g seconds.", receiverClass, receiverAddress, interval]};
+        [weakTimeoutPromise _transitionToState:PZPromiseStateBroken valueOrReason:[NSError errorWithDomain:PZErrorDomain code:PZTimeoutError userInfo:userInfo] isResolved:YES];
+        
+        // Releasing the observation lets the receiver go, and its pending continuation is skipped once the observation is deallocated.
+        timeout.observationPromise = nil;
+    }];
+    
+    // If the receiver settled or the returned promise was abandoned before the timer was stored, nothing cancelled it, so it is cancelled here.
+    if (!timeout.observationPromise)
+    {
+        [[PZTimerWheel sharedTimerWheel] cancelTimer:timeout.timer];
+    }
+    
+    return timeoutPromise;
+}
+
+- (PZPromise *)withDeadline:(NSDate *)deadline
+{
+    NSParameterAssert(deadline);
+    
+    return [self timeoutAfter:[deadline timeIntervalSinceNow]];
+}
+
++ (PZPromise *)after:(NSTimeInterval)delay
+{
+    PZPromise *promise = [PZPromise new];
+    
+    // The timer retains the promise, so it is kept even if the caller only holds a promise bound to it.
+    [[PZTimerWheel sharedTimerWheel] scheduleAfter:delay block:^{
+        [promise keepWithValue:nil];
+    }];
+    
+    return promise;
+}
+
+
+#pragma mark Observing
+
+- (void)onResolved:(dispatch_block_t)handler
+{
+    NSParameterAssert(handler);
+    
+    if (![self _addSettlementHandler:[handler copy]])
+    {
+        handler();
+    }
+}
+
+
+#pragma mark Waiting
+
+- (BOOL)waitWithTimeout:(NSTimeInterval)timeout
+{
+    return [[self class] waitAll:@[self] timeout:timeout];
+}
+
++ (BOOL)waitAll:(NSArray *)promises timeout:(NSTimeInterval)timeout
+{
+    NSParameterAssert(promises);
+    
+    NSTimeInterval deadline = [NSProcessInfo processInfo].systemUptime + timeout;
+    
+    if ([NSThread isMainThread])
+    {
+        return [self _waitForPromisesOnMainThread:promises deadline:deadline];
+    }
+    
+    id<PZExecutor> executor = [self defaultExecutor];
+    BOOL canHelp = [executor respondsToSelector:@selector(executePendingBlock)] && _PZWaitHelpDepth() < PZMaximumWaitHelpDepth;
+    
+    // Each pending promise signals once when it resolves, so the thread is only woken to count them off.
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_block_t handler = ^{
+        dispatch_semaphore_signal(semaphore);
+    };
+    
+    NSMutableArray *pendingPromises = [NSMutableArray new];
+    for (PZPromise *promise in promises)
+    {
+        if ([promise _addSettlementHandler:handler])
+        {
+            [pendingPromises addObject:promise];
+        }
+    }
+    
+    BOOL resolved = YES;
+    NSUInteger remainingCount = pendingPromises.count;
+    while (remainingCount > 0)
+    {
+        if (dispatch_semaphore_wait(semaphore, DISPATCH_TIME_NOW) == 0)
+        {
+            remainingCount -= 1;
+            continue;
+        }
+        
+        // While the executor has work which may resolve the promises, the thread does it instead of sleeping. Once it runs dry the thread parks, leaving anything submitted later to the executor's own workers.
+        if (canHelp)
+        {
+            if ([self _helpExecutor:executor])
+            {
+                if ([NSProcessInfo processInfo].systemUptime >= deadline)
+                {
+                    resolved = NO;
+                    break;
+                }
+                continue;
+            }
+        }
+        
+        if (dispatch_semaphore_wait(semaphore, _PZDispatchTimeForDeadline(deadline)) != 0)
+        {
+            resolved = NO;
+            break;
+        }
+        remainingCount -= 1;
+    }
+    
+    for (PZPromise *promise in pendingPromises)
+    {
+        [promise _removeSettlementHandler:handler];
+    }
+    
+    return resolved;
+}
+
+
+#pragma mark Diagnostics
+
++ (PZContinuationPoolStatistics)continuationPoolStatistics
+{
+    // The calling thread's own counts are included right away, which makes the statistics exact for single threaded measurements.
+    _PZRecordCache *cache = _PZCurrentRecordCache();
+    if (cache)
+    {
+        _PZFlushRecordStatistics(cache);
+    }
+    
+    PZContinuationPoolStatistics statistics;
+    statistics.acquiredRecordCount = (uint64_t)OSAtomicAdd64Barrier(0, &_PZAcquiredRecordCount);
+    statistics.reusedRecordCount = (uint64_t)OSAtomicAdd64Barrier(0, &_PZReusedRecordCount);
+    statistics.pooledRecordCount = (NSUInteger)MAX(OSAtomicAdd32Barrier(0, &_PZPooledRecordCount), 0);
+    
+    return statistics;
+}
+
+- (NSUInteger)retainedByteCount
+{
+    OSSpinLockLock(&_spinLock);
+    
+    size_t byteCount = malloc_size((__bridge const void *)self);
+    for (_PZContinuationRecord *continuation = _PZStateWordGetFirstContinuation(_stateWord); continuation; continuation = continuation->next)
+    {
+        byteCount += continuation->arena ? sizeof(_PZContinuationRecord) : malloc_size(continuation);
+    }
+    
+    _PZPromiseSideTable *sideTable = _sideTable;
+    if (sideTable)
+    {
+        byteCount += malloc_size((__bridge const void *)sideTable);
+        for (NSArray *handlers in @[sideTable.abandonmentHandlers ?: @[], sideTable.effectivePriorityHandlers ?: @[], sideTable.settlementHandlers ?: @[]])
+        {
+            byteCount += handlers.count ? malloc_size((__bridge const void *)handlers) + handlers.count * sizeof(id) : 0;
+        }
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return byteCount;
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [self descriptionWithLocale:[NSLocale currentLocale] indent:0];
+}
+
+- (NSString *)descriptionWithLocale:(id)locale indent:(NSUInteger)level
+{
+    NSString *padding = [@"" stringByPaddingToLength:level withString:@"\t" startingAtIndex:0];
+    NSMutableString *mutableDescription = [NSMutableString stringWithFormat:@"%@<%@:%p>", padding, [self class], self];
+    
+    switch (self.state)
+    {
+        case PZPromiseStatePending:
+        {
+            [mutableDescription appendString:@" state:PZPromiseStatePending"];
+            
+            if (self.bindingPromise)
+            {
+                [mutableDescription appendFormat:@"\n%@", [self.bindingPromise descriptionWithLocale:locale indent:level+1]];
+            }
+            break;
+        }
+        case PZPromiseStateKept:
+        {
+            [mutableDescription appendFormat:@" state:PZPromiseStateKept, keptValue:%@", self.keptValue];
+            break;
+        }
+        case PZPromiseStateBroken:
+        {
+            [mutableDescription appendFormat:@" state:PZPromiseStateBroken, brokenReason:%@", self.brokenReason];
+            break;
+        }
+        default:
+            break;
+    }
+    
+    return [mutableDescription copy];
+}
+
+
+#pragma mark PZThenable
+
+- (instancetype)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken
+{
+    return [self thenOnKept:onKept onBroken:onBroken priority:self.priority];
+}
+
+
+#pragma mark Private
+
+// Must be called while holding the lock.
+- (_PZPromiseSideTable *)_loadSideTable
+{
+    if (!_sideTable)
+    {
+        _sideTable = [_PZPromiseSideTable new];
+    }
+    
+    return _sideTable;
+}
+
+// Must be called while holding the lock. Returns YES if the caller must schedule a drain with the returned priority once it releases the lock.
+- (BOOL)_addContinuation:(_PZContinuationRecord *)continuation drainPriority:(PZPromisePriority *)drainPriority
+{
+    if (_lastContinuation)
+    {
+        _lastContinuation->next = continuation;
+    }
+    else
+    {
+        _stateWord = _PZStateWordSetFirstContinuation(_stateWord, continuation);
+    }
+    _lastContinuation = continuation;
+    
+    if (continuation->priority > _flags.pendingDrainPriority)
+    {
+        _flags.pendingDrainPriority = continuation->priority;
+    }
+    
+    return [self _claimDrainWithPriority:drainPriority];
+}
+
+// Must be called while holding the lock. Returns YES when the receiver is resolved and has continuations which no scheduled drain will execute soon enough, either because there is no drain or because the scheduled ones have a lower priority than the waiting work.
+- (BOOL)_claimDrainWithPriority:(PZPromisePriority *)drainPriority
+{
+    if (_PZStateWordGetState(_stateWord) == PZPromiseStatePending || !_PZStateWordGetFirstContinuation(_stateWord))
+    {
+        return NO;
+    }
+    
+    if (_flags.scheduledDrainCount > 0 && _flags.pendingDrainPriority <= _flags.scheduledDrainPriority)
+    {
+        return NO;
+    }
+    
+    _flags.scheduledDrainCount += 1;
+    _flags.scheduledDrainPriority = _flags.pendingDrainPriority;
+    *drainPriority = _flags.pendingDrainPriority;
+    _flags.pendingDrainPriority = PZPromisePriorityLow;
+    return YES;
+}
+
+// Must be called while holding the lock.
+- (void)_finishScheduledDrain
+{
+    _flags.scheduledDrainCount -= 1;
+    if (_flags.scheduledDrainCount == 0)
+    {
+        _flags.scheduledDrainPriority = PZPromisePriorityLow;
+    }
+}
+
+- (void)_scheduleDrainWithPriority:(PZPromisePriority)priority
+{
+    // The drain always runs later, never within the call which scheduled it, so blocks are never executed before -thenOnKept:onBroken: returns.
+    [[[self class] defaultExecutor] executeBlock:^{
+        [self _drainContinuations];
+    } priority:priority];
+}
+
+- (void)_drainContinuations
+{
+    OSSpinLockLock(&_spinLock);
+    
+    // Another drain is already executing the continuations in order, so this one has nothing to do.
+    if (_stateWord & _PZStateWordDrainRunningFlag)
+    {
+        [self _finishScheduledDrain];
+        OSSpinLockUnlock(&_spinLock);
+        return;
+    }
+    _stateWord |= _PZStateWordDrainRunningFlag;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    while (YES)
+    {
+        OSSpinLockLock(&_spinLock);
+        
+        _PZContinuationRecord *continuation = _PZStateWordGetFirstContinuation(_stateWord);
+        if (!continuation)
+        {
+            _stateWord &= ~_PZStateWordDrainRunningFlag;
+            [self _finishScheduledDrain];
+            OSSpinLockUnlock(&_spinLock);
+            return;
+        }
+        _stateWord = _PZStateWordSetFirstContinuation(_stateWord, continuation->next);
+        if (!continuation->next)
+        {
+            _lastContinuation = NULL;
+        }
+        
+        OSSpinLockUnlock(&_spinLock);
+        
+        @autoreleasepool
+        {
+            [self _executeContinuation:continuation];
+        }
+    }
+}
+
+- (void)_addConsumerWithPriority:(PZPromisePriority)priority
+{
+    OSSpinLockLock(&_spinLock);
+    _consumerCount += 1;
+    OSSpinLockUnlock(&_spinLock);
+    
+    [self _moveWaiterFromPriority:_PZNoPriority toPriority:priority];
+}
+
+- (void)_removeConsumerWithPriority:(PZPromisePriority)priority
+{
+    [self _moveWaiterFromPriority:priority toPriority:_PZNoPriority];
+    
+    NSArray *handlers = nil;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    NSAssert(_consumerCount > 0, @"Promise (%@) lost more consumers than it gained.", self);
+    _consumerCount -= 1;
+    
+    if (_consumerCount == 0 && _PZStateWordGetState(_stateWord) == PZPromiseStatePending && !_flags.abandoned)
+    {
+        _flags.abandoned = YES;
+        handlers = _sideTable.abandonmentHandlers;
+        _sideTable.abandonmentHandlers = nil;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // Consumers are usually removed while a bound promise is deallocating, so the handlers are executed later rather than inside of the dealloc.
+    for (dispatch_block_t handler in handlers)
+    {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), handler);
+    }
+}
+
+// Moves a waiter's registration between priorities. When this changes the receiver's effective priority, the receiver's own registrations upstream are moved too, and so on up the chain. Those moves are queued and applied in a loop rather than recursively, so a long chain can't overflow the stack.
+- (void)_moveWaiterFromPriority:(PZPromisePriority)fromPriority toPriority:(PZPromisePriority)toPriority
+{
+    if (fromPriority == toPriority)
+    {
+        return;
+    }
+    
+    NSMutableArray *pendingMoves;
+    NSArray *upstreamMoves = [self _applyWaiterMoveFromPriority:fromPriority toPriority:toPriority];
+    
+    while (upstreamMoves || pendingMoves.count > 0)
+    {
+        // Most changes stop at the receiver, so the queue is only created once they don't.
+        if (upstreamMoves)
+        {
+            pendingMoves = pendingMoves ?: [NSMutableArray new];
+            [pendingMoves addObjectsFromArray:upstreamMoves];
+        }
         
-        // The resolution queue must stay suspended until the promise is resolved or broken.
-        [_resolutionQueue setSuspended:YES];
+        _PZWaiterMove *move = pendingMoves.lastObject;
+        [pendingMoves removeLastObject];
+        upstreamMoves = [move.promise _applyWaiterMoveFromPriority:move.fromPriority toPriority:move.toPriority];
     }
-    
-    return self;
 }
 
-- (instancetype)initWithKeptValue:(id)keptValue
+// Applies a single move, returning the moves it causes upstream, if any.
+- (NSArray *)_applyWaiterMoveFromPriority:(PZPromisePriority)fromPriority toPriority:(PZPromisePriority)toPriority
 {
-    if ((self = [self init]))
+    if (fromPriority == toPriority)
     {
-        _state = PZPromiseStateKept;
-        _keptValue = keptValue;
-        _resolutionQueue.suspended = NO;
+        return nil;
     }
     
-    return self;
-}
-
-- (instancetype)initWithBrokenReason:(NSError *)brokenReason
-{
-    if ((self = [self init]))
+    OSSpinLockLock(&_spinLock);
+    
+    if (fromPriority != _PZNoPriority)
     {
-        _state = PZPromiseStateBroken;
-        _brokenReason = brokenReason;
-        _resolutionQueue.suspended = NO;
+        _waiterCounts[fromPriority] -= 1;
+    }
+    if (toPriority != _PZNoPriority)
+    {
+        _waiterCounts[toPriority] += 1;
     }
     
-    return self;
+    // A resolved receiver has no producer left to speed up, but the drain executing its waiters' continuations may be scheduled too low.
+    PZPromisePriority drainPriority;
+    BOOL shouldDrain = NO;
+    if (_PZStateWordGetState(_stateWord) != PZPromiseStatePending && toPriority != _PZNoPriority)
+    {
+        if (toPriority > _flags.pendingDrainPriority)
+        {
+            _flags.pendingDrainPriority = toPriority;
+        }
+        shouldDrain = [self _claimDrainWithPriority:&drainPriority];
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldDrain)
+    {
+        [self _scheduleDrainWithPriority:drainPriority];
+    }
+    
+    return [self _updateEffectivePriority];
 }
 
-- (instancetype)initWithBindingPromise:(PZPromise *)bindingPromise;
+// Returns the moves which pass a change of the effective priority upstream, if it changed.
+- (NSArray *)_updateEffectivePriority
 {
-    if (!(self = [self init]))
+    OSSpinLockLock(&_spinLock);
+    
+    PZPromisePriority effectivePriority = _flags.priority;
+    if (_PZStateWordGetState(_stateWord) == PZPromiseStatePending)
     {
+        for (NSInteger level = PZPromisePriorityHigh; level > _flags.priority; level--)
+        {
+            if (_waiterCounts[level] > 0)
+            {
+                effectivePriority = (PZPromisePriority)level;
+                break;
+            }
+        }
+    }
+    
+    PZPromisePriority previousPriority = _flags.effectivePriority;
+    if (effectivePriority == previousPriority)
+    {
+        OSSpinLockUnlock(&_spinLock);
         return nil;
     }
     
-    _bindingPromise = bindingPromise;
+    _flags.effectivePriority = effectivePriority;
+    PZPromise *bindingPromise = _bindingPromise;
+    PZPromise *adoptedPromise = [_adoptedThenable isKindOfClass:[PZPromise class]] ? (PZPromise *)_adoptedThenable : nil;
+    NSArray *handlers = [_sideTable.effectivePriorityHandlers copy];
     
-    return self;
+    OSSpinLockUnlock(&_spinLock);
+    
+    for (void (^handler)(PZPromisePriority) in handlers)
+    {
+        handler(effectivePriority);
+    }
+    
+    // The change is passed upstream, so whatever produces the value the receiver is waiting for is sped up or slowed down with it.
+    NSMutableArray *upstreamMoves = [NSMutableArray new];
+    _PZAddWaiterMove(upstreamMoves, bindingPromise, previousPriority, effectivePriority);
+    _PZAddWaiterMove(upstreamMoves, adoptedPromise, previousPriority, effectivePriority);
+    
+    return (upstreamMoves.count > 0) ? upstreamMoves : nil;
 }
 
-- (void)dealloc
+- (id<PZThenable>)adoptedThenable
 {
-    [_resolutionQueue cancelAllOperations];
+    OSSpinLockLock(&_spinLock);
+    id<PZThenable> adoptedThenable = _adoptedThenable;
+    OSSpinLockUnlock(&_spinLock);
     
-    // As per the NSOperationQueue documentation, a suspended queue never clears out its operations even when cancelled, so we un-suspend the queue just in case here.
-    _resolutionQueue.suspended = NO;
+    return adoptedThenable;
 }
 
-
-#pragma mark Keeping and breaking promises
-
-- (BOOL)keepWithValue:(id)value
+- (void)setAdoptedThenable:(id<PZThenable>)adoptedThenable
 {
-    return [self _transitionToState:PZPromiseStateKept valueOrReason:value isResolved:NO];
+    OSSpinLockLock(&_spinLock);
+    id<PZThenable> previousThenable = _adoptedThenable;
+    _adoptedThenable = adoptedThenable;
+    PZPromisePriority effectivePriority = _flags.effectivePriority;
+    OSSpinLockUnlock(&_spinLock);
+    
+    if ([previousThenable isKindOfClass:[PZPromise class]])
+    {
+        [(PZPromise *)previousThenable _moveWaiterFromPriority:effectivePriority toPriority:_PZNoPriority];
+    }
+    if ([adoptedThenable isKindOfClass:[PZPromise class]])
+    {
+        [(PZPromise *)adoptedThenable _moveWaiterFromPriority:_PZNoPriority toPriority:effectivePriority];
+    }
 }
 
-- (BOOL)breakWithReason:(NSError *)reason
++ (NSOperationQueuePriority)_queuePriorityForPriority:(PZPromisePriority)priority
 {
-    return [self _transitionToState:PZPromiseStateBroken valueOrReason:reason isResolved:NO];
+    switch (priority)
+    {
+        case PZPromisePriorityLow:
+            return NSOperationQueuePriorityLow;
+        case PZPromisePriorityHigh:
+            return NSOperationQueuePriorityHigh;
+        default:
+            return NSOperationQueuePriorityNormal;
+    }
 }
 
-
-#pragma mark NSObject
-
-- (NSString *)description
++ (NSQualityOfService)_qualityOfServiceForPriority:(PZPromisePriority)priority
 {
-    return [self descriptionWithLocale:[NSLocale currentLocale] indent:0];
+    switch (priority)
+    {
+        case PZPromisePriorityLow:
+            return NSQualityOfServiceUtility;
+        case PZPromisePriorityHigh:
+            return NSQualityOfServiceUserInitiated;
+        default:
+            return NSQualityOfServiceDefault;
+    }
 }
 
-- (NSString *)descriptionWithLocale:(id)locale indent:(NSUInteger)level
+// Adds a block executed synchronously once the receiver is resolved. Returns NO without adding the block if the receiver is already resolved.
+- (BOOL)_addSettlementHandler:(dispatch_block_t)handler
 {
-    NSString *padding = [@"" stringByPaddingToLength:level withString:@"\t" startingAtIndex:0];
-    NSMutableString *mutableDescription = [NSMutableString stringWithFormat:@"%@<%@:%p>", padding, [self class], self];
+    OSSpinLockLock(&_spinLock);
     
-    switch (self.state)
+    BOOL added = NO;
+    if (_PZStateWordGetState(_stateWord) == PZPromiseStatePending)
     {
-        case PZPromiseStatePending:
-        {
-            [mutableDescription appendString:@" state:PZPromiseStatePending"];
-            
-            if (self.bindingPromise)
-            {
-                [mutableDescription appendFormat:@"\n%@", [self.bindingPromise descriptionWithLocale:locale indent:level+1]];
-            }
-            break;
-        }
-        case PZPromiseStateKept:
-        {
-            [mutableDescription appendFormat:@" state:PZPromiseStateKept, keptValue:%@", self.keptValue];
-            break;
-        }
-        case PZPromiseStateBroken:
+        _PZPromiseSideTable *sideTable = [self _loadSideTable];
+        if (!sideTable.settlementHandlers)
         {
-            [mutableDescription appendFormat:@" state:PZPromiseStateBroken, brokenReason:%@", self.brokenReason];
-            break;
+            sideTable.settlementHandlers = [NSMutableArray new];
         }
-        default:
-            break;
+        [sideTable.settlementHandlers addObject:handler];
+        added = YES;
     }
     
-    return [mutableDescription copy];
+    OSSpinLockUnlock(&_spinLock);
+    
+    return added;
 }
 
-
-#pragma mark PZThenable
-
-- (instancetype)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken
+- (void)_removeSettlementHandler:(dispatch_block_t)handler
 {
-    PZPromise *returnPromise;
-    
     OSSpinLockLock(&_spinLock);
+    [_sideTable.settlementHandlers removeObjectIdenticalTo:handler];
+    OSSpinLockUnlock(&_spinLock);
+}
+
++ (BOOL)_helpExecutor:(id<PZExecutor>)executor
+{
+    NSInteger depth = _PZWaitHelpDepth();
+    _PZSetWaitHelpDepth(depth + 1);
     
-    if (self.state == PZPromiseStateKept && !onKept)
-    {
-        returnPromise = [[[self class] alloc] initWithKeptValue:self.keptValue];
-    }
-    else if (self.state == PZPromiseStateBroken && !onBroken)
+    BOOL executed;
+    @autoreleasepool
     {
-        returnPromise = [[[self class] alloc] initWithBrokenReason:self.brokenReason];
-    }
-    else
-    {
-        returnPromise = [[[self class] alloc] initWithBindingPromise:self];
-        
-        _PZResolutionOperation *operation = [[_PZResolutionOperation alloc] initWithPromise:returnPromise onKept:onKept onBroken:onBroken];
-        [self.resolutionQueue addOperation:operation];
+        executed = [executor executePendingBlock];
     }
     
-    OSSpinLockUnlock(&_spinLock);
+    _PZSetWaitHelpDepth(depth);
     
-    return returnPromise;
+    return executed;
 }
 
-
-#pragma mark Private
-
-- (BOOL)_transitionToState:(PZPromiseState)state valueOrReason:(id)valueOrReason isResolved:(BOOL)isResolved
+// Parking the main thread would stall everything scheduled on it, which may include the work the promises are waiting for, so the run loop keeps running until a resolved promise signals a source on it.
++ (BOOL)_waitForPromisesOnMainThread:(NSArray *)promises deadline:(NSTimeInterval)deadline
 {
-    NSAssert(state != PZPromiseStatePending, @"Cannot transition promise (%@) to pending state.", self);
+    CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+    CFRunLoopSourceContext context = {0};
+    context.perform = _PZPerformWakeSource;
     
-    OSSpinLockLock(&_spinLock);
+    // The handlers retain the source, since one may still be executing after the wait returns.
+    id source = CFBridgingRelease(CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context));
+    CFRunLoopAddSource(runLoop, (__bridge CFRunLoopSourceRef)source, kCFRunLoopDefaultMode);
     
-    // If a promise isn't pending it cannot be changed. Also, if a promise is being resolved (i.e. it was created via the -initWithBindingPromise: method) then it cannot be resolved manually unless isResolved is YES.
-    if (self.state != PZPromiseStatePending || (self.bindingPromise != nil && !isResolved))
-    {
-        OSSpinLockUnlock(&_spinLock);
-        return NO;
-    }
-    OSSpinLockUnlock(&_spinLock);
+    dispatch_block_t handler = ^{
+        CFRunLoopSourceSignal((__bridge CFRunLoopSourceRef)source);
+        CFRunLoopWakeUp(runLoop);
+    };
     
-    NSString *changedValueKeyPath;
-    if (state == PZPromiseStateKept)
-    {
-        changedValueKeyPath = NSStringFromSelector(@selector(keptValue));
-    }
-    else
+    NSMutableArray *pendingPromises = [NSMutableArray new];
+    for (PZPromise *promise in promises)
     {
-        changedValueKeyPath = NSStringFromSelector(@selector(brokenReason));
+        if ([promise _addSettlementHandler:handler])
+        {
+            [pendingPromises addObject:promise];
+        }
     }
     
-    // The KVC notifications must be sent outside of our spin lock or else observers could accidentally cause a deadlock by invoking -thenOnKept:onBroken: or this method again.
-    [self willChangeValueForKey:NSStringFromSelector(@selector(state))];
-    [self willChangeValueForKey:changedValueKeyPath];
-    
-    OSSpinLockLock(&_spinLock);
-    
-    _state = state;
-    _bindingPromise = nil;
-    
-    if (state == PZPromiseStateKept)
+    BOOL resolved = YES;
+    for (PZPromise *promise in pendingPromises)
     {
-        _keptValue = valueOrReason;
+        while (promise.state == PZPromiseStatePending)
+        {
+            NSTimeInterval remaining = deadline - [NSProcessInfo processInfo].systemUptime;
+            if (remaining <= 0.0)
+            {
+                resolved = NO;
+                break;
+            }
+            
+            CFRunLoopRunInMode(kCFRunLoopDefaultMode, remaining, true);
+        }
+        
+        if (!resolved)
+        {
+            break;
+        }
     }
-    else
+    
+    for (PZPromise *promise in pendingPromises)
     {
-        _brokenReason = valueOrReason;
+        [promise _removeSettlementHandler:handler];
     }
+    CFRunLoopRemoveSource(runLoop, (__bridge CFRunLoopSourceRef)source, kCFRunLoopDefaultMode);
     
-    OSSpinLockUnlock(&_spinLock);
-    
-    [self didChangeValueForKey:changedValueKeyPath];
-    [self didChangeValueForKey:NSStringFromSelector(@selector(state))];
-    
-    // We resume our resolution queue which will allow the _PZResolutionOperations to commence. This must be done asynchronously to ensure that resolution happens in at least the next runloop
-    dispatch_async(dispatch_get_main_queue(), ^{
-        self.resolutionQueue.suspended = NO;
-    });
-    
-    return YES;
+    return resolved;
 }
 
-@end
-
-
-#pragma mark - _PZResolutionOperation
-
-@implementation _PZResolutionOperation
+- (NSError *)_cancelledError
+{
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Promise cancelled error.",
+                               NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The promise bound to (<%@:%p>) was cancelled by its cancellation token.", [self class], self]};
+    return [NSError errorWithDomain:PZErrorDomain code:PZCancelledError userInfo:userInfo];
+}
 
-- (instancetype)initWithPromise:(PZPromise *)promise onKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken
+- (void)_setCancellationToken:(PZCancellationToken *)cancellationToken registration:(id)registration
 {
-    NSParameterAssert(promise);
+    OSSpinLockLock(&_spinLock);
     
-    if (!(self = [super init]))
+    // A promise which already resolved (for example because the token was cancelled during registration) has no use for the handler.
+    BOOL isPending = (_PZStateWordGetState(_stateWord) == PZPromiseStatePending);
+    if (isPending)
     {
-        return nil;
+        _PZPromiseSideTable *sideTable = [self _loadSideTable];
+        sideTable.cancellationToken = cancellationToken;
+        sideTable.cancellationRegistration = registration;
     }
     
-    _promise = promise;
-    _onKept = [onKept copy];
-    _onBroken = [onBroken copy];
-    _resolutionCount = 0;
+    OSSpinLockUnlock(&_spinLock);
     
-    return self;
+    if (!isPending)
+    {
+        [cancellationToken removeCancellationHandler:registration];
+    }
 }
 
-- (void)main
+// Executes a continuation taken off the receiver's queue, which means the receiver is resolved and is the binding promise of the continuation's promise.
+- (void)_executeContinuation:(_PZContinuationRecord *)continuation
 {
-    PZPromise *promise = self.promise;
-    if (self.isCancelled || !promise)
+    PZOnKeptBlock onKept;
+    PZOnBrokenBlock onBroken;
+    PZPromiseArena *arena;
+    PZPromise *promise = _PZTakeContinuationRecord(continuation, &onKept, &onBroken, &arena);
+    
+    // A promise nobody holds has nothing to resolve, and one resolved before its blocks run was cancelled.
+    if (!promise || promise.state != PZPromiseStatePending)
     {
-        // We nil out the blocks so any potential retain cycles are broken.
-        _onKept = nil;
-        _onBroken = nil;
         return;
     }
     
-    PZPromise *bindingPromise = promise.bindingPromise;
-    PZPromiseState bindingPromiseState = bindingPromise.state;
+    PZPromiseState state = self.state;
     
-    if (bindingPromiseState == PZPromiseStatePending)
+    if (state == PZPromiseStatePending)
     {
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Internal promise inconsistency error.",
                                    NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The promise (<%@:%p>) started resolving before being kept or broken.", [promise class], promise]};
@@ -301,30 +1637,39 @@ NSString *const PZErrorDomain = @"com.zachradke.promiseZ.errorDomain";
         
         // As per the spec, if a promise attempts to resolve before it can, it breaks both the returned promise and the binding promise.
         [promise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
-        [bindingPromise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
-        
-        _onKept = nil;
-        _onBroken = nil;
+        [self _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
     }
-    else if ((bindingPromiseState == PZPromiseStateKept && self.onKept) || (bindingPromiseState == PZPromiseStateBroken && self.onBroken))
+    else if ((state == PZPromiseStateKept && onKept) || (state == PZPromiseStateBroken && onBroken))
     {
         @try
         {
-            id blockResult;
-            if (bindingPromiseState == PZPromiseStateKept)
+            __block id blockResult;
+            dispatch_block_t executeBlock = ^{
+                if (state == PZPromiseStateKept)
+                {
+                    blockResult = onKept(self.keptValue);
+                }
+                else
+                {
+                    blockResult = onBroken(self.brokenReason);
+                }
+            };
+            
+            // Blocks of a chain started in an arena run with it current again, so the chain keeps using it as it grows. Once the arena is closed, the chain goes back to the current arena of the executing thread, if any.
+            if (arena && !arena.isClosed)
             {
-                blockResult = self.onKept(bindingPromise.keptValue);
+                [arena performBlock:executeBlock];
             }
             else
             {
-                blockResult = self.onBroken(bindingPromise.brokenReason);
+                executeBlock();
             }
             
             // Once we've executed the blocks, we no longer need them
-            _onKept = nil;
-            _onBroken = nil;
+            onKept = nil;
+            onBroken = nil;
             
-            [self _resolvePromiseWithBlockResult:blockResult];
+            [promise _resolveWithBlockResult:blockResult resolutionCount:0];
         }
         @catch (NSException *exception)
         {
@@ -337,82 +1682,170 @@ NSString *const PZErrorDomain = @"com.zachradke.promiseZ.errorDomain";
     else
     {
         // If there was no on-kept or on-broken block associated with the promise resolution, we simply have the promise adopt the state of the binding promise.
-        if (bindingPromiseState == PZPromiseStateKept)
+        if (state == PZPromiseStateKept)
         {
-            [promise _transitionToState:PZPromiseStateKept valueOrReason:bindingPromise.keptValue isResolved:YES];
+            [promise _transitionToState:PZPromiseStateKept valueOrReason:self.keptValue isResolved:YES];
         }
         else
         {
-            [promise _transitionToState:PZPromiseStateBroken valueOrReason:bindingPromise.brokenReason isResolved:YES];
+            [promise _transitionToState:PZPromiseStateBroken valueOrReason:self.brokenReason isResolved:YES];
         }
-        
-        _onKept = nil;
-        _onBroken = nil;
     }
 }
 
-- (void)_resolvePromiseWithBlockResult:(id)blockResult
+// Resolves the receiver with the result of one of its blocks, or with the value of a thenable the blocks returned. Each adopted thenable which is kept with another thenable counts toward the recursion limit.
+- (void)_resolveWithBlockResult:(id)blockResult resolutionCount:(NSUInteger)resolutionCount
 {
-    PZPromise *promise = self.promise;
-    if (self.isCancelled || !promise)
-    {
-        return;
-    }
-    
-    if (self.resolutionCount > PZMaximumResolutionRecursionDepth)
+    if (resolutionCount > PZMaximumResolutionRecursionDepth)
     {
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Infinite promise resolution recursion error.",
-                                   NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"Resolving the promise (<%@:%p>) has exceeded the maximum allowed recursion depth.", [promise class], promise]};
+                                   NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"Resolving the promise (<%@:%p>) has exceeded the maximum allowed recursion depth.", [self class], self]};
         NSError *error = [NSError errorWithDomain:PZErrorDomain code:PZRecursionError userInfo:userInfo];
-        [promise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
+        [self _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
     }
-    else if (blockResult == promise)
+    else if (blockResult == self)
     {
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Infinite promise resolution recursion error.",
-                                   NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The promise (<%@:%p>) cannot be resolved with itself.", [promise class], promise]};
+                                   NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The promise (<%@:%p>) cannot be resolved with itself.", [self class], self]};
         NSError *error = [NSError errorWithDomain:PZErrorDomain code:PZRecursionError userInfo:userInfo];
-        [promise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
+        [self _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
     }
     else if ([blockResult conformsToProtocol:@protocol(PZThenable)])
     {
         // We only allow a single execution of our on-kept or on-broken blocks.
         __block BOOL handlerExecuted = NO;
         
-        // We keep this operation around until the promise has finally resolved
-        __block _PZResolutionOperation *retainedOperation = self;
+        // The receiver is captured weakly so that if all of its consumers go away, it can be released along with the thenable it adopts.
+        __weak PZPromise *weakSelf = self;
         
-        // The returned thenable is retained until the promise has resolved.
-        self.retainedThenable = [blockResult thenOnKept:^id(id value) {
-            retainedOperation.retainedThenable = nil;
+        // The returned thenable is retained by the receiver until the receiver has resolved.
+        self.adoptedThenable = [blockResult thenOnKept:^id(id value) {
+            PZPromise *strongSelf = weakSelf;
+            strongSelf.adoptedThenable = nil;
             
             if (!handlerExecuted)
             {
-                retainedOperation.resolutionCount += 1;
-                [retainedOperation _resolvePromiseWithBlockResult:value];
                 handlerExecuted = YES;
+                [strongSelf _resolveWithBlockResult:value resolutionCount:resolutionCount + 1];
             }
             
-            retainedOperation = nil;
             return nil;
-            
         } onBroken:^id(NSError *error) {
-            retainedOperation.retainedThenable = nil;
+            PZPromise *strongSelf = weakSelf;
+            strongSelf.adoptedThenable = nil;
             
             if (!handlerExecuted)
             {
-                [promise _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
                 handlerExecuted = YES;
+                [strongSelf _transitionToState:PZPromiseStateBroken valueOrReason:error isResolved:YES];
             }
             
-            retainedOperation = nil;
             return nil;
         }];
     }
     else
     {
         // If the value is not a PZThenable or invalid it is used to keep the promise.
-        [promise _transitionToState:PZPromiseStateKept valueOrReason:blockResult isResolved:YES];
+        [self _transitionToState:PZPromiseStateKept valueOrReason:blockResult isResolved:YES];
+    }
+}
+
+- (BOOL)_transitionToState:(PZPromiseState)state valueOrReason:(id)valueOrReason isResolved:(BOOL)isResolved
+{
+    NSAssert(state != PZPromiseStatePending, @"Cannot transition promise (%@) to pending state.", self);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // If a promise isn't pending it cannot be changed. Also, if a promise is being resolved (i.e. it was created via the -initWithBindingPromise:priority: method) or belongs to a PZDeferred, then it cannot be resolved manually unless isResolved is YES.
+    if (_PZStateWordGetState(_stateWord) != PZPromiseStatePending || ((_bindingPromise != nil || (_stateWord & _PZStateWordSealedFlag)) && !isResolved))
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return NO;
+    }
+    OSSpinLockUnlock(&_spinLock);
+    
+    NSString *changedValueKeyPath;
+    if (state == PZPromiseStateKept)
+    {
+        changedValueKeyPath = NSStringFromSelector(@selector(keptValue));
+    }
+    else
+    {
+        changedValueKeyPath = NSStringFromSelector(@selector(brokenReason));
+    }
+    
+    // The KVC notifications must be sent outside of our spin lock or else observers could accidentally cause a deadlock by invoking -thenOnKept:onBroken: or this method again.
+    [self willChangeValueForKey:NSStringFromSelector(@selector(state))];
+    [self willChangeValueForKey:changedValueKeyPath];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // Another thread may have resolved the receiver while the lock was released, such as a cancellation handler racing the continuation, so the check is repeated before anything is written.
+    if (_PZStateWordGetState(_stateWord) != PZPromiseStatePending || ((_bindingPromise != nil || (_stateWord & _PZStateWordSealedFlag)) && !isResolved))
+    {
+        OSSpinLockUnlock(&_spinLock);
+        
+        [self didChangeValueForKey:changedValueKeyPath];
+        [self didChangeValueForKey:NSStringFromSelector(@selector(state))];
+        
+        return NO;
+    }
+    
+    _stateWord = _PZStateWordSetState(_stateWord, state);
+    _valueOrReason = valueOrReason;
+    
+    // A resolved promise no longer consumes its binding promise, which matters when it was broken early by a cancellation token. It also stops waiting on its binding promise and adopted thenable, and drops any boost its producer was given.
+    PZPromise *formerBindingPromise = _bindingPromise;
+    _bindingPromise = nil;
+    
+    id<PZThenable> formerAdoptedThenable = _adoptedThenable;
+    _adoptedThenable = nil;
+    
+    PZPromisePriority priority = _flags.priority;
+    PZPromisePriority formerEffectivePriority = _flags.effectivePriority;
+    _flags.effectivePriority = priority;
+    
+    // Nothing in the side table matters once resolved.
+    _PZPromiseSideTable *sideTable = _sideTable;
+    _sideTable = nil;
+    NSArray *effectivePriorityHandlers = (formerEffectivePriority != priority) ? sideTable.effectivePriorityHandlers : nil;
+    NSArray *settlementHandlers = sideTable.settlementHandlers;
+    PZCancellationToken *cancellationToken = sideTable.cancellationToken;
+    id cancellationRegistration = sideTable.cancellationRegistration;
+    
+    PZPromisePriority drainPriority;
+    BOOL shouldDrain = [self _claimDrainWithPriority:&drainPriority];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    [self didChangeValueForKey:changedValueKeyPath];
+    [self didChangeValueForKey:NSStringFromSelector(@selector(state))];
+    
+    // Blocked threads are woken before anything else, since they may be holding up the rest of their chain.
+    for (dispatch_block_t handler in settlementHandlers)
+    {
+        handler();
+    }
+    
+    // Once resolved, cancelling the token can no longer affect the receiver.
+    [cancellationToken removeCancellationHandler:cancellationRegistration];
+    [formerBindingPromise _removeConsumerWithPriority:formerEffectivePriority];
+    if ([formerAdoptedThenable isKindOfClass:[PZPromise class]])
+    {
+        [(PZPromise *)formerAdoptedThenable _moveWaiterFromPriority:formerEffectivePriority toPriority:_PZNoPriority];
     }
+    
+    for (void (^handler)(PZPromisePriority) in effectivePriorityHandlers)
+    {
+        handler(priority);
+    }
+    
+    if (shouldDrain)
+    {
+        [self _scheduleDrainWithPriority:drainPriority];
+    }
+    
+    return YES;
 }
 
 @end
@@ -0,0 +1,111 @@
+//
+//  PZPromiseArena.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/25/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  A scope whose promise bookkeeping is carved out of a few large slabs by bumping a pointer, and released all together once the scope is over. This suits code which builds many short chains which all end together, such as the chains serving a single request.
+ *
+ *  @code
+ *  PZPromiseArena *arena = [PZPromiseArena new];
+ *  [arena performBlock:^{
+ *      PZPromise *response = [[self fetchRequest:request] thenOnKept:^id(NSData *data) {
+ *          return [self parseResponse:data];
+ *      } onBroken:nil];
+ *      ...
+ *  }];
+ *  ...
+ *  [arena close];
+ *  @endcode
+ *
+ *  Continuation records added while the arena is current come from its slabs, and blocks executed for those records run with the arena current again, so chains extended from within them keep using it. Individual allocations are never reused, so allocating costs no more than taking a lock and moving a pointer. Whenever the last live allocation is relinquished, though, the arena starts over at the beginning of its newest slab and frees the others, so an arena which is never closed only holds as much memory as its chains use at once.
+ *
+ *  Every allocation retains the arena, so chains which outlive the scope keep its slabs alive until they finish, and the slabs are freed once both the arena and its last allocation are released. Closing the arena stops new allocations and records how many were still live in escapedAllocationCount, which should be 0 for code which waits for its chains to finish.
+ *
+ *  @note The promises themselves are allocated by the Objective-C runtime as usual, since objects can't be placed in memory which they don't free themselves.
+ *
+ *  This class is thread safe.
+ */
+@interface PZPromiseArena : NSObject
+
+/**
+ *  Initializes an arena with 16 kilobyte slabs.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param slabSize The number of bytes allocated at once whenever the current slab is full.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithSlabSize:(NSUInteger)slabSize NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  The arena current on the calling thread, if any.
+ *
+ *  @return The arena of the innermost -performBlock: executing on the calling thread, or nil.
+ */
++ (instancetype)currentArena;
+
+/**
+ *  Executes a block with the receiver as the current arena. Calls may be nested, and the previous arena is restored when the block returns or raises.
+ *
+ *  @param block The block to execute. This must not be nil.
+ */
+- (void)performBlock:(dispatch_block_t)block;
+
+/**
+ *  Ends the receiver's scope. Later allocations return NULL, so promise bookkeeping falls back to the regular allocator. Subsequent calls have no effect.
+ */
+- (void)close;
+
+/**
+ *  Whether the receiver has been closed.
+ */
+@property (assign, nonatomic, readonly, getter=isClosed) BOOL closed;
+
+/**
+ *  The number of allocations which were still live when the receiver was closed, or 0 if it is open.
+ */
+@property (assign, nonatomic, readonly) NSUInteger escapedAllocationCount;
+
+/**
+ *  The number of allocations which have not been relinquished yet.
+ */
+@property (assign, nonatomic, readonly) NSUInteger liveAllocationCount;
+
+/**
+ *  The number of bytes held by the receiver's slabs.
+ */
+@property (assign, nonatomic, readonly) NSUInteger allocatedByteCount;
+
+/**
+ *  @name Allocating
+ */
+
+/**
+ *  Allocates memory from the current slab, starting a new slab if it is full. The allocation retains the receiver until it is relinquished.
+ *
+ *  @param size The number of bytes to allocate.
+ *
+ *  @return Memory aligned to 16 bytes, or NULL if the receiver is closed or the size exceeds the slab size.
+ */
+- (void *)allocateBytes:(size_t)size;
+
+/**
+ *  Marks an allocation as no longer used, releasing the receiver's hold on it. The memory itself is freed with the receiver's slabs, or reused once no allocation is live anymore.
+ *
+ *  @param bytes Memory returned by -allocateBytes:.
+ */
+- (void)relinquishBytes:(void *)bytes;
+
+@end
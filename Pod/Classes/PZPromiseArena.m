@@ -0,0 +1,265 @@
+//
+//  PZPromiseArena.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/25/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZPromiseArena.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+
+static const NSUInteger _PZDefaultArenaSlabSize = 16 * 1024;
+static const size_t _PZArenaAlignment = 16;
+
+// Holds the innermost arena of the -performBlock: calls executing on each thread. Arenas are not retained by it, since whoever calls -performBlock: holds the arena until it returns.
+static pthread_key_t _PZCurrentArenaKey;
+
+// Slabs are linked through a header at their start, which keeps the allocations after it aligned.
+typedef struct _PZArenaSlab
+{
+    struct _PZArenaSlab *next;
+} __attribute__((aligned(16))) _PZArenaSlab;
+
+static size_t _PZAlignSize(size_t size)
+{
+    return (size + _PZArenaAlignment - 1) & ~(_PZArenaAlignment - 1);
+}
+
+@interface PZPromiseArena ()
+{
+    OSSpinLock _spinLock;
+    _PZArenaSlab *_slabs;
+    char *_nextByte;
+    char *_endByte;
+    NSUInteger _liveAllocationCount;
+    NSUInteger _allocatedByteCount;
+    NSUInteger _escapedAllocationCount;
+    BOOL _closed;
+}
+
+@property (assign, nonatomic, readonly) NSUInteger slabSize;
+
+@end
+
+@implementation PZPromiseArena
+
++ (void)initialize
+{
+    if (self == [PZPromiseArena class])
+    {
+        pthread_key_create(&_PZCurrentArenaKey, NULL);
+    }
+}
+
++ (instancetype)currentArena
+{
+    return (__bridge PZPromiseArena *)pthread_getspecific(_PZCurrentArenaKey);
+}
+
+- (instancetype)init
+{
+    return [self initWithSlabSize:_PZDefaultArenaSlabSize];
+}
+
+- (instancetype)initWithSlabSize:(NSUInteger)slabSize
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _slabSize = _PZAlignSize(MAX(slabSize, _PZArenaAlignment));
+    _slabs = NULL;
+    _nextByte = NULL;
+    _endByte = NULL;
+    _liveAllocationCount = 0;
+    _allocatedByteCount = 0;
+    _escapedAllocationCount = 0;
+    _closed = NO;
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    // Every allocation retains the receiver, so nothing can be using the slabs anymore.
+    while (_slabs)
+    {
+        _PZArenaSlab *slab = _slabs;
+        _slabs = slab->next;
+        free(slab);
+    }
+}
+
+
+#pragma mark Scope
+
+- (void)performBlock:(dispatch_block_t)block
+{
+    NSParameterAssert(block);
+    
+    void *previousArena = pthread_getspecific(_PZCurrentArenaKey);
+    pthread_setspecific(_PZCurrentArenaKey, (__bridge void *)self);
+    
+    @try
+    {
+        block();
+    }
+    @finally
+    {
+        pthread_setspecific(_PZCurrentArenaKey, previousArena);
+    }
+}
+
+- (void)close
+{
+    OSSpinLockLock(&_spinLock);
+    if (!_closed)
+    {
+        _closed = YES;
+        _escapedAllocationCount = _liveAllocationCount;
+    }
+    OSSpinLockUnlock(&_spinLock);
+}
+
+- (BOOL)isClosed
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL closed = _closed;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return closed;
+}
+
+- (NSUInteger)escapedAllocationCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger escapedAllocationCount = _escapedAllocationCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return escapedAllocationCount;
+}
+
+- (NSUInteger)liveAllocationCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger liveAllocationCount = _liveAllocationCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return liveAllocationCount;
+}
+
+- (NSUInteger)allocatedByteCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger allocatedByteCount = _allocatedByteCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return allocatedByteCount;
+}
+
+
+#pragma mark Allocating
+
+- (void *)allocateBytes:(size_t)size
+{
+    size = _PZAlignSize(MAX(size, (size_t)1));
+    if (size > self.slabSize)
+    {
+        return NULL;
+    }
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (_closed)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return NULL;
+    }
+    
+    if ((size_t)(_endByte - _nextByte) < size)
+    {
+        // The rest of the full slab is abandoned. Slabs are small enough that this wastes less than reusing holes would cost.
+        _PZArenaSlab *slab = malloc(sizeof(_PZArenaSlab) + self.slabSize);
+        if (!slab)
+        {
+            OSSpinLockUnlock(&_spinLock);
+            return NULL;
+        }
+        
+        slab->next = _slabs;
+        _slabs = slab;
+        _nextByte = (char *)(slab + 1);
+        _endByte = _nextByte + self.slabSize;
+        _allocatedByteCount += sizeof(_PZArenaSlab) + self.slabSize;
+    }
+    
+    void *bytes = _nextByte;
+    _nextByte += size;
+    _liveAllocationCount += 1;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // Balanced in -relinquishBytes:, so the slabs outlive every allocation.
+    CFBridgingRetain(self);
+    
+    return bytes;
+}
+
+- (void)relinquishBytes:(void *)bytes
+{
+    if (!bytes)
+    {
+        return;
+    }
+    
+    _PZArenaSlab *surplusSlabs = NULL;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    BOOL hadLiveAllocation = (_liveAllocationCount > 0);
+    _liveAllocationCount -= hadLiveAllocation ? 1 : 0;
+    
+    // Once nothing is live, the newest slab is reused from its start and the others are freed. Otherwise a chain which keeps running in an arena nobody closes would grow it without bound.
+    if (_liveAllocationCount == 0 && _slabs)
+    {
+        surplusSlabs = _slabs->next;
+        _slabs->next = NULL;
+        _nextByte = (char *)(_slabs + 1);
+        _endByte = _nextByte + self.slabSize;
+        _allocatedByteCount = sizeof(_PZArenaSlab) + self.slabSize;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    NSAssert(hadLiveAllocation, @"Arena (%@) had more allocations relinquished than it made.", self);
+    
+    while (surplusSlabs)
+    {
+        _PZArenaSlab *slab = surplusSlabs;
+        surplusSlabs = slab->next;
+        free(slab);
+    }
+    
+    // This may release the last reference to the receiver, so it must come last.
+    CFRelease((__bridge CFTypeRef)self);
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger liveAllocationCount = _liveAllocationCount;
+    NSUInteger allocatedByteCount = _allocatedByteCount;
+    BOOL closed = _closed;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return [NSString stringWithFormat:@"<%@:%p> liveAllocationCount:%lu, allocatedByteCount:%lu, closed:%@", [self class], self, (unsigned long)liveAllocationCount, (unsigned long)allocatedByteCount, closed ? @"YES" : @"NO"];
+}
+
+@end
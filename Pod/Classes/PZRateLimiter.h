@@ -0,0 +1,53 @@
+//
+//  PZRateLimiter.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A token bucket rate limiter which hands out tokens through promises. The bucket holds up to burstSize tokens and refills at tokensPerSecond, so short bursts pass right away while sustained load is smoothed to the configured rate.
+ *
+ *  Callers waiting for a token are released in FIFO order as the bucket refills, without blocking any threads. Refills are scheduled on the shared PZTimerWheel, and only while callers are waiting.
+ *
+ *  This class is thread safe.
+ */
+@interface PZRateLimiter : NSObject
+
+/**
+ *  The designated initializer. The bucket starts full.
+ *
+ *  @param tokensPerSecond The rate at which the bucket refills. Must be greater than 0.
+ *  @param burstSize       The maximum number of tokens the bucket can hold. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithTokensPerSecond:(double)tokensPerSecond burstSize:(NSUInteger)burstSize NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) double tokensPerSecond;
+@property (assign, nonatomic, readonly) NSUInteger burstSize;
+
+/**
+ *  The number of callers waiting for a token.
+ */
+@property (assign, nonatomic, readonly) NSUInteger waiterCount;
+
+/**
+ *  Requests a token. Tokens are consumed, so unlike PZAsyncSemaphore permits they are never returned.
+ *
+ *  @return A promise which is kept with `nil` once the caller has been granted a token.
+ */
+- (PZPromise *)acquire;
+
+/**
+ *  Takes a token only if one is available without waiting.
+ *
+ *  @return YES if the caller was granted a token, otherwise NO.
+ */
+- (BOOL)tryAcquire;
+
+@end
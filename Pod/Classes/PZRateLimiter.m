@@ -0,0 +1,132 @@
+//
+//  PZRateLimiter.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/17/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZRateLimiter.h"
+#import "PZAsyncSemaphore.h"
+#import "PZTimerWheel.h"
+#import <libkern/OSAtomic.h>
+
+@interface PZRateLimiter ()
+{
+    OSSpinLock _spinLock;
+    
+    // Fractional tokens which have accumulated but not yet been added to the bucket.
+    double _partialTokens;
+    NSTimeInterval _lastRefill;
+    BOOL _isRefillScheduled;
+}
+
+// The bucket itself. Its permits are the available tokens, and its FIFO queue of waiters is reused for callers waiting on a refill.
+@property (strong, nonatomic, readonly) PZAsyncSemaphore *bucket;
+
+@end
+
+@implementation PZRateLimiter
+
+- (instancetype)init
+{
+    return [self initWithTokensPerSecond:1.0 burstSize:1];
+}
+
+- (instancetype)initWithTokensPerSecond:(double)tokensPerSecond burstSize:(NSUInteger)burstSize
+{
+    NSParameterAssert(tokensPerSecond > 0.0);
+    NSParameterAssert(burstSize > 0);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _tokensPerSecond = tokensPerSecond;
+    _burstSize = burstSize;
+    _partialTokens = 0.0;
+    _lastRefill = [NSProcessInfo processInfo].systemUptime;
+    _isRefillScheduled = NO;
+    _bucket = [[PZAsyncSemaphore alloc] initWithValue:burstSize];
+    
+    return self;
+}
+
+- (NSUInteger)waiterCount
+{
+    return self.bucket.waiterCount;
+}
+
+
+#pragma mark Acquiring tokens
+
+- (PZPromise *)acquire
+{
+    [self _refill];
+    PZPromise *promise = [self.bucket acquire];
+    [self _scheduleRefillIfNeeded];
+    
+    return promise;
+}
+
+- (BOOL)tryAcquire
+{
+    [self _refill];
+    return [self.bucket tryAcquire];
+}
+
+
+#pragma mark Private
+
+- (void)_refill
+{
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSUInteger tokenCount = 0;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    _partialTokens += (now - _lastRefill) * self.tokensPerSecond;
+    _lastRefill = now;
+    
+    // Waiters take tokens as soon as they are added, so only an idle bucket can fill up. Anything beyond the burst size is discarded.
+    NSUInteger room = self.burstSize - MIN(self.bucket.availablePermits, self.burstSize);
+    tokenCount = MIN((NSUInteger)floor(_partialTokens), room);
+    _partialTokens = (tokenCount < room) ? _partialTokens - tokenCount : 0.0;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    for (NSUInteger i = 0; i < tokenCount; i++)
+    {
+        [self.bucket signal];
+    }
+}
+
+- (void)_scheduleRefillIfNeeded
+{
+    OSSpinLockLock(&_spinLock);
+    
+    if (_isRefillScheduled || self.bucket.waiterCount == 0)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return;
+    }
+    
+    _isRefillScheduled = YES;
+    NSTimeInterval delay = MAX(1.0 - _partialTokens, 0.0) / self.tokensPerSecond;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // The timer retains the receiver, so waiters are still released if nothing else holds on to the limiter.
+    [[PZTimerWheel sharedTimerWheel] scheduleAfter:delay block:^{
+        OSSpinLockLock(&_spinLock);
+        _isRefillScheduled = NO;
+        OSSpinLockUnlock(&_spinLock);
+        
+        [self _refill];
+        [self _scheduleRefillIfNeeded];
+    }];
+}
+
+@end
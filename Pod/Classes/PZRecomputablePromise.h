@@ -0,0 +1,88 @@
+//
+//  PZRecomputablePromise.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/26/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A thenable for a value which is expensive to hold but can be rebuilt, such as a decoded image. It starts its task with a factory the first time blocks are chained to it, and holds on to the kept promise like any other. Under memory pressure it lets go of the kept promise, and the next time blocks are chained the factory is called again.
+ *
+ *  @code
+ *  PZRecomputablePromise *thumbnail = [[PZRecomputablePromise alloc] initWithFactory:^PZPromise *{
+ *      return [self decodeThumbnailAtURL:URL];
+ *  }];
+ *  ...
+ *  [thumbnail thenOnKept:^id(UIImage *image) {
+ *      imageView.image = image;
+ *      return nil;
+ *  } onBroken:nil];
+ *  @endcode
+ *
+ *  Only one task runs at a time. Callers chaining blocks while it is pending share its promise, and a pending promise is never discarded, so memory pressure can't start the same task twice. A broken promise is not held on to either, so the next caller retries the task.
+ *
+ *  Values are discarded when the system reports memory pressure through dispatch, and on iOS when the application receives a memory warning. Call +discardValuesForMemoryPressure to react to other signals as well.
+ *
+ *  @note Discarding only releases the receiver's reference. Promises chained to it before keep whatever they resolved with, so callers which hold on to results keep the memory alive.
+ *
+ *  This class is thread safe.
+ */
+@interface PZRecomputablePromise : NSObject <PZThenable>
+
+/**
+ *  The designated initializer.
+ *
+ *  @param factory The block which starts the task and returns a promise for its result. It is executed on the default executor, and returning nil is treated as a task kept with nil. This must not be nil.
+ *
+ *  @return An initialized instance of the receiver. The task doesn't start until blocks are chained to it.
+ */
+- (instancetype)initWithFactory:(PZPromiseFactoryBlock)factory NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Whether the receiver discards its value when the system reports memory pressure. Defaults to YES.
+ */
+@property (assign, atomic) BOOL discardsValueUnderMemoryPressure;
+
+/**
+ *  Whether the receiver is holding on to a kept promise.
+ */
+@property (assign, nonatomic, readonly) BOOL hasKeptValue;
+
+/**
+ *  The number of times the factory has been called.
+ */
+@property (assign, nonatomic, readonly) NSUInteger computationCount;
+
+/**
+ *  Returns the promise for the value, calling the factory if the receiver holds none.
+ *
+ *  @return The pending or kept promise for the value.
+ */
+- (PZPromise *)promise;
+
+/**
+ *  Chains blocks to the promise for the value, calling the factory if the receiver holds none.
+ *
+ *  @see [PZThenable thenOnKept:onBroken:]
+ *
+ *  @return A new promise resolved by the blocks.
+ */
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken;
+
+/**
+ *  Lets go of the kept promise, so the factory is called again the next time it is needed. Pending promises are not affected.
+ *
+ *  @return YES if a kept promise was discarded.
+ */
+- (BOOL)discardValue;
+
+/**
+ *  Discards the values of every recomputable promise whose discardsValueUnderMemoryPressure is YES. This is called automatically when the system reports memory pressure.
+ */
++ (void)discardValuesForMemoryPressure;
+
+@end
@@ -0,0 +1,184 @@
+//
+//  PZRecomputablePromise.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/26/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZRecomputablePromise.h"
+#import <libkern/OSAtomic.h>
+
+// Every recomputable promise, held weakly, so memory pressure can reach them without keeping them alive.
+static OSSpinLock _PZRecomputablePromisesSpinLock = OS_SPINLOCK_INIT;
+static NSHashTable *_PZRecomputablePromises;
+
+static dispatch_source_t _PZMemoryPressureSource;
+
+// Starts listening for memory pressure once the first recomputable promise is created, so apps which don't use them don't pay for it.
+static void _PZStartObservingMemoryPressure(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _PZRecomputablePromises = [NSHashTable weakObjectsHashTable];
+
+#ifdef DISPATCH_SOURCE_TYPE_MEMORYPRESSURE
+        // The source type is weakly linked, since it is missing before iOS 8 and OS X 10.9.
+        if (DISPATCH_SOURCE_TYPE_MEMORYPRESSURE != NULL)
+        {
+            _PZMemoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+            dispatch_source_set_event_handler(_PZMemoryPressureSource, ^{
+                [PZRecomputablePromise discardValuesForMemoryPressure];
+            });
+            dispatch_resume(_PZMemoryPressureSource);
+        }
+#endif
+
+#if TARGET_OS_IPHONE
+        // Referenced by name, so the library doesn't need to link UIKit.
+        [[NSNotificationCenter defaultCenter] addObserverForName:@"UIApplicationDidReceiveMemoryWarningNotification" object:nil queue:nil usingBlock:^(NSNotification *note) {
+            [PZRecomputablePromise discardValuesForMemoryPressure];
+        }];
+#endif
+    });
+}
+
+
+#pragma mark - PZRecomputablePromise
+
+@interface PZRecomputablePromise ()
+{
+    OSSpinLock _spinLock;
+    PZPromise *_promise;
+    NSUInteger _computationCount;
+}
+
+@property (copy, nonatomic, readonly) PZPromiseFactoryBlock factory;
+
+@end
+
+@implementation PZRecomputablePromise
+
+- (instancetype)initWithFactory:(PZPromiseFactoryBlock)factory
+{
+    NSParameterAssert(factory);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _factory = [factory copy];
+    _computationCount = 0;
+    _discardsValueUnderMemoryPressure = YES;
+    
+    _PZStartObservingMemoryPressure();
+    
+    OSSpinLockLock(&_PZRecomputablePromisesSpinLock);
+    [_PZRecomputablePromises addObject:self];
+    OSSpinLockUnlock(&_PZRecomputablePromisesSpinLock);
+    
+    return self;
+}
+
+
+#pragma mark Accessing the value
+
+- (PZPromise *)promise
+{
+    OSSpinLockLock(&_spinLock);
+    
+    // A broken promise is replaced as well, so the task is retried.
+    PZPromise *promise = _promise;
+    if (!promise || promise.state == PZPromiseStateBroken)
+    {
+        // Binding the task to a kept promise runs the factory on the default executor, outside of the lock, while callers arriving in the meantime share the bound promise. The kept promise is not the shared +keptNil, since factories chained to one promise would run one at a time.
+        PZPromiseFactoryBlock factory = self.factory;
+        promise = [[[PZPromise alloc] initWithKeptValue:nil] thenOnKept:^id(id value) {
+            return factory();
+        } onBroken:nil];
+        
+        _promise = promise;
+        _computationCount += 1;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return promise;
+}
+
+- (PZPromise *)thenOnKept:(PZOnKeptBlock)onKept onBroken:(PZOnBrokenBlock)onBroken
+{
+    return [[self promise] thenOnKept:onKept onBroken:onBroken];
+}
+
+- (BOOL)hasKeptValue
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL hasKeptValue = (_promise.state == PZPromiseStateKept);
+    OSSpinLockUnlock(&_spinLock);
+    
+    return hasKeptValue;
+}
+
+- (NSUInteger)computationCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger computationCount = _computationCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return computationCount;
+}
+
+
+#pragma mark Discarding the value
+
+- (BOOL)discardValue
+{
+    PZPromise *discardedPromise = nil;
+    
+    OSSpinLockLock(&_spinLock);
+    if (_promise.state == PZPromiseStateKept)
+    {
+        discardedPromise = _promise;
+        _promise = nil;
+    }
+    OSSpinLockUnlock(&_spinLock);
+    
+    // The value may be large, so it is released outside of the lock.
+    BOOL discarded = (discardedPromise != nil);
+    discardedPromise = nil;
+    
+    return discarded;
+}
+
++ (void)discardValuesForMemoryPressure
+{
+    OSSpinLockLock(&_PZRecomputablePromisesSpinLock);
+    NSArray *promises = [_PZRecomputablePromises allObjects];
+    OSSpinLockUnlock(&_PZRecomputablePromisesSpinLock);
+    
+    for (PZRecomputablePromise *promise in promises)
+    {
+        if (promise.discardsValueUnderMemoryPressure)
+        {
+            [promise discardValue];
+        }
+    }
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    OSSpinLockLock(&_spinLock);
+    PZPromise *promise = _promise;
+    NSUInteger computationCount = _computationCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return [NSString stringWithFormat:@"<%@:%p> computationCount:%lu, promise:%@", [self class], self, (unsigned long)computationCount, promise];
+}
+
+@end
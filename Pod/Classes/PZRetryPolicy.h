@@ -0,0 +1,139 @@
+//
+//  PZRetryPolicy.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/10/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  Block which decides whether a broken attempt should be retried.
+ *
+ *  @param reason  The reason the attempt was broken.
+ *  @param attempt The number of the attempt which was broken, starting at 1.
+ *
+ *  @return YES if the task should be attempted again, otherwise NO.
+ */
+typedef BOOL(^PZShouldRetryBlock)(NSError *reason, NSUInteger attempt);
+
+/**
+ *  A budget limiting how many retries can be made relative to the number of first attempts. Every first attempt deposits a fraction of a retry into the budget and every retry withdraws a whole one, so during an outage retries cannot multiply the load on a failing service. A small number of retries per second is always allowed so that rarely used tasks can still be retried.
+ *
+ *  This class is thread safe.
+ */
+@interface PZRetryBudget : NSObject
+
+/**
+ *  The budget used by PZRetryPolicy instances by default. It allows 20% extra retries on top of first attempts and at least 10 retries per second.
+ *
+ *  @return The shared budget.
+ */
++ (instancetype)sharedBudget;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param retryRatio               The fraction of a retry deposited for every first attempt. For example, 0.2 allows 1 retry for every 5 first attempts.
+ *  @param minimumRetriesPerSecond  The number of retries per second which are always allowed, regardless of the number of first attempts.
+ *  @param maximumBalance           The maximum number of retries which can be saved up in the budget.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithRetryRatio:(double)retryRatio minimumRetriesPerSecond:(double)minimumRetriesPerSecond maximumBalance:(double)maximumBalance NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) double retryRatio;
+@property (assign, nonatomic, readonly) double minimumRetriesPerSecond;
+@property (assign, nonatomic, readonly) double maximumBalance;
+
+/**
+ *  Records a first attempt, depositing the retryRatio into the budget.
+ */
+- (void)recordAttempt;
+
+/**
+ *  Withdraws a single retry from the budget if one is available.
+ *
+ *  @return YES if the retry may proceed, or NO if the budget is exhausted.
+ */
+- (BOOL)tryWithdrawRetry;
+
+@end
+
+
+/**
+ *  Describes how a broken task is retried by [PZPromise retry:policy:]. Delays grow exponentially from the initialDelay by the multiplier, are capped at the maximumDelay, and by default are randomized with "full jitter" (a uniformly random delay between 0 and the computed delay) so that many failing callers do not retry in lockstep.
+ */
+@interface PZRetryPolicy : NSObject <NSCopying>
+
+/**
+ *  A policy with 3 attempts, an initial delay of 0.1 seconds, a multiplier of 2, a maximum delay of 10 seconds, full jitter, and the shared retry budget.
+ *
+ *  @return A new policy instance.
+ */
++ (instancetype)defaultPolicy;
+
+/**
+ *  The maximum number of attempts, including the first one. Defaults to 3.
+ */
+@property (assign, nonatomic) NSUInteger maximumAttempts;
+
+/**
+ *  The delay before the first retry, before jitter is applied. Defaults to 0.1 seconds.
+ */
+@property (assign, nonatomic) NSTimeInterval initialDelay;
+
+/**
+ *  The factor the delay grows by for every following retry. Defaults to 2.
+ */
+@property (assign, nonatomic) double multiplier;
+
+/**
+ *  The upper bound for the delay between attempts, before jitter is applied. Defaults to 10 seconds.
+ */
+@property (assign, nonatomic) NSTimeInterval maximumDelay;
+
+/**
+ *  Whether delays are randomized between 0 and the computed delay. Defaults to YES.
+ */
+@property (assign, nonatomic) BOOL usesFullJitter;
+
+/**
+ *  The budget retries are withdrawn from. Defaults to [PZRetryBudget sharedBudget]. If nil, retries are only limited by maximumAttempts.
+ */
+@property (strong, nonatomic) PZRetryBudget *budget;
+
+/**
+ *  An optional block deciding whether a broken attempt should be retried. If nil, every broken attempt is retried.
+ */
+@property (copy, nonatomic) PZShouldRetryBlock shouldRetryBlock;
+
+/**
+ *  Calculates the delay to wait before the given attempt, including jitter.
+ *
+ *  @param attempt The number of the attempt about to be made. Must be 2 or greater.
+ *
+ *  @return The delay in seconds.
+ */
+- (NSTimeInterval)delayBeforeAttempt:(NSUInteger)attempt;
+
+@end
+
+
+@interface PZPromise (PZRetry)
+
+/**
+ *  Runs a task, retrying it according to the policy whenever its promise is broken.
+ *
+ *  Every attempt replaces the previous one, so memory does not grow with the number of attempts. If the returned promise is released before the task succeeds, no further attempts are made.
+ *
+ *  @param factory The block which starts an attempt and returns a promise for its result. This must not be nil.
+ *  @param policy  The policy describing how to retry. If nil, the defaultPolicy is used.
+ *
+ *  @return A promise which is kept with the value of the first successful attempt, or broken with the reason of the last attempt once the policy or budget stops retrying. It cannot be kept or broken manually.
+ */
++ (PZPromise *)retry:(PZPromiseFactoryBlock)factory policy:(PZRetryPolicy *)policy;
+
+@end
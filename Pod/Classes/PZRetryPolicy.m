@@ -0,0 +1,283 @@
+//
+//  PZRetryPolicy.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/10/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZRetryPolicy.h"
+#import "PZTimerWheel.h"
+#import <libkern/OSAtomic.h>
+
+// Methods implemented privately by PZPromise which let the attempter create and settle a sealed promise.
+@interface PZPromise (PZRetryPrivate)
+
+- (instancetype)initSealed;
+- (BOOL)_transitionToState:(PZPromiseState)state valueOrReason:(id)valueOrReason isResolved:(BOOL)isResolved;
+
+@end
+
+#pragma mark - PZRetryBudget
+
+@interface PZRetryBudget ()
+{
+    OSSpinLock _spinLock;
+    double _balance;
+    NSTimeInterval _lastRefill;
+}
+
+@end
+
+@implementation PZRetryBudget
+
++ (instancetype)sharedBudget
+{
+    static PZRetryBudget *sharedBudget;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedBudget = [[self alloc] initWithRetryRatio:0.2 minimumRetriesPerSecond:10.0 maximumBalance:100.0];
+    });
+    
+    return sharedBudget;
+}
+
+- (instancetype)init
+{
+    return [self initWithRetryRatio:0.2 minimumRetriesPerSecond:10.0 maximumBalance:100.0];
+}
+
+- (instancetype)initWithRetryRatio:(double)retryRatio minimumRetriesPerSecond:(double)minimumRetriesPerSecond maximumBalance:(double)maximumBalance
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _retryRatio = MAX(retryRatio, 0.0);
+    _minimumRetriesPerSecond = MAX(minimumRetriesPerSecond, 0.0);
+    _maximumBalance = MAX(maximumBalance, 1.0);
+    _balance = _maximumBalance;
+    _lastRefill = [NSProcessInfo processInfo].systemUptime;
+    
+    return self;
+}
+
+- (void)recordAttempt
+{
+    OSSpinLockLock(&_spinLock);
+    _balance = MIN(_balance + self.retryRatio, self.maximumBalance);
+    OSSpinLockUnlock(&_spinLock);
+}
+
+- (BOOL)tryWithdrawRetry
+{
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    BOOL canRetry = NO;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    _balance = MIN(_balance + (now - _lastRefill) * self.minimumRetriesPerSecond, self.maximumBalance);
+    _lastRefill = now;
+    
+    if (_balance >= 1.0)
+    {
+        _balance -= 1.0;
+        canRetry = YES;
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return canRetry;
+}
+
+@end
+
+
+#pragma mark - PZRetryPolicy
+
+@implementation PZRetryPolicy
+
++ (instancetype)defaultPolicy
+{
+    return [self new];
+}
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _maximumAttempts = 3;
+    _initialDelay = 0.1;
+    _multiplier = 2.0;
+    _maximumDelay = 10.0;
+    _usesFullJitter = YES;
+    _budget = [PZRetryBudget sharedBudget];
+    
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    PZRetryPolicy *policy = [[[self class] allocWithZone:zone] init];
+    policy.maximumAttempts = self.maximumAttempts;
+    policy.initialDelay = self.initialDelay;
+    policy.multiplier = self.multiplier;
+    policy.maximumDelay = self.maximumDelay;
+    policy.usesFullJitter = self.usesFullJitter;
+    policy.budget = self.budget;
+    policy.shouldRetryBlock = self.shouldRetryBlock;
+    
+    return policy;
+}
+
+- (NSTimeInterval)delayBeforeAttempt:(NSUInteger)attempt
+{
+    NSParameterAssert(attempt >= 2);
+    
+    NSTimeInterval delay = self.initialDelay * pow(self.multiplier, (double)(attempt - 2));
+    delay = MAX(MIN(delay, self.maximumDelay), 0.0);
+    
+    if (self.usesFullJitter)
+    {
+        delay *= (double)arc4random() / (double)UINT32_MAX;
+    }
+    
+    return delay;
+}
+
+@end
+
+
+#pragma mark - _PZRetryAttempter
+
+// Drives the attempts of a single +retry:policy: call. It is only retained by the pending attempt or delay, so it disappears as soon as there is nothing left to do.
+@interface _PZRetryAttempter : NSObject
+
+- (instancetype)initWithFactory:(PZPromiseFactoryBlock)factory policy:(PZRetryPolicy *)policy promise:(PZPromise *)promise NS_DESIGNATED_INITIALIZER;
+
+@property (copy, nonatomic, readonly) PZPromiseFactoryBlock factory;
+@property (copy, nonatomic, readonly) PZRetryPolicy *policy;
+@property (weak, nonatomic, readonly) PZPromise *promise;
+
+// The bound promise observing the current attempt. It is replaced on every attempt, so only one is ever alive.
+@property (strong, atomic) PZPromise *observationPromise;
+
+@property (assign, atomic) NSUInteger attempt;
+
+- (void)start;
+
+@end
+
+@implementation _PZRetryAttempter
+
+- (instancetype)initWithFactory:(PZPromiseFactoryBlock)factory policy:(PZRetryPolicy *)policy promise:(PZPromise *)promise
+{
+    NSParameterAssert(factory);
+    NSParameterAssert(policy);
+    NSParameterAssert(promise);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _factory = [factory copy];
+    _policy = [policy copy];
+    _promise = promise;
+    _attempt = 0;
+    
+    return self;
+}
+
+- (void)start
+{
+    [self.policy.budget recordAttempt];
+    [self _attempt];
+}
+
+- (void)_attempt
+{
+    // If nobody is waiting on the result anymore there is no reason to keep trying.
+    if (!self.promise)
+    {
+        self.observationPromise = nil;
+        return;
+    }
+    
+    self.attempt += 1;
+    
+    PZPromise *attemptPromise;
+    @try
+    {
+        attemptPromise = self.factory() ?: [PZPromise keptNil];
+    }
+    @catch (NSException *exception)
+    {
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Unexepected exception raised while starting a retry attempt.",
+                                   NSLocalizedFailureReasonErrorKey: exception.reason ?: exception.description};
+        attemptPromise = [[PZPromise alloc] initWithBrokenReason:[NSError errorWithDomain:PZErrorDomain code:PZExceptionError userInfo:userInfo]];
+    }
+    
+    self.observationPromise = [attemptPromise thenOnKept:^id(id value) {
+        [self.promise _transitionToState:PZPromiseStateKept valueOrReason:value isResolved:YES];
+        self.observationPromise = nil;
+        return nil;
+    } onBroken:^id(NSError *reason) {
+        [self _attemptDidBreakWithReason:reason];
+        return nil;
+    }];
+}
+
+- (void)_attemptDidBreakWithReason:(NSError *)reason
+{
+    PZRetryPolicy *policy = self.policy;
+    NSUInteger attempt = self.attempt;
+    
+    BOOL shouldRetry = (attempt < policy.maximumAttempts &&
+                        (!policy.shouldRetryBlock || policy.shouldRetryBlock(reason, attempt)) &&
+                        (!policy.budget || [policy.budget tryWithdrawRetry]));
+    
+    if (!shouldRetry)
+    {
+        [self.promise _transitionToState:PZPromiseStateBroken valueOrReason:reason isResolved:YES];
+        self.observationPromise = nil;
+        return;
+    }
+    
+    NSTimeInterval delay = [policy delayBeforeAttempt:attempt + 1];
+    [[PZTimerWheel sharedTimerWheel] scheduleAfter:delay block:^{
+        // Attempts are started off the wheel's queue, since factories may do arbitrary work.
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self _attempt];
+        });
+    }];
+    
+    // The delay retains the receiver until the next attempt, so the previous attempt can be released right away.
+    self.observationPromise = nil;
+}
+
+@end
+
+
+#pragma mark - PZPromise (PZRetry)
+
+@implementation PZPromise (PZRetry)
+
++ (PZPromise *)retry:(PZPromiseFactoryBlock)factory policy:(PZRetryPolicy *)policy
+{
+    NSParameterAssert(factory);
+    
+    // The returned promise is sealed, so only the attempts can settle it. The attempter references it weakly rather than through a PZDeferred, so retrying stops once nobody holds it.
+    PZPromise *promise = [[PZPromise alloc] initSealed];
+    _PZRetryAttempter *attempter = [[_PZRetryAttempter alloc] initWithFactory:factory policy:(policy ?: [PZRetryPolicy defaultPolicy]) promise:promise];
+    [attempter start];
+    
+    return promise;
+}
+
+@end
@@ -0,0 +1,94 @@
+//
+//  PZSingleFlight.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/6/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A registry which deduplicates concurrent requests for the same resource. While a promise for a key is pending, every caller asking for that key receives the same promise instead of starting the task again. Once the promise is kept or broken it is dropped from the registry, unless settled result caching is enabled via the settledResultLifetime property.
+ *
+ *  Keys are split across a fixed number of shards, each guarded by its own lock, so unrelated keys do not contend with each other.
+ *
+ *  @note Callers share the returned promise, so they should not keep or break it themselves.
+ */
+@interface PZSingleFlight : NSObject
+
+/**
+ *  @name Creating registries
+ */
+
+/**
+ *  Initializes a registry with a shard count derived from the number of active processors.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param shardCount The number of independently locked shards keys are spread across. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithShardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+
+
+/**
+ *  @name Configuring settled results
+ */
+
+/**
+ *  How long a kept promise remains in the registry after it settles. During this time callers asking for the key receive the kept promise without the task being started again. Broken promises are never retained. Defaults to 0, which drops promises as soon as they settle.
+ */
+@property (assign, atomic) NSTimeInterval settledResultLifetime;
+
+/**
+ *  The maximum number of settled results each shard retains when settledResultLifetime is positive. When the limit is exceeded the oldest settled results are dropped first. Defaults to 64.
+ */
+@property (assign, atomic) NSUInteger settledResultCountLimitPerShard;
+
+
+/**
+ *  @name Accessing promises
+ */
+
+/**
+ *  Returns the promise registered for the given key, starting the task via the block if no pending or cached promise exists.
+ *
+ *  @note The block is invoked asynchronously, at most once per miss, and its promise is adopted by the returned promise.
+ *
+ *  @param key   The key identifying the task. This must not be nil.
+ *  @param block The block which starts the task and returns a promise for its result. This must not be nil.
+ *
+ *  @return The shared promise for the key.
+ */
+- (PZPromise *)promiseForKey:(id<NSCopying>)key usingBlock:(PZPromiseFactoryBlock)block;
+
+/**
+ *  Returns the promise currently registered for the key without starting any task.
+ *
+ *  @param key The key identifying the task. This must not be nil.
+ *
+ *  @return The registered promise, or nil if there is none or the cached result has expired.
+ */
+- (PZPromise *)existingPromiseForKey:(id<NSCopying>)key;
+
+/**
+ *  Removes the promise registered for the key. The promise itself is unaffected, but later callers will start a new task.
+ *
+ *  @param key The key identifying the task. This must not be nil.
+ */
+- (void)removePromiseForKey:(id<NSCopying>)key;
+
+/**
+ *  Removes all registered promises.
+ */
+- (void)removeAllPromises;
+
+@end
@@ -0,0 +1,264 @@
+//
+//  PZSingleFlight.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/6/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZSingleFlight.h"
+#import <libkern/OSAtomic.h>
+
+@interface _PZSingleFlightEntry : NSObject
+
+@property (strong, nonatomic) PZPromise *promise;
+
+// The bound promise observing the shared promise. Continuations only hold their promise weakly, so it must be retained or the drain will skip its blocks.
+@property (strong, nonatomic) PZPromise *settlementPromise;
+
+@property (assign, nonatomic) BOOL settled;
+@property (assign, nonatomic) NSTimeInterval expiration;
+
+@end
+
+@implementation _PZSingleFlightEntry
+@end
+
+
+@interface _PZSingleFlightShard : NSObject
+{
+    @public
+    OSSpinLock _spinLock;
+}
+
+@property (strong, nonatomic, readonly) NSMutableDictionary *entries;
+
+// Keys of settled entries in the order they settled, so the oldest can be dropped first.
+@property (strong, nonatomic, readonly) NSMutableOrderedSet *settledKeys;
+
+@end
+
+@implementation _PZSingleFlightShard
+
+- (instancetype)init
+{
+    if ((self = [super init]))
+    {
+        _spinLock = OS_SPINLOCK_INIT;
+        _entries = [NSMutableDictionary new];
+        _settledKeys = [NSMutableOrderedSet new];
+    }
+    
+    return self;
+}
+
+@end
+
+
+#pragma mark - PZSingleFlight
+
+@interface PZSingleFlight ()
+
+@property (copy, nonatomic, readonly) NSArray *shards;
+
+@end
+
+@implementation PZSingleFlight
+
+#pragma mark Creating registries
+
+- (instancetype)init
+{
+    return [self initWithShardCount:MAX([NSProcessInfo processInfo].activeProcessorCount * 4, 1)];
+}
+
+- (instancetype)initWithShardCount:(NSUInteger)shardCount
+{
+    NSParameterAssert(shardCount > 0);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    NSMutableArray *shards = [NSMutableArray arrayWithCapacity:shardCount];
+    for (NSUInteger i = 0; i < shardCount; i++)
+    {
+        [shards addObject:[_PZSingleFlightShard new]];
+    }
+    
+    _shards = [shards copy];
+    _settledResultLifetime = 0.0;
+    _settledResultCountLimitPerShard = 64;
+    
+    return self;
+}
+
+
+#pragma mark Accessing promises
+
+- (PZPromise *)promiseForKey:(id<NSCopying>)key usingBlock:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(key);
+    NSParameterAssert(block);
+    
+    // The key is captured by the settlement blocks, so it is copied up front just like the dictionary would.
+    key = [(id)key copy];
+    
+    _PZSingleFlightShard *shard = [self _shardForKey:key];
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    
+    OSSpinLockLock(&shard->_spinLock);
+    
+    _PZSingleFlightEntry *entry = [self _liveEntryForKey:key inShard:shard now:now];
+    if (entry)
+    {
+        PZPromise *promise = entry.promise;
+        OSSpinLockUnlock(&shard->_spinLock);
+        return promise;
+    }
+    
+    // The shared promise is bound to a gate which is only opened after the entry is registered. This lets the block run outside of the lock while still guaranteeing that concurrent callers find the entry.
+    PZPromise *gatePromise = [PZPromise new];
+    
+    entry = [_PZSingleFlightEntry new];
+    entry.promise = [gatePromise thenOnKept:^id(id value) {
+        return block();
+    } onBroken:nil];
+    
+    __weak _PZSingleFlightEntry *weakEntry = entry;
+    __weak _PZSingleFlightShard *weakShard = shard;
+    __weak typeof(self) weakSelf = self;
+    entry.settlementPromise = [entry.promise thenOnKept:^id(id value) {
+        [weakSelf _settleEntry:weakEntry forKey:key inShard:weakShard isKept:YES];
+        return nil;
+    } onBroken:^id(NSError *reason) {
+        [weakSelf _settleEntry:weakEntry forKey:key inShard:weakShard isKept:NO];
+        return nil;
+    }];
+    
+    shard.entries[key] = entry;
+    
+    OSSpinLockUnlock(&shard->_spinLock);
+    
+    [gatePromise keepWithValue:nil];
+    
+    return entry.promise;
+}
+
+- (PZPromise *)existingPromiseForKey:(id<NSCopying>)key
+{
+    NSParameterAssert(key);
+    
+    _PZSingleFlightShard *shard = [self _shardForKey:key];
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    
+    OSSpinLockLock(&shard->_spinLock);
+    PZPromise *promise = [self _liveEntryForKey:key inShard:shard now:now].promise;
+    OSSpinLockUnlock(&shard->_spinLock);
+    
+    return promise;
+}
+
+- (void)removePromiseForKey:(id<NSCopying>)key
+{
+    NSParameterAssert(key);
+    
+    _PZSingleFlightShard *shard = [self _shardForKey:key];
+    _PZSingleFlightEntry *entry;
+    
+    OSSpinLockLock(&shard->_spinLock);
+    entry = shard.entries[key];
+    [shard.entries removeObjectForKey:key];
+    [shard.settledKeys removeObject:key];
+    OSSpinLockUnlock(&shard->_spinLock);
+    
+    // The entry is released outside of the lock since it may release the last reference to its promises.
+    entry = nil;
+}
+
+- (void)removeAllPromises
+{
+    for (_PZSingleFlightShard *shard in self.shards)
+    {
+        NSDictionary *entries;
+        
+        OSSpinLockLock(&shard->_spinLock);
+        entries = [shard.entries copy];
+        [shard.entries removeAllObjects];
+        [shard.settledKeys removeAllObjects];
+        OSSpinLockUnlock(&shard->_spinLock);
+        
+        entries = nil;
+    }
+}
+
+
+#pragma mark Private
+
+- (_PZSingleFlightShard *)_shardForKey:(id<NSCopying>)key
+{
+    // Hashes of common keys (like small NSNumbers) are poorly distributed, so they are mixed before picking a shard.
+    uint64_t hash = (uint64_t)[(id)key hash] * 0x9E3779B97F4A7C15ULL;
+    NSArray *shards = self.shards;
+    return shards[(NSUInteger)((hash >> 32) % shards.count)];
+}
+
+// Must be called while holding the shard's lock.
+- (_PZSingleFlightEntry *)_liveEntryForKey:(id<NSCopying>)key inShard:(_PZSingleFlightShard *)shard now:(NSTimeInterval)now
+{
+    _PZSingleFlightEntry *entry = shard.entries[key];
+    if (entry.settled && entry.expiration <= now)
+    {
+        [shard.entries removeObjectForKey:key];
+        [shard.settledKeys removeObject:key];
+        return nil;
+    }
+    
+    return entry;
+}
+
+- (void)_settleEntry:(_PZSingleFlightEntry *)entry forKey:(id<NSCopying>)key inShard:(_PZSingleFlightShard *)shard isKept:(BOOL)isKept
+{
+    if (!entry || !shard)
+    {
+        return;
+    }
+    
+    NSTimeInterval lifetime = self.settledResultLifetime;
+    NSUInteger countLimit = self.settledResultCountLimitPerShard;
+    NSMutableArray *releasedEntries = [NSMutableArray new];
+    
+    OSSpinLockLock(&shard->_spinLock);
+    
+    // The entry may have been removed or replaced while its promise was settling.
+    if (shard.entries[key] == entry)
+    {
+        if (isKept && lifetime > 0.0 && countLimit > 0)
+        {
+            entry.settled = YES;
+            entry.expiration = [NSProcessInfo processInfo].systemUptime + lifetime;
+            [shard.settledKeys addObject:key];
+            
+            while (shard.settledKeys.count > countLimit)
+            {
+                id oldestKey = shard.settledKeys.firstObject;
+                [releasedEntries addObject:shard.entries[oldestKey]];
+                [shard.entries removeObjectForKey:oldestKey];
+                [shard.settledKeys removeObjectAtIndex:0];
+            }
+        }
+        else
+        {
+            [releasedEntries addObject:entry];
+            [shard.entries removeObjectForKey:key];
+        }
+    }
+    
+    OSSpinLockUnlock(&shard->_spinLock);
+    
+    entry.settlementPromise = nil;
+    [releasedEntries removeAllObjects];
+}
+
+@end
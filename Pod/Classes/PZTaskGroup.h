@@ -0,0 +1,56 @@
+//
+//  PZTaskGroup.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/16/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+@class PZCancellationToken;
+
+/**
+ *  A scope which owns a set of concurrently running child tasks. If any child is broken, or the group is cancelled, every other child is cancelled through the group's cancellationToken. The group's own promise only settles once the group is closed and every child has finished or been cancelled, so no child work outlives the result it was started for.
+ *
+ *  Children should link the operations doing their work to the cancellationToken, for example with -[PZCancellationToken linkOperation:], so cancelling a child actually stops the work instead of only discarding its result.
+ *
+ *  A group retains itself while it has pending children. If it is deallocated before being closed, its promise is broken with a PZAbandonedError.
+ *
+ *  This class is thread safe.
+ */
+@interface PZTaskGroup : NSObject
+
+/**
+ *  A promise which is kept with an array of the children's kept values, in the order the children were added, once the group is closed and every child has been kept. Children kept with `nil` are represented by NSNull. If any child is broken, the promise is broken with the first child's reason once all other children have finished or been cancelled.
+ */
+@property (strong, nonatomic, readonly) PZPromise *promise;
+
+/**
+ *  The token which is cancelled when a child is broken or the group is cancelled. Children should link their work to it.
+ */
+@property (strong, nonatomic, readonly) PZCancellationToken *cancellationToken;
+
+/**
+ *  Starts a child task in the group.
+ *
+ *  @note If the group is closed or has already been cancelled, the block is not invoked and the returned promise is broken with a PZCancelledError.
+ *
+ *  @param block The block which starts the task and returns a promise for its result. Returning `nil` is treated as a task kept with `nil`. This must not be nil.
+ *
+ *  @return A promise adopting the state of the child's promise, which is broken with a PZCancelledError if the group cancels the child first.
+ */
+- (PZPromise *)addTask:(PZPromiseFactoryBlock)block;
+
+/**
+ *  Prevents further children from being added, allowing the group's promise to settle once the existing children finish. Subsequent calls have no effect.
+ */
+- (void)close;
+
+/**
+ *  Closes the group and cancels every pending child. Unless a child was already broken, the group's promise is broken with a PZCancelledError once the children have finished.
+ */
+- (void)cancel;
+
+@end
@@ -0,0 +1,244 @@
+//
+//  PZTaskGroup.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/16/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZTaskGroup.h"
+#import "PZCancellationToken.h"
+#import "PZDeferred.h"
+#import <libkern/OSAtomic.h>
+
+#pragma mark - _PZTaskGroupChild
+
+// Holds the observation of a single child. The observation's blocks release it once they run, which in turn releases the group.
+@interface _PZTaskGroupChild : NSObject
+
+@property (strong, atomic) PZPromise *observationPromise;
+
+@end
+
+@implementation _PZTaskGroupChild
+@end
+
+
+#pragma mark - PZTaskGroup
+
+@interface PZTaskGroup ()
+{
+    OSSpinLock _spinLock;
+    NSUInteger _pendingCount;
+    BOOL _closed;
+    BOOL _cancelled;
+    BOOL _settled;
+    NSError *_firstBrokenReason;
+    BOOL _hasBrokenChild;
+}
+
+@property (strong, nonatomic, readonly) PZDeferred *deferred;
+@property (strong, nonatomic, readonly) NSMutableArray *values;
+
+@end
+
+@implementation PZTaskGroup
+
+- (instancetype)init
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _pendingCount = 0;
+    _closed = NO;
+    _cancelled = NO;
+    _settled = NO;
+    _hasBrokenChild = NO;
+    
+    _deferred = [PZDeferred deferred];
+    _cancellationToken = [PZCancellationToken new];
+    _values = [NSMutableArray new];
+    
+    return self;
+}
+
+- (PZPromise *)promise
+{
+    return self.deferred.promise;
+}
+
+
+#pragma mark Managing children
+
+- (PZPromise *)addTask:(PZPromiseFactoryBlock)block
+{
+    NSParameterAssert(block);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (_closed || _hasBrokenChild)
+    {
+        OSSpinLockUnlock(&_spinLock);
+        return [[PZPromise alloc] initWithBrokenReason:[self _cancelledError]];
+    }
+    
+    NSUInteger index = self.values.count;
+    [self.values addObject:[NSNull null]];
+    _pendingCount += 1;
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    PZPromise *taskPromise;
+    @try
+    {
+        taskPromise = block() ?: [PZPromise keptNil];
+    }
+    @catch (NSException *exception)
+    {
+        NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Unexepected exception raised while starting a task group child.",
+                                   NSLocalizedFailureReasonErrorKey: exception.reason ?: exception.description};
+        taskPromise = [[PZPromise alloc] initWithBrokenReason:[NSError errorWithDomain:PZErrorDomain code:PZExceptionError userInfo:userInfo]];
+    }
+    
+    // Tying the child to the group's token lets a failing sibling break it right away. Once the child is no longer consumed, the task promise is abandoned as well, so producers listening for abandonment stop too.
+    PZPromise *childPromise = [taskPromise thenOnKept:nil onBroken:nil cancellationToken:self.cancellationToken];
+    
+    _PZTaskGroupChild *child = [_PZTaskGroupChild new];
+    child.observationPromise = [childPromise thenOnKept:^id(id value) {
+        [self _childAtIndex:index didSettleWithValueOrReason:value isKept:YES];
+        child.observationPromise = nil;
+        return nil;
+    } onBroken:^id(NSError *reason) {
+        [self _childAtIndex:index didSettleWithValueOrReason:reason isKept:NO];
+        child.observationPromise = nil;
+        return nil;
+    }];
+    
+    return childPromise;
+}
+
+- (void)close
+{
+    OSSpinLockLock(&_spinLock);
+    _closed = YES;
+    BOOL shouldSettle = [self _shouldSettle];
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldSettle)
+    {
+        [self _settle];
+    }
+}
+
+- (void)cancel
+{
+    OSSpinLockLock(&_spinLock);
+    _closed = YES;
+    _cancelled = YES;
+    BOOL shouldSettle = [self _shouldSettle];
+    OSSpinLockUnlock(&_spinLock);
+    
+    [self.cancellationToken cancel];
+    
+    if (shouldSettle)
+    {
+        [self _settle];
+    }
+}
+
+
+#pragma mark Private
+
+- (NSError *)_cancelledError
+{
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Task group cancelled error.",
+                               NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:@"The task group (<%@:%p>) was cancelled.", [self class], self]};
+    return [NSError errorWithDomain:PZErrorDomain code:PZCancelledError userInfo:userInfo];
+}
+
+- (void)_childAtIndex:(NSUInteger)index didSettleWithValueOrReason:(id)valueOrReason isKept:(BOOL)isKept
+{
+    BOOL shouldCancelSiblings = NO;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (isKept)
+    {
+        self.values[index] = valueOrReason ?: [NSNull null];
+    }
+    else if (!_hasBrokenChild && !_cancelled)
+    {
+        // Only the first failure is reported. Siblings broken by the cancellation that follows would only hide it.
+        _hasBrokenChild = YES;
+        _firstBrokenReason = valueOrReason;
+        shouldCancelSiblings = YES;
+    }
+    
+    _pendingCount -= 1;
+    BOOL shouldSettle = [self _shouldSettle];
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (shouldCancelSiblings)
+    {
+        [self.cancellationToken cancel];
+    }
+    
+    if (shouldSettle)
+    {
+        [self _settle];
+    }
+}
+
+// Must be called while holding the lock. Returns YES exactly once, when the group is closed and no children are pending.
+- (BOOL)_shouldSettle
+{
+    if (_settled || !_closed || _pendingCount > 0)
+    {
+        return NO;
+    }
+    
+    _settled = YES;
+    return YES;
+}
+
+- (void)_settle
+{
+    OSSpinLockLock(&_spinLock);
+    BOOL hasBrokenChild = _hasBrokenChild;
+    NSError *firstBrokenReason = _firstBrokenReason;
+    BOOL cancelled = _cancelled;
+    NSArray *values = [self.values copy];
+    OSSpinLockUnlock(&_spinLock);
+    
+    if (hasBrokenChild)
+    {
+        [self.deferred breakWithReason:firstBrokenReason];
+    }
+    else if (cancelled)
+    {
+        [self.deferred breakWithReason:[self _cancelledError]];
+    }
+    else
+    {
+        [self.deferred keepWithValue:values];
+    }
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger pendingCount = _pendingCount;
+    BOOL closed = _closed;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return [NSString stringWithFormat:@"<%@:%p> pendingCount:%lu, closed:%@, promise:%@", [self class], self, (unsigned long)pendingCount, closed ? @"YES" : @"NO", self.promise];
+}
+
+@end
@@ -0,0 +1,69 @@
+//
+//  PZTimerWheel.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/13/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Opaque handle identifying a timer scheduled on a PZTimerWheel. A handle of 0 is never returned for a scheduled timer.
+ */
+typedef uint64_t PZTimerWheelTimer;
+
+/**
+ *  A hashed timing wheel which schedules large numbers of coarse timers using a single dispatch source. Timers are hashed into slots by their deadline tick, so scheduling and cancelling are constant time operations regardless of how many timers are outstanding, and the kernel only ever sees one timer per wheel.
+ *
+ *  Timers fire on the wheel's private serial queue with a precision of one tick, so their blocks should be short. PromiseZ uses the shared wheel for promise timeouts, delays, and retry backoffs.
+ *
+ *  This class is thread safe.
+ */
+@interface PZTimerWheel : NSObject
+
+/**
+ *  The wheel shared by PromiseZ, which ticks every 10 milliseconds and has 4096 slots.
+ *
+ *  @return The shared timer wheel.
+ */
++ (instancetype)sharedTimerWheel;
+
+/**
+ *  The designated initializer.
+ *
+ *  @param tickInterval The resolution of the wheel in seconds. Must be greater than 0.
+ *  @param slotCount    The number of slots in the wheel. Timers further away than one rotation stay in their slot for multiple rotations, so larger wheels do less work per tick. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval slotCount:(NSUInteger)slotCount NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) NSTimeInterval tickInterval;
+@property (assign, nonatomic, readonly) NSUInteger slotCount;
+
+/**
+ *  The number of timers which are scheduled and have not yet fired or been cancelled.
+ */
+@property (assign, nonatomic, readonly) NSUInteger timerCount;
+
+/**
+ *  Schedules a block to be executed after the given delay, rounded up to the next tick.
+ *
+ *  @param delay The number of seconds to wait before executing the block.
+ *  @param block The block to execute. This must not be nil.
+ *
+ *  @return A handle which can be used to cancel the timer.
+ */
+- (PZTimerWheelTimer)scheduleAfter:(NSTimeInterval)delay block:(dispatch_block_t)block;
+
+/**
+ *  Cancels a timer, releasing its block without executing it.
+ *
+ *  @param timer The handle of the timer to cancel. Handles of timers which have already fired or been cancelled are ignored.
+ *
+ *  @return YES if the timer was cancelled, or NO if it had already fired or been cancelled.
+ */
+- (BOOL)cancelTimer:(PZTimerWheelTimer)timer;
+
+@end
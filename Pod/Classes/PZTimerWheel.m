@@ -0,0 +1,341 @@
+//
+//  PZTimerWheel.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/13/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZTimerWheel.h"
+#import <libkern/OSAtomic.h>
+
+static const uint32_t _PZTimerWheelNoIndex = UINT32_MAX;
+
+// Timers live in a single growable array and are linked by index, so scheduling a timer never allocates once the array is large enough and handles stay valid when it grows.
+typedef struct
+{
+    // The retained block, or NULL if the node is free.
+    void *block;
+    uint64_t deadlineTick;
+    uint32_t slot;
+    uint32_t previous;
+    uint32_t next;
+    // Bumped every time the node is freed, so stale handles can be detected.
+    uint32_t generation;
+} _PZTimerWheelNode;
+
+@interface PZTimerWheel ()
+{
+    OSSpinLock _spinLock;
+    
+    _PZTimerWheelNode *_nodes;
+    uint32_t _nodeCapacity;
+    uint32_t _freeListHead;
+    
+    // The head node index of every slot.
+    uint32_t *_slots;
+    
+    NSUInteger _timerCount;
+    uint64_t _lastProcessedTick;
+    NSTimeInterval _startTime;
+    BOOL _isRunning;
+}
+
+@property (strong, nonatomic, readonly) dispatch_queue_t queue;
+@property (strong, nonatomic, readonly) dispatch_source_t source;
+
+@end
+
+@implementation PZTimerWheel
+
++ (instancetype)sharedTimerWheel
+{
+    static PZTimerWheel *sharedTimerWheel;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedTimerWheel = [[self alloc] initWithTickInterval:0.01 slotCount:4096];
+    });
+    
+    return sharedTimerWheel;
+}
+
+- (instancetype)init
+{
+    return [self initWithTickInterval:0.01 slotCount:4096];
+}
+
+- (instancetype)initWithTickInterval:(NSTimeInterval)tickInterval slotCount:(NSUInteger)slotCount
+{
+    NSParameterAssert(tickInterval > 0.0);
+    NSParameterAssert(slotCount > 0 && slotCount < _PZTimerWheelNoIndex);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _tickInterval = tickInterval;
+    _slotCount = slotCount;
+    _spinLock = OS_SPINLOCK_INIT;
+    
+    _slots = malloc(sizeof(uint32_t) * slotCount);
+    for (NSUInteger i = 0; i < slotCount; i++)
+    {
+        _slots[i] = _PZTimerWheelNoIndex;
+    }
+    
+    _nodes = NULL;
+    _nodeCapacity = 0;
+    _freeListHead = _PZTimerWheelNoIndex;
+    _timerCount = 0;
+    _lastProcessedTick = 0;
+    _startTime = [NSProcessInfo processInfo].systemUptime;
+    _isRunning = NO;
+    
+    _queue = dispatch_queue_create("com.zachradke.promiseZ.timerWheel", DISPATCH_QUEUE_SERIAL);
+    _source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    
+    uint64_t interval = (uint64_t)(tickInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(_source, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10);
+    
+    // The handler must not retain the wheel, or it could never be deallocated.
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(_source, ^{
+        [weakSelf _tick];
+    });
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    // A suspended source cannot be cancelled, so it is resumed first.
+    if (!_isRunning)
+    {
+        dispatch_resume(_source);
+    }
+    dispatch_source_cancel(_source);
+    
+    for (uint32_t i = 0; i < _nodeCapacity; i++)
+    {
+        if (_nodes[i].block)
+        {
+            CFRelease(_nodes[i].block);
+        }
+    }
+    
+    free(_nodes);
+    free(_slots);
+}
+
+
+#pragma mark Scheduling timers
+
+- (NSUInteger)timerCount
+{
+    OSSpinLockLock(&_spinLock);
+    NSUInteger timerCount = _timerCount;
+    OSSpinLockUnlock(&_spinLock);
+    
+    return timerCount;
+}
+
+- (PZTimerWheelTimer)scheduleAfter:(NSTimeInterval)delay block:(dispatch_block_t)block
+{
+    NSParameterAssert(block);
+    
+    void *retainedBlock = (__bridge_retained void *)[block copy];
+    NSTimeInterval deadline = [NSProcessInfo processInfo].systemUptime + MAX(delay, 0.0);
+    
+    OSSpinLockLock(&_spinLock);
+    
+    // When the wheel has been idle, the ticks it slept through have nothing in them. Catching up before the deadline is clamped keeps a timer from landing on one of them, where it would wait a full rotation for its slot to be visited again.
+    BOOL shouldResume = !_isRunning;
+    if (shouldResume)
+    {
+        _lastProcessedTick = MAX(_lastProcessedTick, [self _currentTick]);
+    }
+    
+    // Ticks which have already been processed can't fire anymore, so a timer lands at least on the next one.
+    uint64_t deadlineTick = (uint64_t)ceil((deadline - _startTime) / self.tickInterval);
+    deadlineTick = MAX(deadlineTick, _lastProcessedTick + 1);
+    
+    if (_freeListHead == _PZTimerWheelNoIndex)
+    {
+        [self _growNodes];
+    }
+    
+    uint32_t index = _freeListHead;
+    _PZTimerWheelNode *node = &_nodes[index];
+    _freeListHead = node->next;
+    
+    node->block = retainedBlock;
+    node->deadlineTick = deadlineTick;
+    node->slot = (uint32_t)(deadlineTick % self.slotCount);
+    node->previous = _PZTimerWheelNoIndex;
+    node->next = _slots[node->slot];
+    
+    if (node->next != _PZTimerWheelNoIndex)
+    {
+        _nodes[node->next].previous = index;
+    }
+    _slots[node->slot] = index;
+    
+    _timerCount += 1;
+    
+    if (shouldResume)
+    {
+        _isRunning = YES;
+        dispatch_resume(self.source);
+    }
+    
+    PZTimerWheelTimer timer = ((uint64_t)node->generation << 32) | (uint64_t)(index + 1);
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    return timer;
+}
+
+- (BOOL)cancelTimer:(PZTimerWheelTimer)timer
+{
+    if (timer == 0)
+    {
+        return NO;
+    }
+    
+    uint32_t index = (uint32_t)(timer & 0xFFFFFFFF) - 1;
+    uint32_t generation = (uint32_t)(timer >> 32);
+    void *block = NULL;
+    
+    OSSpinLockLock(&_spinLock);
+    
+    if (index < _nodeCapacity && _nodes[index].generation == generation && _nodes[index].block)
+    {
+        block = _nodes[index].block;
+        [self _removeNodeAtIndex:index];
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    // The block is released outside of the lock since it may release arbitrary objects.
+    if (block)
+    {
+        CFRelease(block);
+        return YES;
+    }
+    
+    return NO;
+}
+
+
+#pragma mark Private
+
+// Must be called while holding the lock.
+- (uint64_t)_currentTick
+{
+    NSTimeInterval elapsed = [NSProcessInfo processInfo].systemUptime - _startTime;
+    return (uint64_t)floor(MAX(elapsed, 0.0) / self.tickInterval);
+}
+
+// Must be called while holding the lock.
+- (void)_growNodes
+{
+    uint32_t oldCapacity = _nodeCapacity;
+    uint32_t newCapacity = MAX(oldCapacity * 2, 1024);
+    NSAssert(newCapacity > oldCapacity && newCapacity < _PZTimerWheelNoIndex, @"Timer wheel (%@) exceeded its maximum number of timers.", self);
+    
+    _nodes = realloc(_nodes, sizeof(_PZTimerWheelNode) * newCapacity);
+    
+    // New nodes are threaded onto the free list in order, so low indexes are reused first.
+    for (uint32_t i = oldCapacity; i < newCapacity; i++)
+    {
+        _nodes[i].block = NULL;
+        _nodes[i].generation = 0;
+        _nodes[i].slot = _PZTimerWheelNoIndex;
+        _nodes[i].previous = _PZTimerWheelNoIndex;
+        _nodes[i].next = (i + 1 < newCapacity) ? i + 1 : _freeListHead;
+    }
+    
+    _freeListHead = oldCapacity;
+    _nodeCapacity = newCapacity;
+}
+
+// Must be called while holding the lock. The caller takes ownership of the node's block.
+- (void)_removeNodeAtIndex:(uint32_t)index
+{
+    _PZTimerWheelNode *node = &_nodes[index];
+    
+    if (node->previous != _PZTimerWheelNoIndex)
+    {
+        _nodes[node->previous].next = node->next;
+    }
+    else
+    {
+        _slots[node->slot] = node->next;
+    }
+    
+    if (node->next != _PZTimerWheelNoIndex)
+    {
+        _nodes[node->next].previous = node->previous;
+    }
+    
+    node->block = NULL;
+    node->generation += 1;
+    node->slot = _PZTimerWheelNoIndex;
+    node->previous = _PZTimerWheelNoIndex;
+    node->next = _freeListHead;
+    _freeListHead = index;
+    
+    _timerCount -= 1;
+}
+
+- (void)_tick
+{
+    NSMutableArray *expiredBlocks = [NSMutableArray new];
+    
+    OSSpinLockLock(&_spinLock);
+    
+    uint64_t currentTick = [self _currentTick];
+    uint64_t slotCount = self.slotCount;
+    
+    // If the tick handler fell behind, every slot between the last processed tick and now is visited, but never more than one full rotation.
+    uint64_t tickCount = MIN(currentTick - MIN(_lastProcessedTick, currentTick), slotCount);
+    
+    for (uint64_t i = 1; i <= tickCount; i++)
+    {
+        uint32_t index = _slots[(_lastProcessedTick + i) % slotCount];
+        
+        while (index != _PZTimerWheelNoIndex)
+        {
+            _PZTimerWheelNode *node = &_nodes[index];
+            uint32_t nextIndex = node->next;
+            
+            // Timers more than one rotation away share the slot, and are left for a later rotation.
+            if (node->deadlineTick <= currentTick)
+            {
+                [expiredBlocks addObject:(__bridge_transfer dispatch_block_t)node->block];
+                [self _removeNodeAtIndex:index];
+            }
+            
+            index = nextIndex;
+        }
+    }
+    
+    _lastProcessedTick = MAX(_lastProcessedTick, currentTick);
+    
+    if (_timerCount == 0 && _isRunning)
+    {
+        // An idle wheel doesn't need to wake up.
+        _isRunning = NO;
+        dispatch_suspend(self.source);
+    }
+    
+    OSSpinLockUnlock(&_spinLock);
+    
+    for (dispatch_block_t block in expiredBlocks)
+    {
+        block();
+    }
+}
+
+@end
@@ -0,0 +1,1006 @@
+//
+//  PZTypedPromise.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/23/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <libkern/OSAtomic.h>
+#import "PZPromise.h"
+#import "PZDeferred.h"
+
+// Typed promises need Objective-C++ compiled as C++17 or later. Anywhere else this header is empty, so it can still be imported from plain Objective-C.
+#if defined(__OBJC__) && defined(__cplusplus) && __cplusplus >= 201703L
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <new>
+#include <optional>
+#include <pthread.h>
+#include <type_traits>
+#include <utility>
+
+namespace pz {
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+template <typename T, typename Stages>
+class Pipeline;
+
+namespace detail {
+
+#pragma mark - Scheduling
+
+// Something waiting for a shared state to resolve.
+class callback_node
+{
+public:
+    virtual void run() noexcept = 0;
+    
+    callback_node *next_scheduled = nullptr;
+
+protected:
+    ~callback_node() = default;
+};
+
+// Callbacks run on the thread which resolves their state. A callback which resolves another state while running only queues that state's callback, so a long chain is walked in a loop instead of recursing once per step.
+struct callback_queue
+{
+    callback_node *head = nullptr;
+    callback_node *tail = nullptr;
+    bool draining = false;
+    
+    // A pthread key rather than thread_local, which the older deployment targets do not support.
+    static callback_queue *current() noexcept
+    {
+        static pthread_key_t queueKey = [] {
+            pthread_key_t newKey;
+            pthread_key_create(&newKey, [](void *queue) {
+                delete static_cast<callback_queue *>(queue);
+            });
+            return newKey;
+        }();
+        
+        callback_queue *queue = static_cast<callback_queue *>(pthread_getspecific(queueKey));
+        if (!queue)
+        {
+            queue = new (std::nothrow) callback_queue();
+            pthread_setspecific(queueKey, queue);
+        }
+        return queue;
+    }
+};
+
+inline void schedule(callback_node *node) noexcept
+{
+    callback_queue *queue = callback_queue::current();
+    if (!queue)
+    {
+        node->run();
+        return;
+    }
+    
+    node->next_scheduled = nullptr;
+    if (queue->tail)
+    {
+        queue->tail->next_scheduled = node;
+    }
+    else
+    {
+        queue->head = node;
+    }
+    queue->tail = node;
+    
+    if (queue->draining)
+    {
+        return;
+    }
+    
+    queue->draining = true;
+    while (callback_node *next = queue->head)
+    {
+        queue->head = next->next_scheduled;
+        if (!queue->head)
+        {
+            queue->tail = nullptr;
+        }
+        next->run();
+    }
+    queue->draining = false;
+}
+
+
+#pragma mark - Errors
+
+// Must be called from a catch block.
+inline NSError *error_for_current_exception() noexcept
+{
+    NSString *reason = nil;
+    try
+    {
+        throw;
+    }
+    catch (NSException *exception)
+    {
+        reason = exception.reason ?: exception.description;
+    }
+    catch (const std::exception &exception)
+    {
+        reason = @(exception.what());
+    }
+    catch (...)
+    {
+    }
+    
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Unexpected exception raised while resolving a typed promise.",
+                               NSLocalizedFailureReasonErrorKey: reason ?: @"Unknown exception."};
+    return [NSError errorWithDomain:PZErrorDomain code:PZExceptionError userInfo:userInfo];
+}
+
+inline NSError *abandoned_error()
+{
+    NSDictionary *userInfo = @{NSLocalizedDescriptionKey: @"Promise abandoned error.",
+                               NSLocalizedFailureReasonErrorKey: @"The pz::Promise resolving the future was destroyed before settling it."};
+    return [NSError errorWithDomain:PZErrorDomain code:PZAbandonedError userInfo:userInfo];
+}
+
+
+#pragma mark - Shared state
+
+// The state shared by a pz::Promise and its pz::Future, which follows the same rules as PZPromise: it starts pending and is kept or broken at most once. The value is stored inline and moved out by the single callback, so move-only types work and nothing is boxed.
+template <typename T>
+class shared_state
+{
+public:
+    shared_state() noexcept : _spinLock(OS_SPINLOCK_INIT), _state(PZPromiseStatePending), _claimed(false), _callback(nullptr), _referenceCount(1) {}
+    
+    shared_state(const shared_state &) = delete;
+    shared_state &operator=(const shared_state &) = delete;
+    
+    void retain() noexcept
+    {
+        _referenceCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void release() noexcept
+    {
+        if (_referenceCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+    
+    template <typename... Args>
+    bool keep(Args &&... args)
+    {
+        // Claiming the state first lets the value be constructed outside of the lock.
+        if (_claimed.exchange(true, std::memory_order_acquire))
+        {
+            return false;
+        }
+        
+        try
+        {
+            _value.emplace(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            _reason = error_for_current_exception();
+            publish(PZPromiseStateBroken);
+            throw;
+        }
+        
+        publish(PZPromiseStateKept);
+        return true;
+    }
+    
+    bool break_with(NSError *reason) noexcept
+    {
+        if (_claimed.exchange(true, std::memory_order_acquire))
+        {
+            return false;
+        }
+        
+        _reason = reason;
+        publish(PZPromiseStateBroken);
+        return true;
+    }
+    
+    // A state has at most one callback, which is scheduled right away if the state is already resolved.
+    void set_callback(callback_node *callback) noexcept
+    {
+        OSSpinLockLock(&_spinLock);
+        if (_state == PZPromiseStatePending)
+        {
+            _callback = callback;
+            OSSpinLockUnlock(&_spinLock);
+            return;
+        }
+        OSSpinLockUnlock(&_spinLock);
+        
+        schedule(callback);
+    }
+    
+    PZPromiseState state() const noexcept
+    {
+        OSSpinLockLock(&_spinLock);
+        PZPromiseState state = _state;
+        OSSpinLockUnlock(&_spinLock);
+        
+        return state;
+    }
+    
+    // Only valid once the state is kept.
+    T &value() noexcept
+    {
+        return *_value;
+    }
+    
+    // Only valid once the state is broken.
+    NSError *reason() const noexcept
+    {
+        return _reason;
+    }
+
+protected:
+    virtual ~shared_state() = default;
+
+private:
+    void publish(PZPromiseState state) noexcept
+    {
+        OSSpinLockLock(&_spinLock);
+        _state = state;
+        callback_node *callback = _callback;
+        _callback = nullptr;
+        OSSpinLockUnlock(&_spinLock);
+        
+        if (callback)
+        {
+            schedule(callback);
+        }
+    }
+    
+    mutable OSSpinLock _spinLock;
+    PZPromiseState _state;
+    std::atomic<bool> _claimed;
+    std::optional<T> _value;
+    NSError *_reason;
+    callback_node *_callback;
+    std::atomic<uint32_t> _referenceCount;
+};
+
+
+#pragma mark - Continuations
+
+// Marks a missing on-kept or on-broken function, in which case the upstream result is passed along unchanged.
+struct passthrough
+{
+};
+
+template <typename R>
+struct is_future : std::false_type
+{
+};
+
+template <typename U>
+struct is_future<Future<U>> : std::true_type
+{
+};
+
+// Objective-C thenables which are adopted no matter what they hold. Results typed as plain `id` are checked at runtime instead, like the blocks of PZPromise.
+template <typename R>
+inline constexpr bool is_static_thenable_v = !std::is_same_v<R, id> && (std::is_convertible_v<R, PZPromise *> || std::is_same_v<R, id<PZThenable>>);
+
+// The value type of the future resolved by a function returning R. Returned futures and thenables are adopted, so they resolve to their own values.
+template <typename R, typename = void>
+struct resolved_value
+{
+    using type = R;
+};
+
+template <typename U>
+struct resolved_value<Future<U>>
+{
+    using type = U;
+};
+
+template <typename R>
+struct resolved_value<R, std::enable_if_t<is_static_thenable_v<R>>>
+{
+    using type = id;
+};
+
+template <typename F, typename Argument>
+using resolved_value_t = typename resolved_value<std::decay_t<std::invoke_result_t<F &, Argument>>>::type;
+
+// Whether a function returning R can be fused into the function before it. Futures and thenables have to be adopted, and an `id` might turn out to be a thenable, so those end the fused stages.
+template <typename R>
+inline constexpr bool is_fusible_v = !is_future<R>::value && !is_static_thenable_v<R> && !std::is_same_v<R, id>;
+
+// Two pipeline stages fused into one function, which the compiler can inline into a single call.
+template <typename First, typename Second>
+struct composed
+{
+    First first;
+    Second second;
+    
+    template <typename Argument>
+    auto operator()(Argument &&argument)
+    {
+        return std::invoke(second, std::invoke(first, std::forward<Argument>(argument)));
+    }
+};
+
+template <typename>
+inline constexpr bool dependent_false_v = false;
+
+// Boxes a kept value for Objective-C. Objects are passed through untouched.
+template <typename T>
+id box(const T &value)
+{
+    if constexpr (std::is_convertible_v<T, id>)
+    {
+        return value;
+    }
+    else if constexpr (std::is_arithmetic_v<T>)
+    {
+        return @(value);
+    }
+    else if constexpr (std::is_enum_v<T>)
+    {
+        return @(static_cast<std::underlying_type_t<T>>(value));
+    }
+    else if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        return [NSValue valueWithBytes:&value objCType:@encode(T)];
+    }
+    else
+    {
+        static_assert(dependent_false_v<T>, "Only objects, numbers, enums and trivially copyable values can be bridged to a PZPromise.");
+        return nil;
+    }
+}
+
+// Both the future returned by -then and the continuation waiting on the upstream state, so every step of a chain is a single allocation. It holds one reference for the returned future, and one while it waits on the upstream or adopted state.
+template <typename T, typename U, typename OnKept, typename OnBroken>
+class continuation_state final : public shared_state<U>, public callback_node
+{
+public:
+    continuation_state(shared_state<T> *upstream, OnKept onKept, OnBroken onBroken) : _upstream(upstream), _adopted(nullptr), _onKept(std::move(onKept)), _onBroken(std::move(onBroken))
+    {
+        this->retain();
+    }
+    
+    void run() noexcept override
+    {
+        if (_adopted)
+        {
+            finish_adoption();
+            return;
+        }
+        
+        shared_state<T> *upstream = std::exchange(_upstream, nullptr);
+        bool waiting = false;
+        
+        try
+        {
+            if (upstream->state() == PZPromiseStateKept)
+            {
+                if constexpr (std::is_same_v<OnKept, passthrough>)
+                {
+                    this->keep(std::move(upstream->value()));
+                }
+                else
+                {
+                    waiting = resolve_with(std::invoke(_onKept, std::move(upstream->value())));
+                }
+            }
+            else
+            {
+                if constexpr (std::is_same_v<OnBroken, passthrough>)
+                {
+                    this->break_with(upstream->reason());
+                }
+                else
+                {
+                    waiting = resolve_with(std::invoke(_onBroken, upstream->reason()));
+                }
+            }
+        }
+        catch (...)
+        {
+            this->break_with(error_for_current_exception());
+        }
+        
+        upstream->release();
+        if (!waiting)
+        {
+            this->release();
+        }
+    }
+
+private:
+    // Returns whether the result was adopted, in which case the reference held for waiting carries over to the adopted state.
+    template <typename R>
+    bool resolve_with(R &&result)
+    {
+        using Result = std::decay_t<R>;
+        
+        if constexpr (is_future<Result>::value)
+        {
+            shared_state<U> *adopted = result._release_state();
+            _adopted = adopted;
+            adopted->set_callback(this);
+            return true;
+        }
+        else if constexpr (std::is_same_v<Result, id>)
+        {
+            if ([result conformsToProtocol:@protocol(PZThenable)])
+            {
+                adopt_thenable(result);
+                return true;
+            }
+            
+            this->keep(result);
+            return false;
+        }
+        else if constexpr (is_static_thenable_v<Result>)
+        {
+            if (!result)
+            {
+                this->keep(nil);
+                return false;
+            }
+            
+            adopt_thenable(result);
+            return true;
+        }
+        else
+        {
+            this->keep(std::forward<R>(result));
+            return false;
+        }
+    }
+    
+    void adopt_thenable(id<PZThenable> thenable)
+    {
+        continuation_state *state = this;
+        
+        // PZPromise instances are observed directly, which skips the bound promise -thenOnKept:onBroken: would allocate.
+        if ([thenable isKindOfClass:[PZPromise class]])
+        {
+            PZPromise *promise = (PZPromise *)thenable;
+            [promise onResolved:^{
+                if (promise.state == PZPromiseStateKept)
+                {
+                    state->keep(promise.keptValue);
+                }
+                else
+                {
+                    state->break_with(promise.brokenReason);
+                }
+                state->release();
+            }];
+            return;
+        }
+        
+        // Other thenables are bound to, and the bound thenable is held by its own blocks until one of them runs.
+        __block id<PZThenable> boundThenable = nil;
+        boundThenable = [thenable thenOnKept:^id(id value) {
+            state->keep(value);
+            state->release();
+            boundThenable = nil;
+            return nil;
+        } onBroken:^id(NSError *reason) {
+            state->break_with(reason);
+            state->release();
+            boundThenable = nil;
+            return nil;
+        }];
+    }
+    
+    void finish_adoption() noexcept
+    {
+        shared_state<U> *adopted = std::exchange(_adopted, nullptr);
+        
+        try
+        {
+            if (adopted->state() == PZPromiseStateKept)
+            {
+                this->keep(std::move(adopted->value()));
+            }
+            else
+            {
+                this->break_with(adopted->reason());
+            }
+        }
+        catch (...)
+        {
+            this->break_with(error_for_current_exception());
+        }
+        
+        adopted->release();
+        this->release();
+    }
+    
+    shared_state<T> *_upstream;
+    shared_state<U> *_adopted;
+    OnKept _onKept;
+    OnBroken _onBroken;
+};
+
+// Settles a PZDeferred with the result of a future, boxing the value only once it is kept.
+template <typename T>
+class bridge_node final : public callback_node
+{
+public:
+    explicit bridge_node(shared_state<T> *upstream) : _upstream(upstream), _deferred([PZDeferred deferred]) {}
+    
+    PZPromise *promise() const
+    {
+        return _deferred.promise;
+    }
+    
+    void run() noexcept override
+    {
+        if (_upstream->state() == PZPromiseStateKept)
+        {
+            [_deferred keepWithValue:box(_upstream->value())];
+        }
+        else
+        {
+            [_deferred breakWithReason:_upstream->reason()];
+        }
+        
+        _upstream->release();
+        delete this;
+    }
+
+private:
+    shared_state<T> *_upstream;
+    PZDeferred *_deferred;
+};
+
+} // namespace detail
+
+
+#pragma mark - Future
+
+/**
+ *  The reading half of a typed promise. A future is kept with a value of type T, stored inline without boxing, or broken with an NSError, at most once, following the same rules as PZPromise.
+ *
+ *  Futures are move-only, and chaining consumes them, so every value is moved along the chain rather than copied or retained.
+ *
+ *  @code
+ *  pz::Promise<int64_t> promise;
+ *  pz::Future<int64_t> future = promise.future().then([](int64_t value) {
+ *      return value * 2;
+ *  }).recover([](NSError *reason) {
+ *      return int64_t(0);
+ *  });
+ *  @endcode
+ *
+ *  Continuations run synchronously on the thread which resolves the upstream future, or on the calling thread if it is already resolved. Unlike PZPromise they are not handed to an executor, so they should be quick. A continuation which resolves another future queues that future's continuation rather than running it recursively, so long chains use a constant amount of stack.
+ *
+ *  This class is not thread safe, but a future and the promise resolving it can be used on different threads.
+ */
+template <typename T>
+class Future
+{
+    static_assert(!std::is_void_v<T> && !std::is_reference_v<T>, "pz::Future values must be object types.");
+
+public:
+    using value_type = T;
+    
+    /**
+     *  Creates an invalid future, which can only be assigned to.
+     */
+    Future() noexcept : _state(nullptr) {}
+    
+    Future(Future &&other) noexcept : _state(std::exchange(other._state, nullptr)) {}
+    
+    Future &operator=(Future &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_state)
+            {
+                _state->release();
+            }
+            _state = std::exchange(other._state, nullptr);
+        }
+        return *this;
+    }
+    
+    Future(const Future &) = delete;
+    Future &operator=(const Future &) = delete;
+    
+    ~Future()
+    {
+        if (_state)
+        {
+            _state->release();
+        }
+    }
+    
+    /**
+     *  Creates a future which is already kept.
+     *
+     *  @param value The value to keep the future with.
+     *
+     *  @return A kept future.
+     */
+    static Future kept(T value)
+    {
+        detail::shared_state<T> *state = new detail::shared_state<T>();
+        state->keep(std::move(value));
+        return Future(state);
+    }
+    
+    /**
+     *  Creates a future which is already broken.
+     *
+     *  @param reason The reason to break the future with.
+     *
+     *  @return A broken future.
+     */
+    static Future broken(NSError *reason)
+    {
+        detail::shared_state<T> *state = new detail::shared_state<T>();
+        state->break_with(reason);
+        return Future(state);
+    }
+    
+    /**
+     *  Whether the receiver refers to a result. Futures are invalid once they are chained or moved from.
+     */
+    bool valid() const noexcept
+    {
+        return _state != nullptr;
+    }
+    
+    PZPromiseState state() const noexcept
+    {
+        return _state->state();
+    }
+    
+    /**
+     *  The kept value. Only valid while the receiver is kept and has not been chained.
+     */
+    const T &value() const noexcept
+    {
+        return _state->value();
+    }
+    
+    /**
+     *  The broken reason. Only valid while the receiver is broken and has not been chained.
+     */
+    NSError *reason() const noexcept
+    {
+        return _state->reason();
+    }
+    
+    /**
+     *  Chains a function to the kept value, consuming the receiver. A broken receiver passes its reason along without invoking the function.
+     *
+     *  The function's result keeps the returned future. If it returns a pz::Future, a PZPromise or an `id<PZThenable>`, or an `id` which turns out to conform to PZThenable, the returned future adopts its state instead. If it throws, the returned future is broken with a PZExceptionError.
+     *
+     *  @param onKept The function invoked with the kept value, moved out of the receiver.
+     *
+     *  @return A future for the function's result.
+     */
+    template <typename OnKept>
+    Future<detail::resolved_value_t<OnKept, T &&>> then(OnKept &&onKept) &&
+    {
+        using U = detail::resolved_value_t<OnKept, T &&>;
+        return std::move(*this).template chain<U>(std::forward<OnKept>(onKept), detail::passthrough());
+    }
+    
+    /**
+     *  Chains a function to the kept value and another to the broken reason, consuming the receiver. Both functions must resolve to the same type.
+     *
+     *  @param onKept   The function invoked with the kept value.
+     *  @param onBroken The function invoked with the broken reason.
+     *
+     *  @return A future for the result of whichever function was invoked.
+     */
+    template <typename OnKept, typename OnBroken>
+    Future<detail::resolved_value_t<OnKept, T &&>> then(OnKept &&onKept, OnBroken &&onBroken) &&
+    {
+        using U = detail::resolved_value_t<OnKept, T &&>;
+        static_assert(std::is_same_v<U, detail::resolved_value_t<OnBroken, NSError *>>, "The on-kept and on-broken functions must resolve to the same type.");
+        return std::move(*this).template chain<U>(std::forward<OnKept>(onKept), std::forward<OnBroken>(onBroken));
+    }
+    
+    /**
+     *  Chains a function to the broken reason, consuming the receiver. A kept receiver passes its value along without invoking the function.
+     *
+     *  @param onBroken The function invoked with the broken reason, which must resolve to T.
+     *
+     *  @return A future for the receiver's value, or the function's result.
+     */
+    template <typename OnBroken>
+    Future<T> recover(OnBroken &&onBroken) &&
+    {
+        static_assert(std::is_same_v<T, detail::resolved_value_t<OnBroken, NSError *>>, "The on-broken function must resolve to the future's value type.");
+        return std::move(*this).template chain<T>(detail::passthrough(), std::forward<OnBroken>(onBroken));
+    }
+    
+    /**
+     *  Starts a pipeline of synchronous transforms on the kept value, consuming the receiver. Consecutive stages added with -map are fused into one function at compile time, so the whole pipeline costs a single continuation, which is only allocated once the pipeline is chained with -then or -recover, converted to a future, or bridged.
+     *
+     *  @code
+     *  pz::Future<std::string> future = std::move(lengths).map([](int64_t length) {
+     *      return length * 2;
+     *  }).map([](int64_t length) {
+     *      return std::to_string(length);
+     *  });
+     *  @endcode
+     *
+     *  @param transform A function from the kept value to a plain value. Functions returning futures, thenables or `id` must be chained with -then instead.
+     *
+     *  @return A pipeline with a single stage.
+     */
+    template <typename Transform>
+    Pipeline<T, std::decay_t<Transform>> map(Transform &&transform) &&
+    {
+        static_assert(detail::is_fusible_v<std::decay_t<std::invoke_result_t<std::decay_t<Transform> &, T &&>>>, "Pipeline stages must return plain values. Chain functions returning futures, thenables or id with then.");
+        return Pipeline<T, std::decay_t<Transform>>(std::move(*this), std::forward<Transform>(transform));
+    }
+    
+    /**
+     *  Bridges the receiver to Objective-C, consuming it. The value is only boxed once it is kept: objects are passed through, numbers and enums become NSNumber instances, and other trivially copyable values become NSValue instances.
+     *
+     *  @note The bridge is a PZPromise rather than a thinner PZThenable over the receiver's state. A future has a single callback, while a thenable can be chained any number of times, so an adapter would need a promise to fan out to its callers anyway. The value has to be boxed for the blocks as well, so bridging costs a deferred and one box, paid once where the chain crosses into Objective-C. Keep chains in C++ until then.
+     *
+     *  @return A promise which is kept or broken along with the receiver.
+     */
+    PZPromise *to_promise() &&
+    {
+        detail::shared_state<T> *upstream = std::exchange(_state, nullptr);
+        detail::bridge_node<T> *node = new detail::bridge_node<T>(upstream);
+        PZPromise *promise = node->promise();
+        upstream->set_callback(node);
+        return promise;
+    }
+
+private:
+    template <typename>
+    friend class Future;
+    
+    template <typename>
+    friend class Promise;
+    
+    template <typename, typename, typename, typename>
+    friend class detail::continuation_state;
+    
+    template <typename, typename>
+    friend class Pipeline;
+    
+    explicit Future(detail::shared_state<T> *state) noexcept : _state(state) {}
+    
+    detail::shared_state<T> *_release_state() noexcept
+    {
+        return std::exchange(_state, nullptr);
+    }
+    
+    template <typename U, typename OnKept, typename OnBroken>
+    Future<U> chain(OnKept &&onKept, OnBroken &&onBroken) &&
+    {
+        using Continuation = detail::continuation_state<T, U, std::decay_t<OnKept>, std::decay_t<OnBroken>>;
+        
+        detail::shared_state<T> *upstream = std::exchange(_state, nullptr);
+        Continuation *continuation = new Continuation(upstream, std::forward<OnKept>(onKept), std::forward<OnBroken>(onBroken));
+        Future<U> future(continuation);
+        upstream->set_callback(continuation);
+        return future;
+    }
+    
+    detail::shared_state<T> *_state;
+};
+
+
+#pragma mark - Pipeline
+
+/**
+ *  Synchronous transforms waiting to be fused into a single continuation of a future, created with -[Future map]. Every -map adds a stage to the fused function without allocating, and the continuation is only created once the pipeline is chained or converted to a future.
+ *
+ *  The stages run one after the other in the same continuation, so an exception from any of them breaks the resulting future with a PZExceptionError, and a broken source skips all of them.
+ *
+ *  Pipelines are move-only and consumed by every method.
+ */
+template <typename T, typename Stages>
+class Pipeline
+{
+public:
+    using value_type = detail::resolved_value_t<Stages, T &&>;
+    
+    Pipeline(Pipeline &&other) = default;
+    Pipeline &operator=(Pipeline &&other) = default;
+    
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+    
+    /**
+     *  Adds a stage to the pipeline.
+     *
+     *  @param transform A function from the previous stage's result to a plain value.
+     *
+     *  @return A pipeline running the receiver's stages followed by the transform.
+     */
+    template <typename Transform>
+    Pipeline<T, detail::composed<Stages, std::decay_t<Transform>>> map(Transform &&transform) &&
+    {
+        static_assert(detail::is_fusible_v<std::decay_t<std::invoke_result_t<std::decay_t<Transform> &, value_type &&>>>, "Pipeline stages must return plain values. Chain functions returning futures, thenables or id with then.");
+        return Pipeline<T, detail::composed<Stages, std::decay_t<Transform>>>(std::move(_source), detail::composed<Stages, std::decay_t<Transform>>{std::move(_stages), std::forward<Transform>(transform)});
+    }
+    
+    /**
+     *  Ends the pipeline with a function which may return a future or thenable to adopt, fused into the same continuation as the other stages.
+     *
+     *  @param onKept The function invoked with the last stage's result.
+     *
+     *  @return A future for the function's result.
+     */
+    template <typename OnKept>
+    auto then(OnKept &&onKept) &&
+    {
+        using Fused = detail::composed<Stages, std::decay_t<OnKept>>;
+        using U = detail::resolved_value_t<Fused, T &&>;
+        return std::move(_source).template chain<U>(Fused{std::move(_stages), std::forward<OnKept>(onKept)}, detail::passthrough());
+    }
+    
+    /**
+     *  Ends the pipeline with a function invoked if the source or any stage breaks.
+     *
+     *  @param onBroken The function invoked with the broken reason, which must resolve to value_type.
+     *
+     *  @return A future for the pipeline's result, or the function's result.
+     */
+    template <typename OnBroken>
+    Future<value_type> recover(OnBroken &&onBroken) &&
+    {
+        return std::move(*this).future().recover(std::forward<OnBroken>(onBroken));
+    }
+    
+    /**
+     *  Creates the single continuation running every stage.
+     *
+     *  @return A future for the last stage's result.
+     */
+    Future<value_type> future() &&
+    {
+        return std::move(_source).template chain<value_type>(std::move(_stages), detail::passthrough());
+    }
+    
+    operator Future<value_type>() &&
+    {
+        return std::move(*this).future();
+    }
+    
+    /**
+     *  Bridges the pipeline's result to Objective-C, like -[Future to_promise].
+     *
+     *  @return A promise which is kept or broken along with the pipeline.
+     */
+    PZPromise *to_promise() &&
+    {
+        return std::move(*this).future().to_promise();
+    }
+
+private:
+    template <typename>
+    friend class Future;
+    
+    template <typename, typename>
+    friend class Pipeline;
+    
+    Pipeline(Future<T> &&source, Stages stages) : _source(std::move(source)), _stages(std::move(stages)) {}
+    
+    Future<T> _source;
+    Stages _stages;
+};
+
+
+#pragma mark - Promise
+
+/**
+ *  The resolving half of a typed promise, like PZDeferred is for PZPromise. If a promise is destroyed while its future is still pending, the future is broken with a PZAbandonedError.
+ */
+template <typename T>
+class Promise
+{
+public:
+    Promise() : _state(new detail::shared_state<T>()), _futureRetrieved(false) {}
+    
+    Promise(Promise &&other) noexcept : _state(std::exchange(other._state, nullptr)), _futureRetrieved(other._futureRetrieved) {}
+    
+    Promise &operator=(Promise &&other) noexcept
+    {
+        if (this != &other)
+        {
+            abandon();
+            _state = std::exchange(other._state, nullptr);
+            _futureRetrieved = other._futureRetrieved;
+        }
+        return *this;
+    }
+    
+    Promise(const Promise &) = delete;
+    Promise &operator=(const Promise &) = delete;
+    
+    ~Promise()
+    {
+        abandon();
+    }
+    
+    /**
+     *  The future resolved by the receiver. This can only be retrieved once.
+     */
+    Future<T> future()
+    {
+        NSCAssert(!_futureRetrieved, @"The future of a pz::Promise can only be retrieved once.");
+        _futureRetrieved = true;
+        _state->retain();
+        return Future<T>(_state);
+    }
+    
+    /**
+     *  Keeps the future with a value, which is moved into it.
+     *
+     *  @return true if the future was kept, or false if it was already resolved.
+     */
+    bool keep(T value)
+    {
+        return _state->keep(std::move(value));
+    }
+    
+    /**
+     *  Breaks the future with a reason.
+     *
+     *  @return true if the future was broken, or false if it was already resolved.
+     */
+    bool break_with(NSError *reason) noexcept
+    {
+        return _state->break_with(reason);
+    }
+
+private:
+    void abandon() noexcept
+    {
+        if (_state)
+        {
+            _state->break_with(detail::abandoned_error());
+            _state->release();
+            _state = nullptr;
+        }
+    }
+    
+    detail::shared_state<T> *_state;
+    bool _futureRetrieved;
+};
+
+/**
+ *  Bridges an Objective-C thenable into a future, which adopts its state.
+ *
+ *  @param thenable The thenable to adopt. A nil thenable gives a future kept with nil.
+ *
+ *  @return A future kept or broken along with the thenable.
+ */
+inline Future<id> future_from_thenable(id<PZThenable> thenable)
+{
+    return Future<id>::kept(thenable).then([](id value) {
+        return value;
+    });
+}
+
+} // namespace pz
+
+#endif
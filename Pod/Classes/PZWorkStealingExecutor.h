@@ -0,0 +1,59 @@
+//
+//  PZWorkStealingExecutor.h
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/20/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PZPromise.h"
+
+/**
+ *  A fixed pool of worker threads which executes blocks. PZPromise uses the shared executor to run its on-kept and on-broken blocks.
+ *
+ *  Every worker owns a Chase-Lev deque. A block submitted from a worker thread, such as a continuation scheduled by the continuation currently running, is pushed onto that worker's deque and popped in LIFO order, so it usually runs next on the same thread while its data is still in the cache. Blocks submitted from other threads go through a shared queue. Idle workers take from the shared queue, then steal the oldest blocks from the other workers' deques, and finally sleep until new work arrives.
+ *
+ *  Since the number of threads is fixed no matter how much work is pending, blocks should avoid waiting synchronously on work which may itself need a worker. -[PZPromise waitWithTimeout:] softens this by executing pending blocks while it waits, starting with the waiting worker's own deque.
+ *
+ *  Priorities are ignored, since workers prefer their own most recent blocks. Use a PZPriorityExecutor when chains of different priorities compete for workers.
+ *
+ *  This class is thread safe.
+ */
+@interface PZWorkStealingExecutor : NSObject <PZExecutor>
+
+/**
+ *  The executor shared by PromiseZ, which has one worker per active processor.
+ *
+ *  @return The shared executor.
+ */
++ (instancetype)sharedExecutor;
+
+/**
+ *  Initializes an executor with one worker per active processor, and at least two workers.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)init;
+
+/**
+ *  The designated initializer. Workers are started right away.
+ *
+ *  @note Blocks which are still queued when the receiver is deallocated are executed before its workers exit.
+ *
+ *  @param workerCount The number of worker threads. Must be greater than 0.
+ *
+ *  @return An initialized instance of the receiver.
+ */
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount NS_DESIGNATED_INITIALIZER;
+
+@property (assign, nonatomic, readonly) NSUInteger workerCount;
+
+/**
+ *  Executes a block asynchronously on one of the receiver's workers. This never executes the block before returning, even when called from a worker.
+ *
+ *  @param block The block to execute. This must not be nil.
+ */
+- (void)executeBlock:(dispatch_block_t)block;
+
+@end
@@ -0,0 +1,546 @@
+//
+//  PZWorkStealingExecutor.m
+//  PromiseZ
+//
+//  Created by Zach Radke on 4/20/15.
+//  Copyright (c) 2015 Zach Radke. All rights reserved.
+//
+
+#import "PZWorkStealingExecutor.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import <sched.h>
+#import <stdatomic.h>
+
+static int64_t const _PZWorkDequeInitialCapacity = 64;
+
+// The number of times an idle worker yields and looks for work again before going to sleep. Waking a sleeping worker costs a system call, so a short spin pays off when continuations arrive in quick succession.
+static NSUInteger const _PZWorkStealingSpinCount = 16;
+
+// Returned by a steal which lost a race with the owner or another thief. Unlike an empty deque, the victim may still have work.
+static char _PZWorkDequeAbortMarker;
+
+static pthread_key_t _PZCurrentWorkerKey;
+
+
+#pragma mark - _PZWorkDeque
+
+// The deque from "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al., 2013). Items are retained blocks. Only the owning worker pushes and takes from the bottom, while any thread may steal from the top.
+typedef struct _PZWorkDequeBuffer
+{
+    int64_t capacity;
+    // Thieves may still be reading a buffer after it has been replaced, so replaced buffers are only freed along with the deque.
+    struct _PZWorkDequeBuffer *retired;
+    _Atomic(void *) items[];
+} _PZWorkDequeBuffer;
+
+typedef struct
+{
+    _Atomic(int64_t) top;
+    _Atomic(int64_t) bottom;
+    _Atomic(_PZWorkDequeBuffer *) buffer;
+} _PZWorkDeque;
+
+static _PZWorkDequeBuffer *_PZWorkDequeBufferCreate(int64_t capacity)
+{
+    _PZWorkDequeBuffer *buffer = calloc(1, sizeof(_PZWorkDequeBuffer) + (size_t)capacity * sizeof(_Atomic(void *)));
+    buffer->capacity = capacity;
+    return buffer;
+}
+
+static void _PZWorkDequeInit(_PZWorkDeque *deque)
+{
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->buffer, _PZWorkDequeBufferCreate(_PZWorkDequeInitialCapacity));
+}
+
+// Must only be called once no other thread can reach the deque. Items which were never taken are released.
+static void _PZWorkDequeDestroy(_PZWorkDeque *deque)
+{
+    _PZWorkDequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    
+    for (int64_t i = top; i < bottom; i++)
+    {
+        CFRelease(atomic_load_explicit(&buffer->items[i & (buffer->capacity - 1)], memory_order_relaxed));
+    }
+    
+    while (buffer)
+    {
+        _PZWorkDequeBuffer *retired = buffer->retired;
+        free(buffer);
+        buffer = retired;
+    }
+}
+
+// Owner only.
+static void _PZWorkDequePush(_PZWorkDeque *deque, void *item)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    _PZWorkDequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    
+    if (bottom - top > buffer->capacity - 1)
+    {
+        _PZWorkDequeBuffer *grownBuffer = _PZWorkDequeBufferCreate(buffer->capacity * 2);
+        for (int64_t i = top; i < bottom; i++)
+        {
+            void *movedItem = atomic_load_explicit(&buffer->items[i & (buffer->capacity - 1)], memory_order_relaxed);
+            atomic_store_explicit(&grownBuffer->items[i & (grownBuffer->capacity - 1)], movedItem, memory_order_relaxed);
+        }
+        
+        grownBuffer->retired = buffer;
+        atomic_store_explicit(&deque->buffer, grownBuffer, memory_order_release);
+        buffer = grownBuffer;
+    }
+    
+    atomic_store_explicit(&buffer->items[bottom & (buffer->capacity - 1)], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+// Owner only. Takes the most recently pushed item, or returns NULL if the deque is empty.
+static void *_PZWorkDequeTake(_PZWorkDeque *deque)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    _PZWorkDequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    
+    if (top > bottom)
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    
+    void *item = atomic_load_explicit(&buffer->items[bottom & (buffer->capacity - 1)], memory_order_relaxed);
+    if (top == bottom)
+    {
+        // The last item may also be wanted by a thief, so whoever advances the top gets it.
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            item = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    
+    return item;
+}
+
+// Any thread. Takes the oldest item, returns NULL if the deque is empty, or &_PZWorkDequeAbortMarker if another thread won the item.
+static void *_PZWorkDequeSteal(_PZWorkDeque *deque)
+{
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    
+    _PZWorkDequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_acquire);
+    void *item = atomic_load_explicit(&buffer->items[top & (buffer->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return &_PZWorkDequeAbortMarker;
+    }
+    
+    return item;
+}
+
+
+#pragma mark - _PZWorkStealingWorker
+
+@class _PZWorkStealingPool;
+
+@interface _PZWorkStealingWorker : NSObject
+{
+    @public
+    _PZWorkDeque _deque;
+    uint32_t _randomState;
+    
+    // Only used to tell whether the current thread's worker belongs to a given pool. The pool always outlives its workers' threads.
+    __unsafe_unretained _PZWorkStealingPool *_pool;
+}
+
+@end
+
+@implementation _PZWorkStealingWorker
+
+- (instancetype)initWithPool:(_PZWorkStealingPool *)pool index:(NSUInteger)index
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _PZWorkDequeInit(&_deque);
+    _randomState = (uint32_t)((index + 1) * 0x9E3779B9U);
+    _pool = pool;
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    _PZWorkDequeDestroy(&_deque);
+}
+
+@end
+
+
+#pragma mark - _PZWorkStealingPool
+
+// The state shared by the workers. It is separate from PZWorkStealingExecutor because the worker threads retain it, so the executor itself can still be deallocated and stop them.
+@interface _PZWorkStealingPool : NSObject
+{
+    @public
+    OSSpinLock _spinLock;
+    NSMutableArray *_sharedQueue;
+    _Atomic(int64_t) _sharedCount;
+    
+    NSArray *_workers;
+    __unsafe_unretained _PZWorkStealingWorker **_workerList;
+    NSUInteger _workerCount;
+    
+    dispatch_semaphore_t _wakeSemaphore;
+    _Atomic(int32_t) _sleepingCount;
+    _Atomic(bool) _stopped;
+}
+
+@end
+
+@implementation _PZWorkStealingPool
+
++ (void)initialize
+{
+    if (self == [_PZWorkStealingPool class])
+    {
+        pthread_key_create(&_PZCurrentWorkerKey, NULL);
+    }
+}
+
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount
+{
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _spinLock = OS_SPINLOCK_INIT;
+    _sharedQueue = [NSMutableArray new];
+    atomic_init(&_sharedCount, 0);
+    atomic_init(&_sleepingCount, 0);
+    atomic_init(&_stopped, false);
+    _wakeSemaphore = dispatch_semaphore_create(0);
+    
+    NSMutableArray *workers = [NSMutableArray arrayWithCapacity:workerCount];
+    _workerList = (__unsafe_unretained _PZWorkStealingWorker **)calloc(workerCount, sizeof(_PZWorkStealingWorker *));
+    for (NSUInteger i = 0; i < workerCount; i++)
+    {
+        _PZWorkStealingWorker *worker = [[_PZWorkStealingWorker alloc] initWithPool:self index:i];
+        [workers addObject:worker];
+        _workerList[i] = worker;
+    }
+    
+    _workers = [workers copy];
+    _workerCount = workerCount;
+    
+    // The workers are only started once the list is complete, since they immediately start stealing from each other.
+    for (NSUInteger i = 0; i < workerCount; i++)
+    {
+        NSThread *thread = [[NSThread alloc] initWithTarget:self selector:@selector(_runWorker:) object:_workers[i]];
+        thread.name = [NSString stringWithFormat:@"com.zachradke.promiseZ.worker.%lu", (unsigned long)i];
+        [thread start];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_workerList);
+}
+
+- (void)executeBlock:(dispatch_block_t)block
+{
+    _PZWorkStealingWorker *worker = (__bridge _PZWorkStealingWorker *)pthread_getspecific(_PZCurrentWorkerKey);
+    
+    if (worker && worker->_pool == self)
+    {
+        _PZWorkDequePush(&worker->_deque, (void *)CFBridgingRetain(block));
+    }
+    else
+    {
+        OSSpinLockLock(&_spinLock);
+        [_sharedQueue addObject:block];
+        atomic_fetch_add_explicit(&_sharedCount, 1, memory_order_relaxed);
+        OSSpinLockUnlock(&_spinLock);
+    }
+    
+    // Pairs with the increment of the sleeping count in -_runWorker:, so either this sees the sleeper, or the sleeper sees the block.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&_sleepingCount, memory_order_relaxed) > 0)
+    {
+        dispatch_semaphore_signal(_wakeSemaphore);
+    }
+}
+
+- (BOOL)executePendingBlock
+{
+    _PZWorkStealingWorker *worker = (__bridge _PZWorkStealingWorker *)pthread_getspecific(_PZCurrentWorkerKey);
+    
+    // A worker helps with its own deque first, since that is where the work it is waiting for was most likely pushed. Other threads can only take from the shared queue and steal.
+    dispatch_block_t block;
+    if (worker && worker->_pool == self)
+    {
+        block = [self _nextBlockForWorker:worker];
+    }
+    else
+    {
+        block = [self _dequeueSharedBlock] ?: [self _stealBlockForWorker:nil];
+    }
+    
+    if (!block)
+    {
+        return NO;
+    }
+    
+    block();
+    return YES;
+}
+
+- (void)stop
+{
+    atomic_store(&_stopped, true);
+    
+    for (NSUInteger i = 0; i < _workerCount; i++)
+    {
+        dispatch_semaphore_signal(_wakeSemaphore);
+    }
+}
+
+
+#pragma mark Private
+
+- (void)_runWorker:(_PZWorkStealingWorker *)worker
+{
+    pthread_setspecific(_PZCurrentWorkerKey, (__bridge void *)worker);
+    
+    NSUInteger idleCount = 0;
+    while (YES)
+    {
+        @autoreleasepool
+        {
+            dispatch_block_t block = [self _nextBlockForWorker:worker];
+            if (block)
+            {
+                idleCount = 0;
+                block();
+                continue;
+            }
+        }
+        
+        // Queued blocks are always executed before a stopped worker exits.
+        if (atomic_load(&_stopped))
+        {
+            break;
+        }
+        
+        if (idleCount < _PZWorkStealingSpinCount)
+        {
+            idleCount += 1;
+            sched_yield();
+            continue;
+        }
+        
+        atomic_fetch_add(&_sleepingCount, 1);
+        
+        @autoreleasepool
+        {
+            dispatch_block_t block = [self _nextBlockForWorker:worker];
+            if (!block && !atomic_load(&_stopped))
+            {
+                dispatch_semaphore_wait(_wakeSemaphore, DISPATCH_TIME_FOREVER);
+            }
+            
+            atomic_fetch_sub(&_sleepingCount, 1);
+            idleCount = 0;
+            
+            if (block)
+            {
+                block();
+            }
+        }
+    }
+    
+    pthread_setspecific(_PZCurrentWorkerKey, NULL);
+}
+
+- (dispatch_block_t)_nextBlockForWorker:(_PZWorkStealingWorker *)worker
+{
+    void *item = _PZWorkDequeTake(&worker->_deque);
+    if (item)
+    {
+        return (__bridge_transfer dispatch_block_t)item;
+    }
+    
+    dispatch_block_t block = [self _dequeueSharedBlock];
+    if (block)
+    {
+        return block;
+    }
+    
+    return [self _stealBlockForWorker:worker];
+}
+
+- (dispatch_block_t)_dequeueSharedBlock
+{
+    // Checking the count first keeps idle workers from contending for the lock.
+    if (atomic_load_explicit(&_sharedCount, memory_order_relaxed) == 0)
+    {
+        return nil;
+    }
+    
+    OSSpinLockLock(&_spinLock);
+    dispatch_block_t block = _sharedQueue.firstObject;
+    if (block)
+    {
+        [_sharedQueue removeObjectAtIndex:0];
+        atomic_fetch_sub_explicit(&_sharedCount, 1, memory_order_relaxed);
+    }
+    OSSpinLockUnlock(&_spinLock);
+    
+    return block;
+}
+
+- (dispatch_block_t)_stealBlockForWorker:(_PZWorkStealingWorker *)worker
+{
+    BOOL didLoseRace;
+    do
+    {
+        didLoseRace = NO;
+        
+        // Starting at a random victim spreads thieves out, so they don't all contend for the same deque. Threads helping from outside the pool have no random state of their own.
+        NSUInteger start;
+        if (worker)
+        {
+            worker->_randomState ^= worker->_randomState << 13;
+            worker->_randomState ^= worker->_randomState >> 17;
+            worker->_randomState ^= worker->_randomState << 5;
+            start = worker->_randomState % _workerCount;
+        }
+        else
+        {
+            start = arc4random_uniform((uint32_t)_workerCount);
+        }
+        
+        for (NSUInteger i = 0; i < _workerCount; i++)
+        {
+            _PZWorkStealingWorker *victim = _workerList[(start + i) % _workerCount];
+            if (victim == worker)
+            {
+                continue;
+            }
+            
+            void *item = _PZWorkDequeSteal(&victim->_deque);
+            if (item == &_PZWorkDequeAbortMarker)
+            {
+                didLoseRace = YES;
+            }
+            else if (item)
+            {
+                return (__bridge_transfer dispatch_block_t)item;
+            }
+        }
+    }
+    while (didLoseRace);
+    
+    return nil;
+}
+
+@end
+
+
+#pragma mark - PZWorkStealingExecutor
+
+@interface PZWorkStealingExecutor ()
+
+@property (strong, nonatomic, readonly) _PZWorkStealingPool *pool;
+
+@end
+
+@implementation PZWorkStealingExecutor
+
++ (instancetype)sharedExecutor
+{
+    static PZWorkStealingExecutor *sharedExecutor;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedExecutor = [self new];
+    });
+    
+    return sharedExecutor;
+}
+
+- (instancetype)init
+{
+    return [self initWithWorkerCount:MAX([NSProcessInfo processInfo].activeProcessorCount, 2)];
+}
+
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount
+{
+    NSParameterAssert(workerCount > 0);
+    
+    if (!(self = [super init]))
+    {
+        return nil;
+    }
+    
+    _workerCount = workerCount;
+    _pool = [[_PZWorkStealingPool alloc] initWithWorkerCount:workerCount];
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_pool stop];
+}
+
+- (void)executeBlock:(dispatch_block_t)block
+{
+    NSParameterAssert(block);
+    
+    [self.pool executeBlock:[block copy]];
+}
+
+
+#pragma mark PZExecutor
+
+- (void)executeBlock:(dispatch_block_t)block priority:(PZPromisePriority)priority
+{
+    NSParameterAssert(priority >= PZPromisePriorityLow && priority <= PZPromisePriorityHigh);
+    
+    // This executor has no notion of priority, so the priority is only validated and then ignored.
+    [self executeBlock:block];
+}
+
+- (BOOL)executePendingBlock
+{
+    return [self.pool executePendingBlock];
+}
+
+
+#pragma mark NSObject
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@:%p> workerCount:%lu", [self class], self, (unsigned long)self.workerCount];
+}
+
+@end